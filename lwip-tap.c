@@ -41,11 +41,11 @@
 #include <unistd.h>
 #include "lwip/tcpip.h"
 #include "chargen.h"
-#include "httpserver-netconn.h"
 #include "tapif.h"
 #include "tcpecho.h"
 #include "udpecho.h"
 #include "pong.h" // mod pong
+#include "pong_http.h" // mod pong: httpserver-netconn with the pong metrics
 
 /* exported in lwipopts.h */
 unsigned char debug_flags = LWIP_DBG_OFF;
@@ -172,9 +172,9 @@ void
 help(void)
 {
 #ifdef LWIP_DEBUG
-  fprintf(stderr,"Usage: lwip-tap [-CEHPdh] -i addr=<addr>,netmask=<addr>,name=<name>,gw=<addr> [...]\n");
+  fprintf(stderr,"Usage: lwip-tap [-CEHPRdh] [-F physics_hz[:input_hz[:snapshot_hz]]] [-S delay_ms] [-T workers] [-J journal[:max_mb]] [-X events] [-B seconds] -i addr=<addr>,netmask=<addr>,name=<name>,gw=<addr> [...]\n");
 #else
-  fprintf(stderr,"Usage: lwip-tap [-CEHPh] -i addr=<addr>,netmask=<addr>,name=<name>,gw=<addr> [...]\n");
+  fprintf(stderr,"Usage: lwip-tap [-CEHPRh] [-F physics_hz[:input_hz[:snapshot_hz]]] [-S delay_ms] [-T workers] [-J journal[:max_mb]] [-X events] [-B seconds] -i addr=<addr>,netmask=<addr>,name=<name>,gw=<addr> [...]\n");
 #endif
   exit(0);
 }
@@ -188,6 +188,7 @@ main(int argc,char *argv[])
   struct netif netif[NETIF_MAX];
   int ch;
   int n = 0;
+  int pong_mode = 0; // mod pong: 'P' or 'R', started once every option is read
 
   memset(tapif,0,sizeof(tapif));
   memset(netif,0,sizeof(netif));
@@ -195,9 +196,9 @@ main(int argc,char *argv[])
   tcpip_init(NULL,NULL);
 
 #ifdef LWIP_DEBUG
-  while ((ch = getopt(argc,argv,"CEHPdhi:")) != -1) {
+  while ((ch = getopt(argc,argv,"CEHPRF:S:T:J:X:B:dhi:")) != -1) {
 #else
-  while ((ch = getopt(argc,argv,"CEHPhi:")) != -1) {
+  while ((ch = getopt(argc,argv,"CEHPRF:S:T:J:X:B:hi:")) != -1) {
 #endif
     switch (ch) {
     case 'C':
@@ -208,10 +209,41 @@ main(int argc,char *argv[])
       tcpecho_init();
       break;
     case 'P':
-      pong_init(); // mod pong
+      pong_mode = ch; // mod pong
+      break;
+    case 'R':
+      pong_mode = ch; // mod pong: same server on the raw TCP API
+      break;
+    case 'F': {
+      unsigned int hz[3] = {0, 0, 0};
+      sscanf(optarg, "%u:%u:%u", &hz[0], &hz[1], &hz[2]);
+      pong_set_rates(hz[0], hz[1], hz[2]); // mod pong: simulation/input/snapshot rates
+      break;
+    }
+    case 'S':
+      pong_set_spectator_delay(atoi(optarg)); // mod pong: spectator broadcast delay
+      break;
+    case 'T':
+      pong_set_workers(atoi(optarg)); // mod pong: cores the matches are stepped on
+      break;
+    case 'J': {
+      char *mb = strrchr(optarg, ':');
+      unsigned int max_mb = 0;
+      if (mb && mb[1] && strspn(mb + 1, "0123456789") == strlen(mb + 1)) {
+        *mb = '\0';
+        max_mb = (unsigned int)atoi(mb + 1);
+      }
+      pong_set_journal(optarg, max_mb); // mod pong: input journal, replayed to recover matches, and its size cap
+      break;
+    }
+    case 'X':
+      pong_set_trace(atoi(optarg)); // mod pong: frame phase profiler, events kept per ring
+      break;
+    case 'B':
+      pong_set_report_interval(atoi(optarg)); // mod pong: frame timing report
       break;
     case 'H':
-      http_server_netconn_init();
+      pong_http_init(); // mod pong: httpserver-netconn, plus /metrics, /metrics.json and /trace.json
       break;
 #ifdef LWIP_DEBUG
     case 'd':
@@ -249,6 +281,10 @@ main(int argc,char *argv[])
   argv += optind;
   if (n <= 0)
     help();
+  if (pong_mode == 'P')
+    pong_init(); // mod pong: after getopt, so -F, -T, -J and -X may come in any order
+  else if (pong_mode == 'R')
+    pong_init_raw(); // mod pong
   pause();
   return -1;
 }
@@ -0,0 +1,358 @@
+/*
+  -------------------------------------------------------------------------------
+  Pong Microbenchmarks: the server's hot loop without a TAP device
+  -------------------------------------------------------------------------------
+
+  Runs the pieces of the server that cost time every frame, on their own:
+
+      physics      → pong_game_step() over many matches, as the game loop ticks them
+      batch        → pong_batch_step() over the same matches, vectorized (pong_batch.h)
+      pool         → pong_game_step() spread over 1, 2, 4... workers (pong_pool.h)
+      parse_input  → pong_parse_input() on INPUT lines, as client_line() reads them
+      STATE        → pong_format_state() / pong_parse_state(), the text protocol
+      delta        → pong_encode_delta() / pong_decode_delta(), the binary protocol
+
+  The paddles follow the ball, with a random slip now and then, and every so
+  often stop watching it for a whole second, so the matches rally, bounce,
+  score and serve again like real ones. Everything is seeded: two runs
+  simulate exactly the same games, and print the same checksum. The batch run
+  replays the games of the physics run and must score the same points and end
+  in exactly the same state, lanes that scored and served again included, and
+  every pool run must end in those games too, whatever the number of workers.
+  The exit status is 1 if one doesn't, or if the physics run scored no point:
+  too few ticks for a serve and a miss, and nothing would check scoring.
+
+  Usage: pong_bench [matches] [ticks]
+
+  -------------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pong_clock.h"
+#include "pong_game.h"
+#include "pong_batch.h"
+#include "pong_pool.h"
+#include "pong_proto.h"
+
+#define DEFAULT_MATCHES 10000  // Matches ticked side by side
+#define DEFAULT_TICKS 1200     // Ticks per match (20 s of play at 60 Hz)
+#define PHYSICS_HZ 60          // Simulation rate, the server's default
+#define SERVE_TICKS (3 * PHYSICS_HZ)
+#define CODEC_LOOPS 1000000    // Calls timed for each encoder and decoder
+#define MISS_ONE_IN 16         // Ticks in which a paddle ignores the ball
+#define LAPSE_TICKS 60         // Length of a stretch a paddle stops following the ball
+#define LAPSE_EVERY 4          // ... one stretch in this many, staggered across paddles
+
+static volatile uint32_t sink; // Keeps the compiler from dropping the measured work
+
+// Moves a paddle toward the ball, or randomly every MISS_ONE_IN ticks. It
+// stands still for LAPSE_TICKS in every LAPSE_EVERY stretches: slips alone
+// never let a ball through. paddle numbers the paddles of all matches
+// (2 * match + side) to spread the lapses. Returns one of the PONG_INPUT_* values.
+static int track_ball(pong_fx ball_y, int paddle_y, uint32_t tick, int paddle, PongRng *rng) {
+    if ((tick / LAPSE_TICKS + (uint32_t)paddle) % LAPSE_EVERY == 0) return PONG_INPUT_NONE;
+    if (pong_rng_below(rng, MISS_ONE_IN) == 0) return (int)pong_rng_below(rng, 3);
+
+    pong_fx center = PONG_FX_INT(paddle_y) + PONG_FX_INT(PONG_PADDLE_HEIGHT) / 2;
+    if (ball_y < center - PONG_FX_ONE) return PONG_INPUT_UP;
+    if (ball_y > center + PONG_FX_ONE) return PONG_INPUT_DOWN;
+    return PONG_INPUT_NONE;
+}
+
+// Quantizes a game the way the server does before sending it.
+static PongSnapshot game_snapshot(const PongGame *g) {
+    return (PongSnapshot){
+        .p1_y = (uint16_t)g->p1.y, .p2_y = (uint16_t)g->p2.y,
+        .ball_x = pong_fx_quantize(g->ball.x, PONG_POS_SCALE),
+        .ball_y = pong_fx_quantize(g->ball.y, PONG_POS_SCALE),
+        .ball_dx = pong_fx_quantize(g->ball.dx, PONG_VEL_SCALE),
+        .ball_dy = pong_fx_quantize(g->ball.dy, PONG_VEL_SCALE),
+        .score1 = (uint16_t)g->score1, .score2 = (uint16_t)g->score2,
+        .serve_timer = (uint16_t)g->ball.serve_timer
+    };
+}
+
+static double seconds(uint64_t ns) {
+    return (double)ns / 1e9;
+}
+
+// === Physics ===
+// Steps every match once per tick, like the server's frame loop. Returns the
+// games in their final state, and the points scored in *points_out.
+static PongGame *bench_physics(int match_count, uint32_t ticks, uint32_t *points_out) {
+    PongGame *games = malloc(sizeof(PongGame) * (size_t)match_count);
+    if (!games) {
+        perror("malloc");
+        exit(1);
+    }
+
+    PongRng rng;
+    pong_rng_seed(&rng, 1);
+    for (int i = 0; i < match_count; i++) pong_game_reset(&games[i], pong_rng_next(&rng), SERVE_TICKS);
+
+    const int grace[2] = { 0, 0 };
+    uint32_t points = 0;
+    uint64_t input_ns = 0;
+    uint64_t start = pong_clock_ns();
+
+    for (uint32_t tick = 0; tick < ticks; tick++) {
+        uint64_t inputs_start = pong_clock_ns();
+        for (int i = 0; i < match_count; i++) {
+            games[i].p1.input = track_ball(games[i].ball.y, games[i].p1.y, tick, 2 * i, &rng);
+            games[i].p2.input = track_ball(games[i].ball.y, games[i].p2.y, tick, 2 * i + 1, &rng);
+        }
+        input_ns += pong_clock_ns() - inputs_start;
+        // Choosing the inputs isn't part of the server's cost: it is timed apart and left out.
+
+        for (int i = 0; i < match_count; i++)
+            points += pong_game_step(&games[i], tick, 1, PHYSICS_HZ, SERVE_TICKS, grace) != 0;
+    }
+
+    uint64_t elapsed = pong_clock_ns() - start - input_ns;
+    uint64_t steps = (uint64_t)match_count * ticks;
+    uint32_t checksum = 0;
+    for (int i = 0; i < match_count; i++)
+        checksum = checksum * 31 + (uint32_t)games[i].ball.x + (uint32_t)games[i].ball.y;
+
+    printf("physics: %d matches x %u ticks, %llu steps in %.3f s: %.2f M steps/s, %.1f ns/step\n",
+           match_count, (unsigned)ticks, (unsigned long long)steps, seconds(elapsed),
+           (double)steps / seconds(elapsed) / 1e6, (double)elapsed / (double)steps);
+    printf("physics: %u points scored, checksum %08x\n", (unsigned)points, (unsigned)checksum);
+    *points_out = points;
+    return games;
+}
+
+// === Batch physics ===
+// Replays bench_physics() with the batch step and checks it scores the same
+// points and ends in the same games. Returns 0 if it does.
+static int bench_batch(const PongGame *games, int match_count, uint32_t ticks, uint32_t physics_points) {
+    PongBatch *batch = malloc(sizeof(PongBatch));
+    if (!batch) {
+        perror("malloc");
+        exit(1);
+    }
+
+    PongRng rng;
+    pong_rng_seed(&rng, 1);
+    batch->count = match_count;
+    for (int i = 0; i < match_count; i++) {
+        PongGame g;
+        pong_game_reset(&g, pong_rng_next(&rng), SERVE_TICKS);
+        pong_batch_put(batch, i, &g);
+    }
+
+    uint32_t points = 0;
+    uint64_t input_ns = 0;
+    uint64_t start = pong_clock_ns();
+
+    for (uint32_t tick = 0; tick < ticks; tick++) {
+        uint64_t inputs_start = pong_clock_ns();
+        for (int i = 0; i < match_count; i++) {
+            batch->p1_input[i] = track_ball(batch->y[i], batch->p1_y[i], tick, 2 * i, &rng);
+            batch->p2_input[i] = track_ball(batch->y[i], batch->p2_y[i], tick, 2 * i + 1, &rng);
+        }
+        input_ns += pong_clock_ns() - inputs_start;
+
+        points += (uint32_t)pong_batch_step(batch, tick, 1, PHYSICS_HZ, SERVE_TICKS);
+    }
+
+    uint64_t elapsed = pong_clock_ns() - start - input_ns;
+    uint64_t steps = (uint64_t)match_count * ticks;
+    int mismatches = 0, scored = 0;
+    for (int i = 0; i < match_count; i++) {
+        PongGame g;
+        pong_batch_get(batch, i, &g);
+        mismatches += memcmp(&g, &games[i], sizeof(g)) != 0;
+        scored += g.score1 + g.score2 > 0;
+    }
+    // Lanes that scored took the re-serve path, where the vector step hands
+    // them back to the scalar one: those are the games worth comparing.
+
+    printf("batch[%s]: %llu steps in %.3f s: %.2f M steps/s, %.1f ns/step, %.1f us per tick of all matches\n",
+           pong_batch_isa(), (unsigned long long)steps, seconds(elapsed),
+           (double)steps / seconds(elapsed) / 1e6, (double)elapsed / (double)steps,
+           (double)elapsed / ticks / 1e3);
+    printf("batch[%s]: %u points scored in %d games, %d of %d games differ from the physics run\n",
+           pong_batch_isa(), (unsigned)points, scored, mismatches, match_count);
+    free(batch);
+
+    if (mismatches == 0 && points == physics_points && points > 0) return 0;
+    printf("batch[%s]: FAILED, %u points against %u in the physics run\n",
+           pong_batch_isa(), (unsigned)points, (unsigned)physics_points);
+    return 1;
+}
+
+// === Worker pool ===
+typedef struct {
+    PongGame *games;
+    PongRng *rngs;     // One per match: the inputs mustn't depend on the order matches run in
+    uint32_t tick;
+} PoolTick;
+
+static void pool_step(void *arg, int i) {
+    PoolTick *t = arg;
+    PongGame *g = &t->games[i];
+    const int grace[2] = { 0, 0 };
+
+    g->p1.input = track_ball(g->ball.y, g->p1.y, t->tick, 2 * i, &t->rngs[i]);
+    g->p2.input = track_ball(g->ball.y, g->p2.y, t->tick, 2 * i + 1, &t->rngs[i]);
+    pong_game_step(g, t->tick, 1, PHYSICS_HZ, SERVE_TICKS, grace);
+}
+
+// Ticks the matches on 1, 2, 4... workers up to one per CPU, and checks every
+// run ends in the same games as the first one. Returns 0 if they all do.
+// The bots' inputs are chosen inside each match's step, so unlike the other
+// runs these numbers include them.
+static int bench_pool(int match_count, uint32_t ticks) {
+    PoolTick t;
+    PongGame *first = malloc(sizeof(PongGame) * (size_t)match_count);
+    t.games = malloc(sizeof(PongGame) * (size_t)match_count);
+    t.rngs = malloc(sizeof(PongRng) * (size_t)match_count);
+    if (!first || !t.games || !t.rngs) {
+        perror("malloc");
+        exit(1);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    double base = 0;
+    int different = 0;
+    for (int workers = 1; workers == 1 || workers <= cpus; workers *= 2) {
+        PongPool pool;
+        PongRng rng;
+        pong_rng_seed(&rng, 1);
+        for (int i = 0; i < match_count; i++) {
+            pong_game_reset(&t.games[i], pong_rng_next(&rng), SERVE_TICKS);
+            pong_rng_seed(&t.rngs[i], pong_rng_next(&rng));
+        }
+
+        pong_pool_init(&pool, workers);
+        uint64_t start = pong_clock_ns();
+        for (t.tick = 0; t.tick < ticks; t.tick++) pong_pool_run(&pool, pool_step, &t, match_count);
+        uint64_t elapsed = pong_clock_ns() - start;
+        uint32_t steals = pong_pool_steals(&pool);
+        pong_pool_destroy(&pool);
+
+        double rate = (double)match_count * ticks / seconds(elapsed);
+        if (workers == 1) {
+            base = rate;
+            memcpy(first, t.games, sizeof(PongGame) * (size_t)match_count);
+        }
+        int same = memcmp(first, t.games, sizeof(PongGame) * (size_t)match_count) == 0;
+        different += !same;
+        printf("pool: %d workers, %.2f M steps/s (x%.2f), %.1f us per tick of all matches, %u steals, %s\n",
+               workers, rate / 1e6, rate / base, (double)elapsed / ticks / 1e3, (unsigned)steals,
+               same ? "same games" : "DIFFERENT games");
+    }
+    printf("pool: bot inputs included in the times above\n");
+
+    free(first);
+    free(t.games);
+    free(t.rngs);
+    if (different) printf("pool: FAILED, %d runs ended in other games than 1 worker\n", different);
+    return different != 0;
+}
+
+// === Input lines ===
+static void bench_parse_input(void) {
+    static const char *lines[] = { "INPUT:UP@1234", "INPUT:DOWN@1235", "INPUT:NONE", "INPUT:DOWN" };
+    uint32_t sum = 0;
+
+    uint64_t start = pong_clock_ns();
+    for (int i = 0; i < CODEC_LOOPS; i++) sum += (uint32_t)pong_parse_input(lines[i & 3]);
+    uint64_t elapsed = pong_clock_ns() - start;
+    sink = sum;
+
+    printf("parse_input: %d lines, %.1f ns/line\n", CODEC_LOOPS, (double)elapsed / CODEC_LOOPS);
+}
+
+// === Text snapshots ===
+static void bench_state(const PongSnapshot *snap) {
+    char line[128];
+    uint32_t sum = 0;
+
+    uint64_t start = pong_clock_ns();
+    for (int i = 0; i < CODEC_LOOPS; i++) {
+        PongSnapshot s = *snap;
+        s.p1_y = (uint16_t)(i % PONG_FIELD_HEIGHT);
+        sum += (uint32_t)pong_format_state(&s, line, sizeof(line));
+    }
+    uint64_t format_ns = pong_clock_ns() - start;
+
+    start = pong_clock_ns();
+    for (int i = 0; i < CODEC_LOOPS; i++) {
+        PongSnapshot s;
+        sum += (uint32_t)pong_parse_state(line, &s);
+        sum += s.ball_x;
+    }
+    uint64_t parse_ns = pong_clock_ns() - start;
+    sink = sum;
+
+    printf("STATE: %d lines, format %.1f ns/line, parse %.1f ns/line (%zu bytes)\n",
+           CODEC_LOOPS, (double)format_ns / CODEC_LOOPS, (double)parse_ns / CODEC_LOOPS, strlen(line));
+}
+
+// === Binary snapshots ===
+static void bench_delta(const PongSnapshot *snap) {
+    uint8_t frame[PONG_FRAME_MAX];
+    PongSnapshot base = *snap;
+    size_t len = 0;
+    uint32_t sum = 0;
+
+    base.ball_x = (int16_t)(base.ball_x - 64);
+    base.ball_y = (int16_t)(base.ball_y + 32);
+    // A typical delta: the ball moved, the rest is unchanged.
+
+    uint64_t start = pong_clock_ns();
+    for (int i = 0; i < CODEC_LOOPS; i++) {
+        len = pong_encode_delta(snap, (uint32_t)i + 2, &base, (uint32_t)i + 1, frame, sizeof(frame));
+        sum += (uint32_t)len;
+    }
+    uint64_t encode_ns = pong_clock_ns() - start;
+
+    start = pong_clock_ns();
+    for (int i = 0; i < CODEC_LOOPS; i++) {
+        PongSnapshot s = base;
+        sum += (uint32_t)pong_decode_delta(frame, len, &s);
+        sum += s.ball_x;
+    }
+    uint64_t decode_ns = pong_clock_ns() - start;
+    sink = sum;
+
+    printf("delta: %d frames, encode %.1f ns/frame, decode %.1f ns/frame (%zu bytes)\n",
+           CODEC_LOOPS, (double)encode_ns / CODEC_LOOPS, (double)decode_ns / CODEC_LOOPS, len);
+}
+
+int main(int argc, char *argv[]) {
+    int match_count = argc > 1 ? atoi(argv[1]) : DEFAULT_MATCHES;
+    long ticks = argc > 2 ? atol(argv[2]) : DEFAULT_TICKS;
+    if (argc > 3 || match_count <= 0 || match_count > PONG_BATCH_MAX || ticks <= 0) {
+        printf("Usage: %s [matches] [ticks]\n", argv[0]);
+        return 1;
+    }
+
+    uint32_t points;
+    PongGame *games = bench_physics(match_count, (uint32_t)ticks, &points);
+    if (points == 0) {
+        printf("physics: no point scored in %ld ticks, scoring went untimed\n", ticks);
+        free(games);
+        return 1;
+    }
+    if (bench_batch(games, match_count, (uint32_t)ticks, points)) {
+        free(games);
+        return 1;
+    }
+    if (bench_pool(match_count, (uint32_t)ticks)) {
+        free(games);
+        return 1;
+    }
+    PongSnapshot snap = game_snapshot(&games[0]);
+    free(games);
+
+    bench_parse_input();
+    bench_state(&snap);
+    bench_delta(&snap);
+    return 0;
+}
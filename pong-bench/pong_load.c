@@ -0,0 +1,532 @@
+/*
+  -------------------------------------------------------------------------------
+  Pong Load: many headless players against a live server
+  -------------------------------------------------------------------------------
+
+  Opens <clients> TCP connections from a single epoll loop, at most
+  <connects> new ones per second, and plays each one the way pong-client
+  does in text mode: HELLO:1 and HELLO:2 alternately, so the server pairs
+  them into matches, then an INPUT line <input hz> times per second until
+  the match is over. A client whose match ends, or whose connection fails,
+  connects again a second later. No window and no raylib, one process for
+  thousands of players: enough to find where the server runs out of
+  connections, matches or frame time.
+
+  Usage: pong_load [-n clients] [-c connects/s] [-r input_hz] [-d seconds]
+                   [-p port] [-s script | -b reaction:error] host
+
+  By default a client is a bot that heads for the ball of the last snapshot
+  it read, aiming again every <reaction> inputs and missing by up to <error>
+  rows. -s plays a script instead: a comma-separated list of UP, DOWN and
+  IDLE, one entry per input, cycled (each client starts at its own offset).
+
+  Every second, and once more at the end, it prints the clients connected
+  and playing, the STATE lines read per second, the gap between two STATE
+  lines of a client (average, p99, max), the jitter (how far a gap is from
+  the snapshot period the server announced in WELCOME, on average) and the
+  errors:
+
+      connect    connect() failed or was refused
+      rejected   the server closed the connection before WELCOME
+      reset      the connection was lost after WELCOME, before GAMEOVER
+      timeout    no WELCOME within 5 s, or no STATE for 5 s during a match
+      malformed  a line that isn't a WELCOME, STATE or GAMEOVER
+      stalled    an INPUT line dropped because the socket was still full
+
+  -------------------------------------------------------------------------------
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "pong_clock.h"
+#include "pong_metrics.h"
+#include "pong_physics.h"
+#include "pong_proto.h"
+
+#define DEFAULT_PORT "12345"
+#define DEFAULT_SNAPSHOT_HZ 60             // Assumed until WELCOME says otherwise
+#define RECV_BUF 1024                      // Room for a partial line between two reads
+#define SEND_BUF 32                        // Longest line we send
+#define TIMEOUT_NS 5000000000ull           // Handshake, or silence during a match
+#define RECONNECT_NS 1000000000ull         // Pause before a client connects again
+#define WAIT_MS 1                          // Longest epoll wait
+#define MAX_EVENTS 256
+#define MAX_SCRIPT 64
+
+typedef enum {
+    CL_IDLE,            // Not connected, in the connect queue
+    CL_CONNECTING,      // connect() in progress
+    CL_HANDSHAKE,       // HELLO sent, waiting for WELCOME
+    CL_PLAYING,         // Welcomed: waiting for an opponent, then in a match
+    CL_OVER             // GAMEOVER read, waiting for the server to close
+} ClientState;
+
+enum { ERR_CONNECT, ERR_REJECTED, ERR_RESET, ERR_TIMEOUT, ERR_MALFORMED, ERR_STALLED, ERRORS };
+
+static const char *const error_names[ERRORS] = {
+    "connect", "rejected", "reset", "timeout", "malformed", "stalled"
+};
+
+typedef struct {
+    int fd;
+    ClientState state;
+    int player;                     // 1 or 2
+    uint64_t since_ns;              // Connect, WELCOME or last STATE, for the timeouts
+    uint64_t ready_ns;              // CL_IDLE: earliest time to connect again
+    uint64_t period_ns;             // Snapshot period announced in WELCOME
+    uint64_t last_state_ns;         // Arrival of the previous STATE, 0 before the first
+    PongSnapshot snap;              // Last STATE read
+    uint32_t inputs;                // Inputs sent this match
+    int target;                     // Row the bot heads for
+    char in[RECV_BUF];
+    size_t in_len;
+    char out[SEND_BUF];             // Rest of a line the socket didn't take
+    size_t out_len;
+} LoadClient;
+
+typedef struct {
+    uint64_t connects, welcomed, games_over, snapshots, inputs;
+    uint64_t errors[ERRORS];
+    uint64_t jitter_ns, gaps;       // Sum of |gap - period|, gaps measured
+} Counters;
+
+static struct {
+    int clients;
+    double connect_rate, input_hz;
+    int seconds;
+    int script[MAX_SCRIPT];
+    int script_len;
+    int reaction, error;
+} opt = { 1000, 200.0, 30.0, 30, { 0 }, 0, 4, 1 };
+
+static struct sockaddr_storage server;
+static socklen_t server_len;
+static int epfd;
+
+static LoadClient *clients;
+static int connected, playing;
+
+// Clients waiting to connect, in the order they went idle. They all wait
+// RECONNECT_NS (or nothing, at the start), so this is also their ready order.
+static int *queue;
+static int queue_head, queue_len;
+
+static Counters total, second;
+static PongHistogram gaps, gaps_second;
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-n clients] [-c connects/s] [-r input_hz] [-d seconds]\n", prog);
+    printf("       %*s [-p port] [-s script | -b reaction:error] host\n", (int)strlen(prog), "");
+}
+
+#define COUNT(field) (total.field++, second.field++)
+
+// === Connections ===
+
+static void enqueue(int i, uint64_t ready_ns) {
+    clients[i].state = CL_IDLE;
+    clients[i].ready_ns = ready_ns;
+    queue[(queue_head + queue_len) % opt.clients] = i;
+    queue_len++;
+}
+
+// Closes a client, charging the error if there is one (-1 for a normal end),
+// and queues it to connect again.
+static void client_close(int i, int error) {
+    LoadClient *c = &clients[i];
+    if (error >= 0) COUNT(errors[error]);
+    if (c->state == CL_PLAYING || c->state == CL_OVER) playing--;
+    if (c->state != CL_CONNECTING) connected--;
+
+    close(c->fd);
+    // Closing also takes it out of the epoll set.
+    c->fd = -1;
+    enqueue(i, pong_clock_ns() + RECONNECT_NS);
+}
+
+static void client_connect(int i, uint64_t now) {
+    LoadClient *c = &clients[i];
+    int fd = socket(server.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        COUNT(errors[ERR_CONNECT]);
+        enqueue(i, now + RECONNECT_NS);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // Input lines are tiny and must go out at once, like pong-client's.
+
+    COUNT(connects);
+    if (connect(fd, (struct sockaddr *)&server, server_len) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        COUNT(errors[ERR_CONNECT]);
+        enqueue(i, now + RECONNECT_NS);
+        return;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT, .data.u32 = (uint32_t)i };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    c->fd = fd;
+    c->state = CL_CONNECTING;
+    c->since_ns = now;
+    c->in_len = c->out_len = 0;
+}
+
+// Sends a line, keeping what the socket didn't take for EPOLLOUT. A line
+// that finds the socket still full is dropped, as a stall.
+static void client_send(int i, const char *line, size_t len) {
+    LoadClient *c = &clients[i];
+    if (c->out_len) {
+        COUNT(errors[ERR_STALLED]);
+        return;
+    }
+
+    ssize_t n = send(c->fd, line, len, MSG_NOSIGNAL);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) COUNT(errors[ERR_STALLED]);
+        return;
+        // Other errors surface as EPOLLERR or EPOLLHUP on the next wait.
+    }
+    if ((size_t)n < len) {
+        c->out_len = len - (size_t)n;
+        memcpy(c->out, line + n, c->out_len);
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT, .data.u32 = (uint32_t)i };
+        epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    }
+}
+
+static void client_flush(int i) {
+    LoadClient *c = &clients[i];
+    ssize_t n = send(c->fd, c->out, c->out_len, MSG_NOSIGNAL);
+    if (n <= 0) return;
+
+    c->out_len -= (size_t)n;
+    memmove(c->out, c->out + n, c->out_len);
+    if (c->out_len == 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+        epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    }
+}
+
+// The connection is up (or failed): send the HELLO.
+static void client_connected(int i, uint64_t now) {
+    LoadClient *c = &clients[i];
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+        client_close(i, ERR_CONNECT);
+        return;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->state = CL_HANDSHAKE;
+    c->since_ns = now;
+    connected++;
+
+    char hello[16];
+    int n = snprintf(hello, sizeof(hello), "HELLO:%d\n", c->player);
+    client_send(i, hello, (size_t)n);
+}
+
+// === Server lines ===
+
+static void client_line(int i, char *line, uint64_t now) {
+    LoadClient *c = &clients[i];
+
+    if (strncmp(line, "STATE:", 6) == 0 && c->state == CL_PLAYING) {
+        if (!pong_parse_state(line, &c->snap)) {
+            COUNT(errors[ERR_MALFORMED]);
+            return;
+        }
+        COUNT(snapshots);
+        if (c->last_state_ns) {
+            uint64_t gap = now - c->last_state_ns;
+            pong_hist_add(&gaps, gap);
+            pong_hist_add(&gaps_second, gap);
+            uint64_t off = gap > c->period_ns ? gap - c->period_ns : c->period_ns - gap;
+            total.jitter_ns += off;
+            second.jitter_ns += off;
+            COUNT(gaps);
+        }
+        c->last_state_ns = c->since_ns = now;
+    } else if (strncmp(line, "WELCOME", 7) == 0 && c->state == CL_HANDSHAKE) {
+        unsigned hz = DEFAULT_SNAPSHOT_HZ;
+        const char *rates = strstr(line, " HZ:");
+        if (rates) sscanf(rates, " HZ:%*u:%*u:%u", &hz);
+        c->period_ns = 1000000000ull / (hz ? hz : DEFAULT_SNAPSHOT_HZ);
+        c->state = CL_PLAYING;
+        c->since_ns = now;
+        c->last_state_ns = 0;
+        c->inputs = 0;
+        c->target = PONG_FIELD_HEIGHT / 2;
+        playing++;
+        COUNT(welcomed);
+    } else if (strncmp(line, "GAMEOVER:", 9) == 0 && c->state == CL_PLAYING) {
+        c->state = CL_OVER;
+        COUNT(games_over);
+        // The server closes the connection next.
+    } else {
+        COUNT(errors[ERR_MALFORMED]);
+    }
+}
+
+// Reads what the server sent, line by line, until the socket is empty or
+// the client is closed.
+static void client_read(int i, uint64_t now) {
+    LoadClient *c = &clients[i];
+
+    for (;;) {
+        ssize_t n = recv(c->fd, c->in + c->in_len, RECV_BUF - 1 - c->in_len, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            client_close(i, c->state == CL_OVER ? -1 : c->state == CL_HANDSHAKE ? ERR_REJECTED : ERR_RESET);
+            return;
+            // Closed before WELCOME: the server was full or refused the HELLO.
+        }
+        c->in_len += (size_t)n;
+        c->in[c->in_len] = '\0';
+
+        char *line = c->in, *nl;
+        while ((nl = strchr(line, '\n'))) {
+            *nl = '\0';
+            if (nl > line && nl[-1] == '\r') nl[-1] = '\0';
+            client_line(i, line, now);
+            line = nl + 1;
+        }
+        c->in_len -= (size_t)(line - c->in);
+        memmove(c->in, line, c->in_len);
+
+        if (c->in_len == RECV_BUF - 1) {
+            client_close(i, ERR_MALFORMED);
+            return;
+            // A line longer than anything the server sends.
+        }
+    }
+}
+
+// === Input ===
+
+static int bot_input(LoadClient *c) {
+    if (c->inputs % (uint32_t)opt.reaction == 0) {
+        int aim = c->snap.ball_y / PONG_POS_SCALE;
+        if (opt.error) aim += rand() % (2 * opt.error + 1) - opt.error;
+        c->target = aim;
+    }
+    int center = (c->player == 1 ? c->snap.p1_y : c->snap.p2_y) + PONG_PADDLE_HEIGHT / 2;
+    return c->target < center ? PONG_INPUT_UP : c->target > center ? PONG_INPUT_DOWN : PONG_INPUT_NONE;
+}
+
+// Runs a client's timeouts and, once its match has started, sends its next input.
+static void client_tick(int i, uint64_t now) {
+    static const char *const lines[] = { "INPUT:IDLE\n", "INPUT:UP\n", "INPUT:DOWN\n" };
+    LoadClient *c = &clients[i];
+
+    if (c->state == CL_CONNECTING || c->state == CL_HANDSHAKE) {
+        if (now - c->since_ns > TIMEOUT_NS) client_close(i, ERR_TIMEOUT);
+        return;
+    }
+    if (c->state != CL_PLAYING || !c->last_state_ns) return;
+    // Waiting for an opponent is not a timeout: no STATE comes until then.
+
+    if (now - c->since_ns > TIMEOUT_NS) {
+        client_close(i, ERR_TIMEOUT);
+        return;
+    }
+
+    int input = opt.script_len ? opt.script[(c->inputs + (uint32_t)i) % (uint32_t)opt.script_len] : bot_input(c);
+    c->inputs++;
+    client_send(i, lines[input], strlen(lines[input]));
+    COUNT(inputs);
+}
+
+// === Report ===
+
+static void report(const char *label, const Counters *k, const PongHistogram *h, double seconds) {
+    uint64_t n = h->count;
+    printf("%s: %d/%d connected, %d playing, %.0f STATE/s, gap avg %.2f p99 %.2f max %.2f ms, "
+           "jitter %.2f ms, errors",
+           label, connected, opt.clients, playing, (double)k->snapshots / seconds,
+           n ? (double)h->sum_ns / (double)n / 1e6 : 0.0, (double)pong_hist_quantile(h, 0.99) / 1e6,
+           (double)h->max_ns / 1e6, k->gaps ? (double)k->jitter_ns / (double)k->gaps / 1e6 : 0.0);
+    for (int e = 0; e < ERRORS; e++) printf(" %s %llu", error_names[e], (unsigned long long)k->errors[e]);
+    printf("\n");
+    fflush(stdout);
+}
+
+// === Main ===
+
+static int parse_script(char *list) {
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        if (opt.script_len == MAX_SCRIPT) return 0;
+        if (strcmp(tok, "UP") == 0) opt.script[opt.script_len++] = PONG_INPUT_UP;
+        else if (strcmp(tok, "DOWN") == 0) opt.script[opt.script_len++] = PONG_INPUT_DOWN;
+        else if (strcmp(tok, "IDLE") == 0) opt.script[opt.script_len++] = PONG_INPUT_NONE;
+        else return 0;
+    }
+    return opt.script_len > 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *port = DEFAULT_PORT;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:c:r:d:p:s:b:h")) != -1) {
+        switch (c) {
+            case 'n': opt.clients = atoi(optarg); break;
+            case 'c': opt.connect_rate = atof(optarg); break;
+            case 'r': opt.input_hz = atof(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'p': port = optarg; break;
+            case 's':
+                if (!parse_script(optarg)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'b':
+                if (sscanf(optarg, "%d:%d", &opt.reaction, &opt.error) != 2) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || opt.clients < 1 || opt.connect_rate <= 0 || opt.input_hz <= 0 ||
+        opt.seconds < 1 || opt.reaction < 1 || opt.error < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *res;
+    int err = getaddrinfo(argv[optind], port, &hints, &res);
+    if (err) {
+        fprintf(stderr, "pong_load: %s: %s\n", argv[optind], gai_strerror(err));
+        return 1;
+    }
+    memcpy(&server, res->ai_addr, res->ai_addrlen);
+    server_len = res->ai_addrlen;
+    freeaddrinfo(res);
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rlim_t want = (rlim_t)opt.clients + 16;
+        if (rl.rlim_cur < want) {
+            rl.rlim_cur = rl.rlim_max == RLIM_INFINITY || rl.rlim_max > want ? want : rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
+        }
+        if (rl.rlim_cur < want)
+            fprintf(stderr, "pong_load: only %llu descriptors, some clients will fail to connect\n",
+                    (unsigned long long)rl.rlim_cur);
+    }
+
+    clients = calloc((size_t)opt.clients, sizeof(LoadClient));
+    queue = malloc((size_t)opt.clients * sizeof(int));
+    epfd = epoll_create1(0);
+    if (!clients || !queue || epfd < 0) {
+        fprintf(stderr, "pong_load: out of memory\n");
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < opt.clients; i++) {
+        clients[i].fd = -1;
+        clients[i].player = i % 2 + 1;
+        // HELLO:1, HELLO:2, ...: consecutive clients end up in the same match.
+        enqueue(i, 0);
+    }
+
+    uint64_t start = pong_clock_ns(), last = start, next_report = start + 1000000000ull;
+    uint64_t end = start + (uint64_t)opt.seconds * 1000000000ull;
+    double tokens = 1.0, visits = 0.0;
+    int cursor = 0, elapsed = 0;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!stop) {
+        uint64_t now = pong_clock_ns();
+        if (now >= end) break;
+        double dt = (double)(now - last) / 1e9;
+        last = now;
+
+        tokens += dt * opt.connect_rate;
+        if (tokens > opt.connect_rate) tokens = opt.connect_rate;
+        // At most a second's worth of connects at once.
+        while (queue_len && tokens >= 1.0 && clients[queue[queue_head]].ready_ns <= now) {
+            int i = queue[queue_head];
+            queue_head = (queue_head + 1) % opt.clients;
+            queue_len--;
+            tokens -= 1.0;
+            client_connect(i, now);
+        }
+
+        int n = epoll_wait(epfd, events, MAX_EVENTS, WAIT_MS);
+        now = pong_clock_ns();
+        for (int e = 0; e < n; e++) {
+            int i = (int)events[e].data.u32;
+            LoadClient *cl = &clients[i];
+            if (cl->fd < 0) continue;
+            if (cl->state == CL_CONNECTING) {
+                client_connected(i, now);
+                continue;
+            }
+            if (events[e].events & EPOLLOUT) client_flush(i);
+            if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) client_read(i, now);
+        }
+
+        visits += dt * opt.input_hz * opt.clients;
+        if (visits > opt.clients) visits = opt.clients;
+        // Sweeps the clients in order, each one input_hz times per second,
+        // spread over the second rather than all at once.
+        for (; visits >= 1.0; visits -= 1.0) {
+            client_tick(cursor, now);
+            cursor = (cursor + 1) % opt.clients;
+        }
+
+        if (now >= next_report) {
+            elapsed++;
+            char label[32];
+            snprintf(label, sizeof(label), "pong_load: %d s", elapsed);
+            report(label, &second, &gaps_second, 1.0);
+            memset(&second, 0, sizeof(second));
+            memset(&gaps_second, 0, sizeof(gaps_second));
+            next_report += 1000000000ull;
+        }
+    }
+
+    double seconds = (double)(pong_clock_ns() - start) / 1e9;
+    printf("pong_load: %llu connects, %llu welcomed, %llu games over, %llu inputs in %.1f s\n",
+           (unsigned long long)total.connects, (unsigned long long)total.welcomed,
+           (unsigned long long)total.games_over, (unsigned long long)total.inputs, seconds);
+    report("total", &total, &gaps, seconds);
+
+    for (int i = 0; i < opt.clients; i++)
+        if (clients[i].fd >= 0) close(clients[i].fd);
+    close(epfd);
+    free(queue);
+    free(clients);
+    return 0;
+}
@@ -0,0 +1,307 @@
+/*
+  -------------------------------------------------------------------------------
+  Pong Tournament: bot-vs-bot matches as fast as the CPU allows
+  -------------------------------------------------------------------------------
+
+  Plays matches between two bots with the server's own rules (pong_game.h:
+  same physics, serve delay and winning score) on a virtual clock: a match is
+  a loop of ticks, with no sockets and no sleeping, so thousands of simulated
+  minutes take a second. Matches are spread over a worker pool (pong_pool.h).
+
+  Every match is seeded from the tournament seed and its index, so a result
+  file can always be reproduced, whatever the number of workers. The bots
+  swap sides every match.
+
+  Usage: pong_tournament [-n matches] [-t workers] [-s seed] [-o file]
+                         [-a reaction:error:center] [-b reaction:error:center]
+
+  A bot looks at the ball every <reaction> ticks and heads for where it is,
+  missing by up to <error> rows; with <center> 1 it goes back to the middle
+  while the ball moves away.
+
+  -------------------------------------------------------------------------------
+  Result file (little-endian):
+
+      header, 32 bytes:
+          char[8]  "PONGTRN1"
+          u32      matches
+          u32      seed
+          u16[3]   bot A: reaction, error, center
+          u16[3]   bot B: reaction, error, center
+          u32      physics rate (Hz)
+
+      then one record per match, in match order, 11 bytes:
+          u32      ticks played
+          u8       bot A's points
+          u8       bot B's points
+          u8       flags: bit 0 set if bot A played as player 2,
+                          bit 1 set if the match hit the tick limit
+          u16      paddle hits
+          u16      longest rally, in paddle hits
+
+  -------------------------------------------------------------------------------
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pong_clock.h"
+#include "pong_game.h"
+#include "pong_pool.h"
+#include "pong_proto.h"
+
+#define PHYSICS_HZ 60                          // Simulation rate, the server's default
+#define SERVE_TICKS (3 * PHYSICS_HZ)           // The server's serve delay
+#define MAX_MATCH_TICKS (PHYSICS_HZ * 3600)    // A match still going after an hour is called off
+#define BLOCK_MATCHES 65536                    // Matches played between two writes of the file
+#define HEADER_SIZE 32
+#define RECORD_SIZE 11
+
+#define FLAG_A_IS_P2 0x01
+#define FLAG_UNFINISHED 0x02
+
+// === Bots ===
+typedef struct {
+    uint16_t reaction;   // Ticks between two looks at the ball
+    uint16_t error;      // Rows it may miss the ball by
+    uint16_t center;     // 1 to return to the middle while the ball moves away
+} Bot;
+
+typedef struct {
+    int input;           // PONG_INPUT_* held until the next look
+    int countdown;       // Ticks until the next look
+} BotState;
+
+// Decides a bot's input for the tick, for the paddle of the given player.
+static int bot_input(const Bot *bot, BotState *st, const PongGame *g, int player, PongRng *rng) {
+    if (st->countdown-- > 0) return st->input;
+    st->countdown = bot->reaction;
+
+    const PongPaddle *p = player == 1 ? &g->p1 : &g->p2;
+    int coming = player == 1 ? g->ball.dx < 0 : g->ball.dx > 0;
+    pong_fx target = g->ball.y;
+    if (!coming && bot->center) target = PONG_FX_INT(PONG_FIELD_HEIGHT) / 2;
+    if (bot->error) target += (pong_fx)pong_rng_below(rng, 2u * bot->error * PONG_FX_ONE) - PONG_FX_INT(bot->error);
+    // A new aiming error on every look.
+
+    pong_fx center = PONG_FX_INT(p->y) + PONG_FX_INT(PONG_PADDLE_HEIGHT) / 2;
+    if (target < center - PONG_FX_ONE) st->input = PONG_INPUT_UP;
+    else if (target > center + PONG_FX_ONE) st->input = PONG_INPUT_DOWN;
+    else st->input = PONG_INPUT_NONE;
+    return st->input;
+}
+
+static int bot_parse(const char *spec, Bot *bot) {
+    unsigned reaction, error, center;
+    if (sscanf(spec, "%u:%u:%u", &reaction, &error, &center) != 3) return 0;
+    if (reaction > 0xffff || error > PONG_FIELD_HEIGHT || center > 1) return 0;
+    *bot = (Bot){ (uint16_t)reaction, (uint16_t)error, (uint16_t)center };
+    return 1;
+}
+
+// === Matches ===
+typedef struct {
+    uint32_t ticks;
+    uint8_t score_a, score_b;
+    uint8_t flags;
+    uint16_t hits, longest_rally;
+} MatchResult;
+
+typedef struct {
+    Bot bots[2];                 // Bot A, bot B
+    uint32_t seed;
+    uint32_t base;               // Index of the first match of the block
+    MatchResult *results;
+} Tournament;
+
+// Seed of a match: the tournament seed and the match index, mixed so that
+// neighbouring matches don't start from related PRNG states.
+static uint32_t match_seed(uint32_t seed, uint32_t index) {
+    uint32_t h = seed ^ (index * 0x9e3779b9u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h ? h : 1;
+}
+
+// Plays one whole match, on any worker.
+static void play_match(void *arg, int i) {
+    Tournament *t = arg;
+    uint32_t index = t->base + (uint32_t)i;
+    const int grace[2] = { 0, 0 };
+    int a_side = index & 1 ? 2 : 1;
+    // Bot A is player 1 in even matches and player 2 in odd ones.
+
+    const Bot *bot1 = &t->bots[a_side == 1 ? 0 : 1], *bot2 = &t->bots[a_side == 1 ? 1 : 0];
+    BotState st1 = {PONG_INPUT_NONE, 0}, st2 = {PONG_INPUT_NONE, 0};
+    PongGame g;
+    PongRng bots_rng;
+    pong_game_reset(&g, match_seed(t->seed, index), SERVE_TICKS);
+    pong_rng_seed(&bots_rng, match_seed(~t->seed, index));
+    // The bots draw from a generator of their own: the serves stay those of the seed.
+
+    uint32_t tick = 0;
+    uint16_t hits = 0, rally = 0, longest = 0;
+    int winner = 0;
+    while (!winner && tick < MAX_MATCH_TICKS) {
+        g.p1.input = bot_input(bot1, &st1, &g, 1, &bots_rng);
+        g.p2.input = bot_input(bot2, &st2, &g, 2, &bots_rng);
+
+        pong_fx dx = g.ball.dx;
+        if (pong_game_step(&g, tick++, 1, PHYSICS_HZ, SERVE_TICKS, grace)) {
+            rally = 0;
+            winner = pong_game_winner(&g);
+        } else if ((dx < 0) != (g.ball.dx < 0)) {
+            if (hits < UINT16_MAX) hits++;
+            if (rally < UINT16_MAX && ++rally > longest) longest = rally;
+        }
+        // Only paddles turn the ball around horizontally.
+    }
+
+    MatchResult *r = &t->results[i];
+    r->ticks = tick;
+    r->score_a = (uint8_t)(a_side == 1 ? g.score1 : g.score2);
+    r->score_b = (uint8_t)(a_side == 1 ? g.score2 : g.score1);
+    r->flags = (a_side == 2 ? FLAG_A_IS_P2 : 0) | (winner ? 0 : FLAG_UNFINISHED);
+    r->hits = hits;
+    r->longest_rally = longest;
+}
+
+// === Result file ===
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v & 0xff);
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p = put_u16(p, (uint16_t)(v & 0xffff));
+    return put_u16(p, (uint16_t)(v >> 16));
+}
+
+static uint8_t *put_bot(uint8_t *p, const Bot *bot) {
+    p = put_u16(p, bot->reaction);
+    p = put_u16(p, bot->error);
+    return put_u16(p, bot->center);
+}
+
+static int write_header(FILE *f, const Tournament *t, uint32_t matches) {
+    uint8_t header[HEADER_SIZE], *p = header;
+
+    memcpy(p, "PONGTRN1", 8);
+    p = put_u32(p + 8, matches);
+    p = put_u32(p, t->seed);
+    p = put_bot(p, &t->bots[0]);
+    p = put_bot(p, &t->bots[1]);
+    put_u32(p, PHYSICS_HZ);
+    return fwrite(header, sizeof(header), 1, f) == 1;
+}
+
+static int write_records(FILE *f, const MatchResult *results, uint32_t count) {
+    static uint8_t buf[BLOCK_MATCHES * RECORD_SIZE];
+    uint8_t *p = buf;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const MatchResult *r = &results[i];
+        p = put_u32(p, r->ticks);
+        *p++ = r->score_a;
+        *p++ = r->score_b;
+        *p++ = r->flags;
+        p = put_u16(p, r->hits);
+        p = put_u16(p, r->longest_rally);
+    }
+    return fwrite(buf, (size_t)(p - buf), 1, f) == 1;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-n matches] [-t workers] [-s seed] [-o file]\n", prog);
+    printf("       %*s [-a reaction:error:center] [-b reaction:error:center]\n", (int)strlen(prog), "");
+}
+
+int main(int argc, char *argv[]) {
+    Tournament t = { .bots = { {3, 2, 1}, {3, 2, 1} }, .seed = 1 };
+    unsigned long matches = 10000;
+    int workers = 0;
+    const char *path = "tournament.bin";
+    int ch;
+
+    while ((ch = getopt(argc, argv, "n:t:s:o:a:b:h")) != -1) {
+        switch (ch) {
+        case 'n': matches = strtoul(optarg, NULL, 10); break;
+        case 't': workers = atoi(optarg); break;
+        case 's': t.seed = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'o': path = optarg; break;
+        case 'a':
+        case 'b':
+            if (!bot_parse(optarg, &t.bots[ch == 'a' ? 0 : 1])) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (matches == 0 || matches > UINT32_MAX || optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+
+    t.results = malloc(sizeof(MatchResult) * BLOCK_MATCHES);
+    if (!t.results) {
+        perror("malloc");
+        return 1;
+    }
+
+    PongPool pool;
+    workers = pong_pool_init(&pool, workers);
+    int ok = write_header(f, &t, (uint32_t)matches);
+
+    uint64_t wins[2] = {0, 0}, unfinished = 0, ticks = 0, hits = 0;
+    uint16_t longest = 0;
+    uint64_t start = pong_clock_ns();
+
+    for (uint32_t base = 0; ok && base < matches; base += BLOCK_MATCHES) {
+        uint32_t count = matches - base < BLOCK_MATCHES ? (uint32_t)(matches - base) : BLOCK_MATCHES;
+        t.base = base;
+        pong_pool_run(&pool, play_match, &t, (int)count);
+        ok = write_records(f, t.results, count);
+
+        for (uint32_t i = 0; i < count; i++) {
+            const MatchResult *r = &t.results[i];
+            if (r->flags & FLAG_UNFINISHED) unfinished++;
+            else wins[r->score_a > r->score_b ? 0 : 1]++;
+            ticks += r->ticks;
+            hits += r->hits;
+            if (r->longest_rally > longest) longest = r->longest_rally;
+        }
+    }
+
+    double elapsed = (double)(pong_clock_ns() - start) / 1e9;
+    double played = (double)ticks / PHYSICS_HZ;
+    pong_pool_destroy(&pool);
+    free(t.results);
+    if (fclose(f) != 0 || !ok) {
+        perror(path);
+        return 1;
+    }
+
+    printf("tournament: %lu matches on %d workers in %.2f s, %.1f h of play (x%.0f real time)\n",
+           matches, workers, elapsed, played / 3600, played / elapsed);
+    printf("bot A %u:%u:%u: %llu wins, bot B %u:%u:%u: %llu wins, %llu unfinished\n",
+           t.bots[0].reaction, t.bots[0].error, t.bots[0].center, (unsigned long long)wins[0],
+           t.bots[1].reaction, t.bots[1].error, t.bots[1].center, (unsigned long long)wins[1],
+           (unsigned long long)unfinished);
+    printf("rallies: %.1f paddle hits per match, longest %u\n", (double)hits / matches, longest);
+    printf("results written to %s\n", path);
+    return 0;
+}
@@ -12,25 +12,31 @@
   network delay, and then corrects any small deviation when the next STATE arrives.
 
   -------------------------------------------------------------------------------
-  Formula Used (executed once per frame):
-  
-      x += dx * Δt * 60
-      y += dy * Δt * 60
+  Simulation Used (executed once per frame):
+
+      ball ← snapshot ball
+      repeat ⌊(now - t_snapshot) · 60⌋ times:
+          pong_ball_step(ball, p1_y, p2_y)      (serve countdown, swept move and bounces)
+      draw ball + velocity · (fraction of the current tick)
 
   Where:
-      - x, y       → predicted ball position (logical server units)
-      - dx, dy     → velocity components from the last server message
-      - Δt         → time passed since last frame (from GetFrameTime())
-      - 60         → correction factor to scale from seconds to frames (assuming 60 FPS)
+      - ball         → fixed-point ball state (pong_physics.h), the one the server simulates
+      - t_snapshot   → GetTime() when the authoritative snapshot arrived
+      - 60           → server ticks per second (physics rate from WELCOME, HZ:<physics>:...)
+
+  The ball is stepped with the same integer physics the server runs, so within
+  a tick the prediction is exactly what the server computes, bounces included,
+  as long as the paddles don't move. Prediction always restarts from the last
+  snapshot, so it never drifts.
 
   -------------------------------------------------------------------------------
   Variables involved:
 
-      predicted.x       → last known x position of the ball
-      predicted.y       → last known y position of the ball
-      predicted.dx/dy   → last known velocity of the ball
-      predicted.valid   → whether a prediction is currently valid
-      predicted.last_update → timestamp of last server update (GetTime())
+      predicted.base       → ball of the last snapshot, in fixed point
+      predicted.p1_y/p2_y  → paddle rows of the last snapshot
+      predicted.base_time  → timestamp of last server update (GetTime())
+      predicted.x/y        → predicted position to draw, in server units
+      predicted.valid      → whether a prediction is currently valid
 
   -------------------------------------------------------------------------------
   Client Prediction Flow Diagram
@@ -38,23 +44,19 @@
     [Server]                            [Client]
 
        |                                  |
-       |---- STATE:x,y,dx,dy,score,timer →|  ← Authoritative update
+       |---- snapshot (seq, state) ------→|  ← Authoritative update
        |                                  |
        |                            +----------------------------+
-       |                            | predicted.x ← x            |
-       |                            | predicted.y ← y            |
-       |                            | predicted.dx ← dx          |
-       |                            | predicted.dy ← dy          |
-       |                            | predicted.last_update ← now|
+       |                            | predicted.base ← ball      |
+       |                            | predicted.base_time ← now  |
        |                            +----------------------------+
        |                                  |
        |                  For each frame (60 fps):
-       |                            Δt ← GetFrameTime()
-       |                            x ← x + dx · Δt · 60
-       |                            y ← y + dy · Δt · 60
+       |                            step a copy of base to now
+       |                            predicted.x/y ← its position
        |                                  |
-       |              ← until next authoritative STATE message
-       |<--- next STATE arrives -----------|
+       |              ← until next authoritative snapshot
+       |<--- next snapshot arrives --------|
 
   -------------------------------------------------------------------------------
 
@@ -76,6 +78,8 @@
 #include <sys/socket.h>     // Core socket API (socket(), connect(), etc.)
 #include <netinet/tcp.h>    // TCP-specific socket options (e.g., TCP_NODELAY)
 #include "raylib.h"         // Simple and portable graphics library for rendering
+#include "pong_proto.h"     // Snapshot encoding shared with the server
+#include "pong_physics.h"   // Fixed-point ball simulation shared with the server
 
 #define PORT 12345              // Must match the server's listening port
 #define BUFFER_SIZE 256         // Buffer size for receiving data over TCP
@@ -90,12 +94,12 @@
 #define BALL_SIZE 15
 
 // Virtual field dimensions and layout (match server logic)
-#define SERVER_WIDTH 80
-#define SERVER_HEIGHT 24
-#define SERVER_PADDLE_HEIGHT 4
-#define SERVER_PADDLE_OFFSET_X 2
-#define SERVER_PADDLE_WIDTH 2
-#define SERVER_EXPECTED_MESSAGES 9
+#define SERVER_WIDTH PONG_FIELD_WIDTH
+#define SERVER_HEIGHT PONG_FIELD_HEIGHT
+#define SERVER_PADDLE_HEIGHT PONG_PADDLE_HEIGHT
+#define SERVER_PADDLE_OFFSET_X PONG_PADDLE_OFFSET_X
+#define SERVER_PADDLE_WIDTH PONG_PADDLE_WIDTH
+#define DEFAULT_HZ 60           // Server rates assumed until WELCOME tells the real ones
 
 
 // Represents the current status of the client's connection to the server
@@ -107,22 +111,48 @@ typedef enum {
 } ConnectionState;
 
 
+// Receive side of the connection to the server
+typedef struct {
+    ConnectionState status;                // Where we are in the connection lifecycle
+    int proto;                             // Binary protocol version confirmed in WELCOME (0 = text)
+    unsigned char rx[BUFFER_SIZE * 2];     // Bytes received but not processed yet
+    size_t rx_len;                         // Number of valid bytes in rx
+    PongSnapshotRing history;              // Recent snapshots, baselines for delta frames
+    unsigned int ack_seq;                  // Newest snapshot applied, to be acknowledged
+    int ack_pending;                       // 1 if ack_seq hasn't been sent to the server yet
+    unsigned int applied_seq;              // Newest snapshot shown, older ones arriving late are skipped
+    double applied_at;                     // GetTime() when it was shown
+    int udp_port;                          // UDP channel granted in WELCOME (0 = TCP only)
+    unsigned int udp_slot, udp_token;      // Credentials for input datagrams
+    unsigned int input_seq;                // Sequence number of the newest input datagram
+    uint8_t inputs[PONG_INPUT_REDUNDANCY]; // Last inputs sent, newest first
+    int input_hz;                          // Input samples per second the server takes
+    int snapshot_hz;                       // Snapshot sequence numbers per second
+    double input_due;                      // GetTime() the next input should be sent at
+} Connection;
+
+
 // Represents the current game state as received from the server
 typedef struct {
     int is_player1;     // 1 if this client is player 1, 0 otherwise
+    int watching;       // 1 if this client only spectates the match
     int p1_y;           // Y-position of player 1's paddle (in logical units)
     int p2_y;           // Y-position of player 2's paddle
     int score1;         // Score for player 1
     int score2;         // Score for player 2
-    int serve_timer;    // Frames remaining before ball is served (used for countdown)
+    int serve_timer;    // Ticks remaining before ball is served (used for countdown)
+    int physics_hz;     // Server ticks per second, the unit of serve_timer
+    int winner;         // Winning player once the server ends the match (0 while playing)
+    int game_over;      // 1 after a GAMEOVER message has been received
 } GameState;
 
 
 // Structure to hold locally predicted ball state between updates
 typedef struct {
-    float x, y;              // Predicted position of the ball
-    float dx, dy;            // Predicted velocity (from last known server state)
-    double last_update;      // Timestamp of the last authoritative update
+    PongBall base;           // Ball of the last authoritative update, in the server's fixed point
+    int p1_y, p2_y;          // Paddle rows of that update, which the ball bounces off
+    double base_time;        // Timestamp of the last authoritative update
+    float x, y;              // Predicted position of the ball, to draw
     int valid;               // 1 if prediction is active; 0 if not yet initialized
 } PredictedBall;
 
@@ -168,11 +198,20 @@ void draw_game(GameState *state, const char *last_input) {
 
     // Show countdown number if a serve delay is active
     if (state->serve_timer > 0) {
-        int countdown = (state->serve_timer + 29) / 30;
-        // Divide remaining frames by 30 to approximate a countdown in seconds (rounded up)
+        int half = state->physics_hz / 2 > 0 ? state->physics_hz / 2 : 1;
+        int countdown = (state->serve_timer + half - 1) / half;
+        // Divide remaining ticks by half a second's worth to approximate a countdown (rounded up)
         DrawText(TextFormat("%d", countdown), SCREEN_WIDTH / 2 - 10, SCREEN_HEIGHT / 2 - 20, 40, WHITE);
     }
 
+    // Show the final result once the server has closed the match
+    if (state->game_over) {
+        const char *result = state->winner == 0 ? "Match aborted" :
+                             state->watching ? (state->winner == 1 ? "Player 1 wins" : "Player 2 wins") :
+                             (state->winner == 1) == (state->is_player1 != 0) ? "You win!" : "You lose";
+        DrawText(result, SCREEN_WIDTH / 2 - 80, SCREEN_HEIGHT / 2 + 40, 30, GREEN);
+    }
+
     // Show last sent input (debug/feedback)
     if (last_input) {
         DrawText(TextFormat("Last input: %s", last_input), 10, SCREEN_HEIGHT - 30, 20, GREEN);
@@ -181,23 +220,72 @@ void draw_game(GameState *state, const char *last_input) {
     EndDrawing(); // Submit the frame to be displayed
 }
 
-// Sends player input to the server based on keypresses.
-// Returns a string representing the last input sent (for optional display/debug).
-const char *handle_input(int sockfd, GameState *state) {
-    const char *msg = "INPUT:IDLE\n";
-    // Default message to send when no input is detected (idle state).
-
+// Reads the keys of this player. Returns one of the PONG_INPUT_* values.
+int read_input(GameState *state) {
     if (state->is_player1) {
         // Player 1 uses W and S keys for movement
-        if (IsKeyDown(KEY_W)) msg = "INPUT:UP\n";
-        else if (IsKeyDown(KEY_S)) msg = "INPUT:DOWN\n";
+        if (IsKeyDown(KEY_W)) return PONG_INPUT_UP;
+        if (IsKeyDown(KEY_S)) return PONG_INPUT_DOWN;
     } else {
         // Player 2 uses UP and DOWN arrow keys
-        if (IsKeyDown(KEY_UP)) msg = "INPUT:UP\n";
-        else if (IsKeyDown(KEY_DOWN)) msg = "INPUT:DOWN\n";
+        if (IsKeyDown(KEY_UP)) return PONG_INPUT_UP;
+        if (IsKeyDown(KEY_DOWN)) return PONG_INPUT_DOWN;
     }
+    return PONG_INPUT_NONE;
+}
+
+// Snapshot our prediction has reached: the newest one applied plus the server
+// frames predicted since. Stamps each input, so the server can apply it at the
+// tick the player actually saw. 0 (no stamp) until a delta snapshot arrived.
+unsigned int input_stamp(const Connection *link) {
+    if (!link->applied_seq) return 0;
+    return link->applied_seq + (unsigned int)((GetTime() - link->applied_at) * link->snapshot_hz);
+}
+
+// Sends player input in a datagram, together with the inputs of the previous
+// datagrams so a lost one costs nothing, and the newest snapshot applied.
+void send_input_dgram(int udpfd, int input, Connection *link) {
+    PongInputDgram in = {.slot = link->udp_slot, .token = link->udp_token,
+                         .seq = ++link->input_seq, .ack = link->ack_seq,
+                         .stamp = input_stamp(link)};
+    uint8_t out[PONG_DGRAM_MAX];
+
+    memmove(link->inputs + 1, link->inputs, sizeof(link->inputs) - 1);
+    link->inputs[0] = (uint8_t)input;
+    in.count = link->input_seq < PONG_INPUT_REDUNDANCY ? link->input_seq : PONG_INPUT_REDUNDANCY;
+    memcpy(in.inputs, link->inputs, sizeof(in.inputs));
+
+    size_t len = pong_encode_input_dgram(&in, out, sizeof(out));
+    send(udpfd, out, len, 0);
+    link->ack_pending = 0;
+    // The datagram carries the acknowledgement; a lost one is repeated by the next.
+}
 
-    send(sockfd, msg, strlen(msg), MSG_NOSIGNAL);
+// Sends player input to the server based on keypresses, over UDP if the server
+// granted the channel.
+// Returns a string representing the last input sent (for optional display/debug).
+// Any pending snapshot acknowledgement travels in the same send() call.
+const char *handle_input(int sockfd, int udpfd, GameState *state, Connection *link) {
+    static const char *const msgs[] = {"INPUT:IDLE", "INPUT:UP", "INPUT:DOWN"};
+    int input = read_input(state);
+    const char *msg = msgs[input];
+
+    if (udpfd >= 0 && link->udp_port) {
+        send_input_dgram(udpfd, input, link);
+        return msg;
+    }
+
+    char out[64];
+    unsigned int stamp = input_stamp(link);
+    int len = stamp ? snprintf(out, sizeof(out), "%s@%u\n", msg, stamp)
+                    : snprintf(out, sizeof(out), "%s\n", msg);
+    if (link->ack_pending) {
+        len += snprintf(out + len, sizeof(out) - len, "ACK:%u\n", link->ack_seq);
+        link->ack_pending = 0;
+        // Tells the server which snapshot the next deltas can be based on.
+    }
+
+    send(sockfd, out, len, MSG_NOSIGNAL);
     // Send the input message to the server over TCP.
     // MSG_NOSIGNAL prevents the process from receiving SIGPIPE if the connection is closed.
 
@@ -206,35 +294,72 @@ const char *handle_input(int sockfd, GameState *state) {
 }
 
 
-// Parses a line received from the server and updates the local game state and prediction.
+// Applies an authoritative snapshot from the server to the local game state and prediction.
+void apply_snapshot(const PongSnapshot *snap, GameState *state) {
+    state->p1_y = snap->p1_y;
+    state->p2_y = snap->p2_y;
+    state->score1 = snap->score1;
+    state->score2 = snap->score2;
+    state->serve_timer = snap->serve_timer;
+
+    // Update the prediction structure using the latest authoritative ball state.
+    predicted.base = (PongBall){
+        .x = pong_fx_dequantize(snap->ball_x, PONG_POS_SCALE),
+        .y = pong_fx_dequantize(snap->ball_y, PONG_POS_SCALE),
+        .dx = pong_fx_dequantize(snap->ball_dx, PONG_VEL_SCALE),
+        .dy = pong_fx_dequantize(snap->ball_dy, PONG_VEL_SCALE),
+        .serve_timer = snap->serve_timer
+    };
+    // The speed isn't on the wire: a predicted paddle hit keeps it until the next update.
+    predicted.p1_y = snap->p1_y;
+    predicted.p2_y = snap->p2_y;
+    predicted.x = (float)predicted.base.x / PONG_FX_ONE;
+    predicted.y = (float)predicted.base.y / PONG_FX_ONE;
+    predicted.base_time = GetTime();   // Timestamp of the update
+    predicted.valid = 1;               // Enable prediction on the next frame
+}
+
+
+// Parses a text line received from the server and updates the connection or game state.
 // Returns 1 if the line was successfully parsed and applied, 0 otherwise.
-int process_game_state(char *line, GameState *state) {
-    int new_p1_y, new_p2_y, score1, score2, timer;
-    float ball_x, ball_y, ball_dx, ball_dy;
+int process_line(char *line, Connection *link, GameState *state) {
+    PongSnapshot snap;
+
+    // WELCOME <player>[ BIN:<version>] MATCH:<index> completes the handshake
+    // (player 0 for a spectator). If the server
+    // echoes the binary protocol version, everything after this line is binary frames.
+    if (strncmp(line, "WELCOME", 7) == 0) {
+        const char *bin = strstr(line, " BIN:");
+        const char *udp = strstr(line, " UDP:");
+        link->proto = bin ? atoi(bin + 5) : 0;
+        if (!udp || sscanf(udp, " UDP:%d:%u:%u", &link->udp_port, &link->udp_slot, &link->udp_token) != 3)
+            link->udp_port = 0;
+        // UDP:<port>:<slot>:<token> grants the datagram channel.
+
+        const char *resume = strstr(line, " RESUME:");
+        unsigned int token;
+        if (resume && sscanf(resume, " RESUME:%u", &token) == 1)
+            printf("Resume token %u: pass resume=%u to get back into this match after a server restart\n", token, token);
+        // RESUME:<token> comes from a server that journals its matches.
+
+        const char *hz = strstr(line, " HZ:");
+        if (hz) sscanf(hz, " HZ:%d:%d:%d", &state->physics_hz, &link->input_hz, &link->snapshot_hz);
+        // HZ:<physics>:<input>:<snapshot> are the server's rates.
+        link->status = CONNECTION_STATE_PLAYING;
+        return 1;
+    }
+
+    // The server ends a match with GAMEOVER:<winner> and then closes the connection.
+    if (sscanf(line, "GAMEOVER:%d", &state->winner) == 1) {
+        state->game_over = 1;
+        return 1;
+    }
 
     // Try to parse a full game state update from the server.
     // Expected format:
     // STATE:<p1_y>,<p2_y>,<ball_x>,<ball_y>,<ball_dx>,<ball_dy>,<score1>,<score2>,<timer>
-    int parsed = sscanf(line, "STATE:%d,%d,%f,%f,%f,%f,%d,%d,%d",
-                        &new_p1_y, &new_p2_y, &ball_x, &ball_y,
-                        &ball_dx, &ball_dy, &score1, &score2, &timer);
-
-    if (parsed == SERVER_EXPECTED_MESSAGES) {
-        // If all the values were successfully parsed, update the local game state:
-        state->p1_y = new_p1_y;
-        state->p2_y = new_p2_y;
-        state->score1 = score1;
-        state->score2 = score2;
-        state->serve_timer = timer;
-
-        // Update the prediction structure using the latest authoritative ball state.
-        predicted.x = ball_x;
-        predicted.y = ball_y;
-        predicted.dx = ball_dx;
-        predicted.dy = ball_dy;
-        predicted.last_update = GetTime(); // Timestamp of the update
-        predicted.valid = 1;               // Enable prediction on the next frame
-
+    if (pong_parse_state(line, &snap)) {
+        apply_snapshot(&snap, state);
         return 1; // Parsing and update successful
     }
 
@@ -242,18 +367,145 @@ int process_game_state(char *line, GameState *state) {
 }
 
 
+// Rebuilds the snapshot carried by a delta frame from its acknowledged baseline.
+// Returns 1 if the frame was applied, 0 otherwise.
+int process_delta(const unsigned char *frame, size_t len, Connection *link, GameState *state) {
+    PongSnapshot snap = {0};
+    uint32_t seq, base_seq;
+
+    if (!pong_decode_delta_header(frame, len, &seq, &base_seq)) return 0;
+
+    if (base_seq) {
+        const PongSnapshot *base = pong_ring_get(&link->history, base_seq);
+        if (!base) {
+            // We no longer have the baseline: ask for a frame without one.
+            link->ack_seq = 0;
+            link->ack_pending = 1;
+            return 0;
+        }
+        snap = *base;
+    }
+    if (!pong_decode_delta(frame, len, &snap)) return 0;
+
+    pong_ring_put(&link->history, seq, &snap);
+    link->ack_seq = seq;
+    link->ack_pending = 1;
+    if ((int32_t)(seq - link->applied_seq) > 0) {
+        link->applied_seq = seq;
+        link->applied_at = GetTime();
+        apply_snapshot(&snap, state);
+    }
+    // A datagram may already have shown something newer.
+    return 1;
+}
+
+
+// Applies a snapshot datagram unless a newer snapshot was already applied.
+// The snapshot also becomes a baseline the server may send deltas against.
+void process_dgram(const uint8_t *dgram, size_t len, Connection *link, GameState *state) {
+    PongSnapshot snap;
+    uint32_t seq;
+
+    if (!pong_decode_snapshot_dgram(dgram, len, &seq, &snap)) return;
+    if ((int32_t)(seq - link->applied_seq) <= 0) return;
+
+    pong_ring_put(&link->history, seq, &snap);
+    link->ack_seq = seq;
+    link->applied_seq = seq;
+    link->applied_at = GetTime();
+    apply_snapshot(&snap, state);
+}
+
+
+// Decodes one complete binary frame from the server.
+// Returns 1 if the frame was applied, 0 otherwise.
+int process_frame(const unsigned char *frame, size_t len, unsigned char type,
+                  Connection *link, GameState *state) {
+    PongSnapshot snap;
+
+    if (type == PONG_FRAME_DELTA) return process_delta(frame, len, link, state);
+
+    if (type == PONG_FRAME_SNAPSHOT && pong_decode_snapshot(frame, len, &snap)) {
+        apply_snapshot(&snap, state);
+        return 1;
+    }
+    if (type == PONG_FRAME_GAMEOVER && pong_decode_gameover(frame, len, &state->winner)) {
+        state->game_over = 1;
+        return 1;
+    }
+    return 0;
+}
+
+
+// Consumes every complete line or frame in the receive buffer.
+// Incomplete data stays buffered until the rest of it arrives.
+void process_incoming(Connection *link, GameState *state) {
+    size_t pos = 0;
+
+    while (pos < link->rx_len) {
+        unsigned char *data = link->rx + pos;
+        size_t avail = link->rx_len - pos;
+
+        if (link->proto) {
+            unsigned char type;
+            int len = pong_frame_peek(data, avail, &type);
+            if (len == 0) break;            // Wait for the rest of the frame
+            if (len < 0) {                  // Out of sync: nothing sensible left to decode
+                link->status = CONNECTION_STATE_DISCONNECTED;
+                pos = link->rx_len;
+                break;
+            }
+            process_frame(data, (size_t)len, type, link, state);
+            pos += (size_t)len;
+        } else {
+            unsigned char *nl = memchr(data, '\n', avail);
+            if (!nl) break;                 // Wait for the rest of the line
+            *nl = '\0';                     // Null-terminate line
+            process_line((char *)data, link, state);
+            pos += (size_t)(nl - data) + 1;
+            // The WELCOME line may switch the rest of the buffer to binary frames.
+        }
+    }
+
+    // Shift the unprocessed bytes to the start of the buffer.
+    memmove(link->rx, link->rx + pos, link->rx_len - pos);
+    link->rx_len -= pos;
+
+    if (link->rx_len == sizeof(link->rx))
+        link->rx_len = 0;
+    // A full buffer without a single complete message can only be garbage.
+}
+
+
 int main(int argc, char *argv[]) {
-    // Check argument count: expects server IP and player number
-    if (argc != 3) {
-        printf("Usage: %s <server_ip> <player_number>\n", argv[0]);
+    // Check arguments: expects server IP and player number, or "watch" and the
+    // match to spectate, optionally followed by "text" to keep the human-readable
+    // protocol, and for players "udp" to play over datagrams, "rate=<hz>" to
+    // get fewer snapshots per second and "resume=<token>" to get back into a
+    // match the server restored after a restart
+    int watching = (argc >= 4 && strcmp(argv[2], "watch") == 0);
+    int args = watching ? 4 : 3;
+    int text_mode = 0, udp_mode = 0, rate = 0, valid = argc >= args;
+    unsigned int resume = 0;
+    for (int i = args; i < argc; i++) {
+        if (strcmp(argv[i], "text") == 0) text_mode = 1;
+        else if (!watching && strcmp(argv[i], "udp") == 0) udp_mode = 1;
+        else if (!watching && sscanf(argv[i], "rate=%d", &rate) == 1 && rate > 0) continue;
+        else if (!watching && sscanf(argv[i], "resume=%u", &resume) == 1 && resume > 0) continue;
+        else valid = 0;
+    }
+    if (!valid || (text_mode && udp_mode)) {
+        printf("Usage: %s <server_ip> <player_number> [text|udp] [rate=<hz>] [resume=<token>]\n", argv[0]);
+        printf("       %s <server_ip> watch <match> [text]\n", argv[0]);
         return 1;
     }
 
     const char *server_ip = argv[1];
-    int player_number = atoi(argv[2]);
+    int player_number = watching ? 0 : atoi(argv[2]);
+    int match = watching ? atoi(argv[3]) : -1;
 
     // Validate player number: must be 1 or 2
-    if (player_number != 1 && player_number != 2) {
+    if (!watching && player_number != 1 && player_number != 2) {
         printf("Player must be 1 or 2.\n");
         return 1;
     }
@@ -279,16 +531,26 @@ int main(int argc, char *argv[]) {
     int opt = 1;
     setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
 
-    // Send initial HELLO message to identify as player 1 or 2
-    char hello_msg[32];
-    snprintf(hello_msg, sizeof(hello_msg), "HELLO:%d\n", player_number);
+    // Send initial HELLO message to identify as player 1 or 2 (or WATCH to
+    // spectate a match), asking for binary snapshots unless text mode was requested
+    char hello_msg[64];
+    int len = watching
+        ? snprintf(hello_msg, sizeof(hello_msg), "WATCH:%d", match)
+        : snprintf(hello_msg, sizeof(hello_msg), "HELLO:%d", player_number);
+    if (!text_mode) len += snprintf(hello_msg + len, sizeof(hello_msg) - len, " BIN:%d", PONG_PROTO_VERSION);
+    if (udp_mode) len += snprintf(hello_msg + len, sizeof(hello_msg) - len, " UDP");
+    if (rate) len += snprintf(hello_msg + len, sizeof(hello_msg) - len, " RATE:%d", rate);
+    if (resume) len += snprintf(hello_msg + len, sizeof(hello_msg) - len, " RESUME:%u", resume);
+    snprintf(hello_msg + len, sizeof(hello_msg) - len, "\n");
     send(sockfd, hello_msg, strlen(hello_msg), MSG_NOSIGNAL);
 
     // Initialize local game state
-    GameState state = {.is_player1 = (player_number == 1)};
+    GameState state = {.is_player1 = (player_number == 1), .watching = watching, .physics_hz = DEFAULT_HZ};
 
-    char buffer[BUFFER_SIZE * 2] = {0}; // Accumulated incoming data buffer
+    Connection link = {.status = CONNECTION_STATE_WAITING_WELCOME,   // Incoming data and protocol mode
+                       .input_hz = DEFAULT_HZ, .snapshot_hz = DEFAULT_HZ};
     const char *last_input = NULL;      // Pointer to last input sent (for UI)
+    int udpfd = -1;                     // Datagram socket, opened once the server grants it
 
     // === Main game loop ===
     while (!WindowShouldClose()) {
@@ -297,47 +559,68 @@ int main(int argc, char *argv[]) {
         // --- Ball prediction logic ---
         // If we have received at least one authoritative update from the server,
         // and it was recent enough (within 1 second), we continue predicting.
-        if (predicted.valid && (now - predicted.last_update) < 1.0) {
-            // GetFrameTime() returns the time elapsed since the last frame (in seconds).
-            // For example, at 60 FPS, this will return approximately 0.01667.
-             double dt = GetFrameTime();
-
-            // The server expresses ball velocity in "units per frame", assuming 60 FPS.
-            // To convert it into "units per second", we multiply by 60.0f.
-            // Then we multiply by dt to scale the movement by real elapsed time.
-            //
-            // This results in: delta_position = velocity_per_frame × (seconds/frame) × frames/sec
-            //                ≈ velocity_per_frame × seconds
-            //
-            // So overall:
-            //      predicted.x ← predicted.x + dx × dt × 60
-            //      predicted.y ← predicted.y + dy × dt × 60
-
-            predicted.x += predicted.dx * dt * 60.0f;
-            predicted.y += predicted.dy * dt * 60.0f;
-
-            // Update the prediction timestamp to the current time.
-            // This ensures prediction continues smoothly on the next frame.
-            predicted.last_update = now;
+        if (predicted.valid && (now - predicted.base_time) < 1.0) {
+            double ticks = (now - predicted.base_time) * state.physics_hz;
+            int whole = (int)ticks;
+            // Server ticks elapsed since the update; the rest is a fraction of the current one.
+
+            PongBall ball = predicted.base;
+            pong_fx dt = pong_fx_tick((uint32_t)state.physics_hz);
+            for (int i = 0; i < whole; i++)
+                pong_ball_step(&ball, predicted.p1_y, predicted.p2_y, dt);
+            // Exactly the server's simulation, restarted from the snapshot every frame.
+
+            float frac = ball.serve_timer > 0 ? 0.0f : (float)(ticks - whole);
+            float step = frac * dt / PONG_FX_ONE;
+            predicted.x = ((float)ball.x + (float)ball.dx * step) / PONG_FX_ONE;
+            predicted.y = ((float)ball.y + (float)ball.dy * step) / PONG_FX_ONE;
+            // Floats only to draw in between ticks.
+        }
+
+        // --- Open the UDP channel ---
+        // Connected to the port from WELCOME, so send() reaches it and only its
+        // datagrams are received.
+        if (udpfd < 0 && link.udp_port) {
+            struct sockaddr_in udp_addr = serv_addr;
+            udp_addr.sin_port = htons((uint16_t)link.udp_port);
+            udpfd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (udpfd >= 0 && connect(udpfd, (struct sockaddr *)&udp_addr, sizeof(udp_addr)) < 0) {
+                close(udpfd);
+                udpfd = -1;
+                link.udp_port = 0;
+                // Keep playing over TCP alone.
+            }
         }
 
         // --- Handle input ---
-        last_input = handle_input(sockfd, &state);
+        // Sampled at the server's input rate: more often would only be overwritten.
+        if (!watching && now >= link.input_due) {
+            last_input = handle_input(sockfd, udpfd, &state, &link);
+            link.input_due += 1.0 / link.input_hz;
+            if (link.input_due < now - 1.0 / link.input_hz) link.input_due = now;
+            // Keeps the average rate even though frames and samples don't line up.
+        }
+        // Spectators send nothing: their deltas are based on what the server wrote last.
 
         // --- Receive and process data from server ---
-        char netbuf[BUFFER_SIZE] = {0};
-        ssize_t n = recv(sockfd, netbuf, sizeof(netbuf) - 1, 0);
+        // New bytes are appended to whatever partial line or frame is still buffered.
+        // The read doesn't block: with delta frames the server sends nothing while
+        // the game state doesn't change, and we must keep rendering meanwhile.
+        ssize_t n = recv(sockfd, link.rx + link.rx_len, sizeof(link.rx) - link.rx_len, MSG_DONTWAIT);
 
         if (n > 0) {
-            netbuf[n] = '\0';
-            strcat(buffer, netbuf);
-
-            char *line;
-            while ((line = strchr(buffer, '\n'))) {
-                *line = '\0'; // Null-terminate line
-                process_game_state(buffer, &state); // Try to parse
-                memmove(buffer, line + 1, strlen(line + 1) + 1); // Shift buffer
-            }
+            link.rx_len += (size_t)n;
+            process_incoming(&link, &state);
+        } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            link.status = CONNECTION_STATE_DISCONNECTED; // Server closed the connection
+        }
+
+        // Every snapshot datagram that arrived since the last frame, newest wins.
+        if (udpfd >= 0) {
+            uint8_t dgram[PONG_DGRAM_MAX];
+            ssize_t got;
+            while ((got = recv(udpfd, dgram, sizeof(dgram), MSG_DONTWAIT)) > 0)
+                process_dgram(dgram, (size_t)got, &link, &state);
         }
 
         // --- Render frame ---
@@ -345,6 +628,7 @@ int main(int argc, char *argv[]) {
     }
 
     // === Cleanup ===
+    if (udpfd >= 0) close(udpfd);
     shutdown(sockfd, SHUT_RDWR); // Gracefully close TCP socket
     close(sockfd);               // Release descriptor
     CloseWindow();               // Close graphical window
@@ -1,309 +1,2524 @@
 #include "pong.h"
+#include "pong_clock.h"
+#include "pong_proto.h"
+#include "pong_physics.h"
+#include "pong_game.h"
+#include "pong_pool.h"
+#include "pong_journal.h"
+#include "pong_metrics.h"
+#include "pong_mib.h"
+#include "pong_trace.h"
 #include "lwip/opt.h"
 
 #if LWIP_NETCONN
 
 #include "lwip/sys.h"
 #include "lwip/api.h"
+#include "lwip/tcpip.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/timers.h"
+#include "lwip/stats.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
-#include <math.h>
 #include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if !LWIP_SOCKET
+#error "pong uses the netconn socket field to map connections to clients, enable LWIP_SOCKET"
+#endif
 
 // === Constants for game settings ===
 #define PORT 12345                         // TCP port used for the Pong server
-#define FPS 60                             // Frames per second
-#define FRAME_TIME_MS (1000 / FPS)         // Time per frame in milliseconds
-#define FIELD_WIDTH 80                     // Width of the playing field (text-based)
-#define FIELD_HEIGHT 24                    // Height of the playing field
-#define PADDLE_HEIGHT 4                    // Height of each paddle
-#define PADDLE_WIDTH 2                     // Width of each paddle
-#define PADDLE_OFFSET_X 2                  // Horizontal offset of paddles from edge
-#define SERVE_TIME (FPS * 3)               // Time to wait before serving the ball
+#define PHYSICS_HZ 60                      // Default simulation ticks per second
+#define INPUT_HZ 60                        // Default times per second the connections are served
+#define SNAPSHOT_HZ 60                     // Default snapshots per second (the most a client gets)
+#define MAX_CATCHUP_TICKS 5                // Missed frames replayed after an overrun before skipping them
+#define SERVE_SECONDS 3                    // Time to wait before serving the ball
 #define MAX_BUFFER_SIZE 256                // Max size of TCP receive buffer
 #define MAX_INPUT_LEN 64                   // Max length of input command
+#define MAX_MATCHES 2048                   // Max number of concurrent matches per server
+#define MAX_CLIENTS (MAX_MATCHES * 2)      // Two connection slots per match
+#define HANDSHAKE_TIMEOUT_MS 2000          // Time a new client gets to send its HELLO line
+#define RESUME_TIMEOUT_MS 30000            // Time the players of a restored match get to come back
+#define MAX_INFLIGHT 16                    // Shared snapshot pbufs a client may have unacknowledged
+#define CLOSE_LINGER_MS 3000               // Time a finished client gets to acknowledge its last frames
+#define MAX_SPECTATORS 16384               // Read-only viewer slots, shared by every match
+#define MAX_FEEDS 64                       // Matches that can be watched at the same time
+#define FEED_HISTORY 256                   // Snapshots a watched match keeps for its delayed broadcast (power of two)
+#define SPECTATOR_DELAY_MS 2000            // Default broadcast delay of the spectator stream
+#define SPECTATOR_INFLIGHT 4               // Shared frames a spectator may have unacknowledged
+#define SPECTATOR_CHUNK 512                // Spectator writes done per tcpip message before yielding
+#define SPECTATOR_SEG_RESERVE 256          // TCP segments kept free for player frames (needs MEMP_STATS)
+#define MAX_CONNS (MAX_CLIENTS + MAX_SPECTATORS)   // Reactor slots: clients first, then spectators
+#define WATCHER_ID 3                       // Pseudo player ID of a lobby client that sent WATCH
+#define REWIND_TICKS 16                    // Ticks a stamped input may reach back (power of two)
+#define LOAD_HIGH_PCT 80                   // Share of the tick budget above which the server sheds load
+#define LOAD_LOW_PCT 50                    // ... and below which it takes a step back to normal
+#define LOAD_HOLD_MS 1000                  // Minimum time between two load level changes
+#define SLOW_MATCH_STRIDE 2                // Frames an idle match waits between steps when shedding
+#define IDLE_MATCH_SECONDS 3               // Time without an input change after which a match counts as idle
+#define JOURNAL_MAX_MB 256                 // Default largest input journal, see pong_set_journal()
+#define JOURNAL_STAGE 256                  // Records a match stages between two appends to the journal
+#define JOURNAL_RESERVE (MAX_MATCHES * (JOURNAL_STAGE + PONG_JOURNAL_RECORD_MAX))  // Journal tail kept for match ends
 
-// Ball movement configuration
-#define INITIAL_BALL_SPEED 0.5f
-#define MAX_BALL_SPEED 1.2f
-#define SPEED_INCREASE_FACTOR 1.03f
-#define MAX_BOUNCE_ANGLE (M_PI / 4.0f)
-#define MIN_BOUNCE_ANGLE 0.3f
+// Field, paddle and ball configuration: see pong_physics.h, shared with the client.
+// The simulation of a match itself is pong_game.c, which needs no network.
 
 // === Input enumeration ===
-typedef enum { NONE, UP, DOWN } Input;
+typedef enum { NONE, UP, DOWN } Input;     // Same values as PONG_INPUT_*
 
-// === Player state ===
+// === Shared frame still referenced by a client's TCP send queue ===
 typedef struct {
-    int y;         // Paddle vertical position
-    Input input;   // Last received input
-} Player;
+    struct pbuf *p;    // Frame pbuf, one reference held per entry
+    u32_t end_seq;     // TCP sequence number right after the frame's last byte
+} InFlight;
 
-// === Ball state ===
+// === Connection handle ===
+// In netconn mode (pong_init) connections are netconns served by the pong thread.
+// In raw mode (pong_init_raw) they are raw TCP pcbs, served from the tcpip thread,
+// which then runs the game loop too. Exactly one of the two is set while open.
 typedef struct {
-    float x, y;        // Ball position
-    float dx, dy;      // Ball velocity
-    int serve_timer;   // Delay before serve
-    float speed;       // Current ball speed
-} Ball;
+    struct netconn *conn;   // Netconn mode connection
+    struct tcp_pcb *pcb;    // Raw mode connection (NULL once the stack dropped it)
+} Link;
 
 // === Client connection state ===
 typedef struct {
-    struct netconn *conn;             // TCP connection object
+    Link link;                        // TCP connection
     char buffer[MAX_BUFFER_SIZE];     // Input buffer
     int buffer_len;                   // Length of buffered data
-    int id;                           // Player ID (1 or 2)
+    int id;                           // Player ID (1 or 2, 0 until HELLO is received, WATCHER_ID for WATCH)
+    int match;                        // Index of the match this client plays in (-1 if none)
+    Input input;                      // Newest input received from this client
+    uint32_t input_stamp;             // Snapshot seq the client was predicting for it (0 = none)
+    int lag_ticks;                    // Ticks between its stamps and their arrival, last measured
+    uint64_t lat_arrived;             // Input followed for its latency: when it reached the tcpip thread (0 = none),
+    uint64_t lat_taken;               // ... when the game loop took it,
+    uint64_t lat_stepped;             // ... and when its match was stepped with it (0 = not yet)
+    int proto;                        // Binary protocol version agreed in the handshake (0 = text)
+    uint32_t acked_seq;               // Newest snapshot the client acknowledged (0 = none)
+    int watch;                        // Match a WATCH handshake asked for
+    uint32_t resume;                  // Token its HELLO echoed to get back into a restored match (0 = none)
+    int send_div;                     // Gets every send_div-th snapshot (its RATE:<hz>)
+    int lobby_pos;                    // Position in lobby[] while waiting for HELLO (-1 otherwise)
+    u32_t accepted_at;                // sys_now() when the connection was accepted
+    InFlight inflight[MAX_INFLIGHT];  // Frames written without copy and not acknowledged yet (FIFO)
+    u8_t inflight_head, inflight_count;
+    int closing_pos;                  // Position in closing[] while the close is pending (-1 otherwise)
+    u32_t close_deadline;             // sys_now() after which a pending close aborts the connection
+
+    // UDP channel (see pong_proto.h), set up in the handshake if the client asks for it.
+    int udp;                          // 1 if the HELLO asked for the UDP channel
+    uint32_t udp_token;               // Token its datagrams must carry (0 = no UDP channel)
+    uint32_t udp_bound;               // Token whose datagrams set udp_addr (tcpip thread)
+    ip_addr_t udp_addr;               // Source of its datagrams, where snapshots go (tcpip thread)
+    u16_t udp_port;
+    uint32_t udp_seq;                 // Newest input datagram accepted (tcpip thread)
+    Input udp_input;                  // Newest input and ACK received by datagram, handed to the
+    uint32_t udp_ack;                 // game loop through the ready ring (SYS_ARCH_PROTECT)
+    uint32_t udp_stamp;
+    uint64_t udp_at;                  // pong_clock_ns() when that datagram arrived
+    int udp_fresh;                    // 1 if they haven't been taken by the game loop yet
 } Client;
 
-// Ensures that the paddle's vertical position stays within the boundaries of the game field.
-static void clamp_paddle(Player *p) {
-    if (p->y < 0) p->y = 0;
-    // If the paddle is above the top edge (y < 0), clamp it to the top.
+// === Match lifecycle ===
+typedef enum {
+    MATCH_FREE,      // Slot is unused and can be handed out to new players
+    MATCH_WAITING,   // One player joined, waiting for the opponent
+    MATCH_PLAYING    // Both players connected, the match is being ticked
+} MatchState;
 
-    if (p->y > FIELD_HEIGHT - PADDLE_HEIGHT)
-        p->y = FIELD_HEIGHT - PADDLE_HEIGHT;
-    // If the bottom of the paddle exceeds the bottom of the field,
-    // clamp it so its bottom aligns with the bottom edge.
-    // FIELD_HEIGHT is the total number of vertical units.
-    // PADDLE_HEIGHT is the number of units the paddle occupies.
-}
+// A recent step of a match, as last simulated.
+typedef struct {
+    PongGame game;             // State at the start of the step, with the inputs applied during it
+    uint32_t ticks;            // Ticks the step covered
+    int grace[2];              // Scoring grace it gave each player
+} Rewind;
+
+// === Match state ===
+// Everything a single game needs lives here, so the server can tick many
+// of them side by side. Each match starts on a cache line of its own: the
+// workers stepping neighbouring matches never write to the same line.
+typedef struct {
+    _Alignas(PONG_CACHE_LINE)
+    MatchState state;          // Current lifecycle stage of the slot
+    Client *players[2];        // players[0] is player 1, players[1] is player 2
+    PongGame game;             // Paddles, ball, score and serve PRNG (pong_game.h)
+    int active_pos;            // Position of this match in active_matches[] (-1 if free)
+    uint32_t seq;              // Sequence number of the newest snapshot sent
+    PongSnapshotRing history;  // Recent snapshots, used as baselines for delta frames
+    int feed;                  // Spectator feed capturing this match (-1 if nobody watches)
+    uint32_t tick;             // Ticks simulated so far
+    uint32_t rewind_floor;     // Oldest tick a late input may rewind to (no point scored since)
+    Rewind rewind[REWIND_TICKS];         // Recent steps, indexed by the tick % REWIND_TICKS they started at
+    uint32_t frame_tick[REWIND_TICKS];   // Tick of each recent snapshot, by seq % REWIND_TICKS
+    uint32_t deferred;         // Ticks owed to it while it is stepped at a reduced rate
+    uint32_t input_tick;       // Tick of the last input change of either player
+    int frame_result;          // Outcome of its step this frame: -1 if not stepped, else match_step()'s
+    int recovered;             // 1 if restored from the journal: it waits for both players again
+    uint32_t resume[2];        // Token each player can reclaim its slot with after a restart
+
+    // Input journal (see pong_journal.h), written REWIND_TICKS behind the
+    // simulation, where late inputs can't rewrite the history any more.
+    int journaled;             // 1 from its START record to its END or ABORT
+    int journal_lost;          // 1 once records didn't fit: only LOST gets written then
+    uint32_t journal_tick;     // Next step to journal
+    uint32_t journal_last;     // Tick of the last record staged
+    int journal_in[2];         // Inputs as the journal last recorded them
+    int journal_grace[2];      // Grace as the journal last recorded it
+    uint16_t journal_len;
+    uint8_t journal_buf[JOURNAL_STAGE];  // Records staged by the workers, appended by pong_frame()
+} Match;
+
+// === Load levels ===
+// Steps the server takes, one after the other, when frames use too much of the
+// tick budget, and undoes in reverse order once the pressure is gone.
+typedef enum {
+    LOAD_NORMAL,       // Everything at the configured rates
+    LOAD_SEND_HALF,    // Players get every 2nd snapshot (60 -> 30 Hz)
+    LOAD_SEND_THIRD,   // Players get every 3rd snapshot (60 -> 20 Hz)
+    LOAD_SLOW_MATCHES, // Idle, unwatched matches are stepped every SLOW_MATCH_STRIDE frames (see match_idle)
+    LOAD_REFUSE,       // No new matches are opened
+    LOAD_LEVELS
+} LoadLevel;
+
+// === Spectator connection state ===
+// Spectators never send anything after WATCH, so unlike Client there is no line
+// buffer or input here: a few words per viewer, so a match can have thousands.
+typedef struct {
+    Link link;                               // TCP connection (closed if the slot is free)
+    s16_t feed;                              // Feed this spectator is subscribed to
+    u8_t proto;                              // Binary protocol version agreed in the handshake (0 = text)
+    u8_t closing;                            // 1 once the spectator is being disconnected
+    uint32_t sent_seq;                       // Newest snapshot written to the connection (0 = none)
+    u32_t close_deadline;                    // sys_now() after which a pending close aborts the connection
+    int active_pos;                          // Position in spectating[]
+    InFlight inflight[SPECTATOR_INFLIGHT];   // Frames written without copy and not acknowledged yet (FIFO)
+    u8_t inflight_head, inflight_count;
+} Spectator;
+
+// === Spectator feed ===
+// Snapshots of a watched match, kept long enough to be broadcast with a delay.
+// A feed outlives its match until the delayed stream has shown the end of it.
+typedef struct {
+    int match;                               // Match being captured (-1 once it ended)
+    int viewers;                             // Spectators subscribed, the feed is free when 0
+    uint32_t seq;                            // Newest snapshot captured
+    uint32_t end_seq;                        // Final snapshot once the match ended (0 while it runs)
+    uint32_t end_frame;                      // snapshot_frames when the match ended
+    int winner;                              // Winner announced at the end of the delayed stream
+    int in_use;                              // 1 while the feed is handed out
+    PongSnapshot snap[FEED_HISTORY];
+    uint32_t snap_seq[FEED_HISTORY];         // Sequence number of each slot, to detect stale entries
+} SpectatorFeed;
+
+// === Server tables ===
+// Connection and match slots are preallocated and recycled through free lists,
+// so accepting or finishing a match never allocates memory.
+static Client clients[MAX_CLIENTS];
+static int free_clients[MAX_CLIENTS];
+static int free_client_count;
+
+static Match matches[MAX_MATCHES];
+static int free_matches[MAX_MATCHES];
+static int free_match_count;
+
+static int active_matches[MAX_MATCHES];   // Dense list of non-free matches
+static int active_match_count;
+
+static int lobby[MAX_CLIENTS];            // Accepted clients that haven't sent HELLO yet
+static int lobby_count;
 
-// Parses a text command received from the client into a movement action.
-// Returns UP, DOWN, or NONE depending on the command string.
-static Input parse_input_line(const char *line) {
-    if (strncmp(line, "INPUT:UP", 8) == 0) return UP;
-    // If the line starts with "INPUT:UP", we interpret it as the UP command.
+static struct netconn *listener;          // Listening connection of the server (netconn mode)
+static struct tcp_pcb *listen_pcb;        // Listening pcb of the server (raw mode)
+static int raw_mode;                      // 1 if the server runs on the raw API in the tcpip thread
 
-    if (strncmp(line, "INPUT:DOWN", 10) == 0) return DOWN;
-    // If the line starts with "INPUT:DOWN", it's interpreted as the DOWN command.
+static TickScheduler sched;               // Frame clock, also keeps the late/skipped frame counters
 
-    return NONE;
-    // If it doesn't match either, the input is ignored and treated as no movement.
+// The simulation runs at physics_hz; connections are served and snapshots are
+// taken on the ticks where their own, lower or equal, rates fall due.
+static u32_t physics_hz = PHYSICS_HZ;
+static u32_t input_hz = INPUT_HZ;
+static u32_t snapshot_hz = SNAPSHOT_HZ;
+static uint64_t sim_ticks;                // Simulation ticks run so far
+
+static LoadLevel load_level;              // Current degradation, see LoadLevel
+static u32_t load_avg;                    // Smoothed share of the tick budget used, in 1/16 %
+static u32_t load_changed_at;             // sys_now() of the last level change
+static u32_t snapshot_frames;             // Snapshot frames taken so far
+
+// === Worker pool ===
+// The matches of a frame are stepped on every core; everything that talks to
+// the network stays on the thread running the frame, once they are all done.
+static PongPool pool;
+static volatile int pool_workers;         // Workers asked for with pong_set_workers() (0 = one per CPU)
+
+// === Profiler ===
+// With pong_set_trace(), the phases of every frame are timed into pong_trace
+// (pong_trace.h). Off, each phase costs one untaken branch.
+static uint32_t trace_events;             // Events per ring asked for (0 = no tracing)
+static int trace_on;                      // 1 once the rings exist
+
+typedef struct {
+    _Alignas(PONG_CACHE_LINE)
+    uint64_t first, last;                 // When its first match of the step started and its last one ended
+    uint64_t busy;                        // Cycles spent in its matches
+    uint32_t matches;
+} WorkerSpan;
+static WorkerSpan worker_spans[PONG_POOL_MAX_WORKERS];  // The current step, per worker of the pool
+static uint64_t fanout_posted;            // When the last fan-out was handed to the tcpip thread
+static uint64_t spectators_posted;        // ... and the last spectator chunk
+
+static uint64_t trace_now(void) {
+    return trace_on ? pong_trace_cycles() : 0;
+}
+
+// Traces a phase of the game loop that started at start and ends now.
+static void trace_loop(PongTracePhase phase, uint64_t start, uint32_t count, uint64_t busy) {
+    pong_trace_put(&pong_trace.rings[PONG_TRACE_RING_LOOP], phase, PONG_TRACE_TID_LOOP, start, trace_now(),
+                   count, busy);
 }
 
-// Resets the ball to the center of the field and assigns an initial velocity.
-// The direction of the horizontal movement depends on which player is serving.
-static void reset_ball(Ball *ball, int serving_player) {
-    ball->x = FIELD_WIDTH / 2;
-    ball->y = FIELD_HEIGHT / 2;
-    // Places the ball at the center of the field, using the defined dimensions.
+// Same for the tcpip thread, where busy is the time the message waited in its mailbox.
+static void trace_tcpip(PongTracePhase phase, uint64_t start, uint32_t count, uint64_t posted) {
+    pong_trace_put(&pong_trace.rings[PONG_TRACE_RING_TCPIP], phase, PONG_TRACE_TID_TCPIP, start, trace_now(),
+                   count, start - posted);
+}
+
+static PongJournal journal;               // Input journal of every match (pong_set_journal())
+static const char *journal_path;          // NULL = no journal
+static size_t journal_max_size = (size_t)JOURNAL_MAX_MB << 20;   // Address space mapped for it
+static int journal_on;                    // 1 once the journal is open
+static u32_t journal_recovered;           // Matches restored from it at startup (0 once the unclaimed are called off)
+static u32_t resume_deadline;             // sys_now() after which unclaimed restored matches are called off
+
+static int closing[MAX_CLIENTS];          // Clients whose close waits for their frames to be acknowledged
+static int closing_count;
+
+static Spectator spectators[MAX_SPECTATORS];
+static int free_spectators[MAX_SPECTATORS];
+static int free_spectator_count;
+static int spectating[MAX_SPECTATORS];    // Dense list of connected spectators
+static int spectating_count;
+
+static SpectatorFeed feeds[MAX_FEEDS];
+static int free_feeds[MAX_FEEDS];
+static int free_feed_count;
+
+static volatile u32_t spectator_delay_ms = SPECTATOR_DELAY_MS;   // Broadcast delay
+static u32_t spectator_skipped;           // Frames the spectators missed because the last batch was still being sent
+
+// === Frame fan-out ===
+// Each frame is serialized once into a pbuf and queued here for every recipient.
+// Once per frame the whole queue is handed to the tcpip thread in a single message,
+// where the same payload is written, without copying, to each recipient's TCP connection.
+typedef struct {
+    struct pbuf *p;    // Frame to send, one reference held per entry
+    int client;        // Recipient slot
+    int udp;           // 1 to send it as a datagram on the client's UDP channel
+    uint64_t arrived;  // Followed input the frame shows: when it reached the tcpip thread (0 = none)
+    uint64_t queued;   // ... and when the frame was queued
+} SendTarget;
+
+static SendTarget send_queue[MAX_CLIENTS * 3];   // A datagram, a snapshot and a GAMEOVER per client at most
+static int send_count;
+static sys_sem_t fanout_done;                    // Signalled by the tcpip thread when the fan-out is over
+
+// Spectators get a queue of their own, written after the players' one and in chunks,
+// so the tcpip thread serves player frames and incoming segments in between.
+// The game loop never waits for it: while a batch is still being written
+// (spectator_busy) the loop leaves every spectator alone and they skip frames.
+typedef struct {
+    struct pbuf *p;    // Frame to send, one reference held per entry (NULL: only finish a pending close)
+    int spectator;     // Recipient slot
+    uint32_t seq;      // Snapshot carried by the frame (0 for GAMEOVER)
+} SpectatorTarget;
+
+static SpectatorTarget spectator_queue[MAX_SPECTATORS * 2];   // The delayed snapshot and a GAMEOVER at most
+static int spectator_count;
+static int spectator_pos;                                     // Next entry the tcpip thread writes
+static volatile int spectator_busy;                           // 1 from posting a batch until it is written
 
-    ball->speed = INITIAL_BALL_SPEED;
-    // Sets the ball speed to its default value.
+// === Reactor state ===
+// Filled by pong_netconn_event() in the tcpip thread and consumed by the game loop,
+// so the loop only ever touches connections that have something queued.
+// Both are protected with SYS_ARCH_PROTECT. Slots below MAX_CLIENTS are clients,
+// the ones above are spectators (MAX_CLIENTS + spectator index).
+static volatile int rcv_pending[MAX_CONNS];    // Receive events queued on each slot's connection
+static uint64_t rcv_at[MAX_CONNS];             // pong_clock_ns() at the oldest of them (0 = none)
+static volatile u8_t ready_queued[MAX_CONNS];  // 1 while the slot sits in the ready ring
+static int ready_ring[MAX_CONNS];              // Slots with receive events pending
+static int ready_head, ready_count;
+static volatile int accept_pending;       // Connections waiting in the listener's accept queue
 
-    float angle;
-    do {
-        // Randomly generate an angle within +-30 degrees (pi/6) from the horizontal.
-        angle = ((rand() % 1000) / 1000.0f) * (M_PI / 3) - (M_PI / 6);
-    } while (fabsf(sinf(angle)) < 0.3f);
-    // If the vertical component is too small (almost horizontal),
-    // regenerate the angle to avoid boring, flat serves.
+// === Frame timing report ===
+// Periodically printed when enabled with pong_set_report_interval(), so the netconn
+// and raw modes can be compared side by side under the same load.
+static volatile u32_t report_interval_ms;  // 0 = no report
+static u32_t report_started;               // sys_now() at the start of the current report window
+static u32_t report_frames;                // Frames run in the window
+static uint64_t report_work_ns;            // Time spent working in those frames
+static uint64_t report_max_ns;             // Longest frame of the window
+static u32_t handoffs;                     // Messages the pong thread exchanged with the tcpip thread
+static u32_t frame_inputs;                 // Input lines and datagrams taken since the last frame
+static uint64_t lines_arrived;             // When the lines being fed reached the tcpip thread (0 = unknown)
+static PongMatchStats match_stats[MAX_MATCHES];   // What the SNMP agent sees of each match (pong_mib.c)
 
-    float dir = (serving_player == 1) ? 1.0f : -1.0f;
-    // If player 1 is serving, the ball goes right (positive x);
-    // otherwise, it goes left (negative x).
+// === UDP channel ===
+static struct udp_pcb *udp_channel;        // Datagram socket on PORT, used from the tcpip thread only
+static u32_t udp_inputs_recovered;         // Inputs of lost datagrams found in the redundant copies
 
-    ball->dx = dir * ball->speed * cosf(angle);
-    ball->dy = ball->speed * sinf(angle);
-    // Sets the horizontal and vertical components of velocity using trigonometry.
+// === Input latency ===
+// One input per player at a time is followed from the tcpip thread to the
+// stack, through the stages of pong_metrics.h: taken by the game loop, stepped
+// into its match, shown by a queued snapshot, written. Another one is followed
+// once it is written; timing every input would cost more than it tells.
 
-    ball->serve_timer = SERVE_TIME;
-    // Introduces a delay before the ball starts moving, allowing players to prepare.
+// Starts following an input the game loop just took, unless one is on its way.
+static void input_follow(Client *c, uint64_t arrived) {
+    if (c->lat_arrived || !arrived || c->match < 0 || matches[c->match].state != MATCH_PLAYING) return;
+    c->lat_arrived = arrived;
+    c->lat_taken = raw_mode ? arrived : pong_clock_ns();
+    c->lat_stepped = 0;
+    pong_hist_add(&pong_metrics.input_queue_ns, c->lat_taken - arrived);
+    // In raw mode the loop takes it right in the recv callback.
 }
 
-// Main server loop executed in a separate thread.
-// Handles client connections, game state updates, and state broadcasting.
-static void pong_thread(void *arg) {
-    srand(time(NULL)); 
-    // Seed the random number generator to ensure varying serve angles.
+// Hands a client's followed input, once a step has taken it, over to the frame
+// just queued for the client.
+static void input_queued(Client *c, SendTarget *t) {
+    if (!c->lat_stepped) return;
+    t->arrived = c->lat_arrived;
+    t->queued = pong_clock_ns();
+    pong_hist_add(&pong_metrics.input_tick_ns, c->lat_stepped - c->lat_taken);
+    pong_hist_add(&pong_metrics.input_snapshot_ns, t->queued - c->lat_stepped);
+    // The step ran on a worker: its stage is accounted here, by the game loop.
+    c->lat_arrived = c->lat_stepped = 0;
+}
 
-    struct netconn *listener = netconn_new(NETCONN_TCP);
-    if (!listener) return;
-    // Create a new TCP connection object for listening. If allocation fails, exit.
+// Accounts the last stages of a followed input, once the tcpip thread wrote its frame.
+static void input_written(const SendTarget *t) {
+    uint64_t now = pong_clock_ns();
+    pong_hist_add(&pong_metrics.input_send_ns, now - t->queued);
+    pong_hist_add(&pong_metrics.input_total_ns, now - t->arrived);
+}
 
-    // Bind the listener to any local IP and the predefined port.
-    // Then set it to listen mode to accept incoming connections.
-    if (netconn_bind(listener, NULL, PORT) != ERR_OK || netconn_listen(listener) != ERR_OK) {
-        netconn_delete(listener);
+// Handles one complete line received from a client.
+// The first line must be the HELLO handshake, or WATCH:<match> for a spectator;
+// after that only INPUT lines matter, and each one simply overwrites the previous,
+// so the newest input always wins.
+static void client_line(Client *c, const char *line) {
+    if (c->id == 0) {
+        if (strncmp(line, "HELLO:1", 7) == 0) c->id = 1;
+        else if (strncmp(line, "HELLO:2", 7) == 0) c->id = 2;
+        else if (strncmp(line, "WATCH:", 6) == 0) {
+            c->id = WATCHER_ID;
+            c->watch = atoi(line + 6);
+        }
+        else c->id = -1;
+        // Anything else than a valid HELLO or WATCH marks the client for rejection.
+
+        const char *bin = strstr(line, " BIN:");
+        int version = bin ? atoi(bin + 5) : 0;
+        if (c->id > 0 && version >= PONG_PROTO_FULL && version <= PONG_PROTO_VERSION)
+            c->proto = version;
+        // Clients that ask for a protocol version we speak get binary snapshots.
+
+        c->udp = strstr(line, " UDP") != NULL;
+        // Only granted with delta snapshots, which carry the sequence numbers it relies on.
+
+        const char *resume = strstr(line, " RESUME:");
+        c->resume = resume ? (uint32_t)strtoul(resume + 8, NULL, 10) : 0;
+        // The token a WELCOME gave this player before the server restarted.
+
+        const char *rate = strstr(line, " RATE:");
+        int hz = rate ? atoi(rate + 6) : 0;
+        c->send_div = hz > 0 && (u32_t)hz < snapshot_hz ? (int)((snapshot_hz + hz - 1) / hz) : 1;
+        // RATE:<hz> asks for fewer snapshots than the server takes: every n-th one.
         return;
     }
 
-    Client clients[2] = {0}; 
-    // Array of two client structures to track both player connections.
+    if (strncmp(line, "ACK:", 4) == 0) {
+        c->acked_seq = (uint32_t)strtoul(line + 4, NULL, 10);
+        // Deltas for this client are now encoded against that snapshot.
+        // ACK:0 asks for a frame that doesn't depend on any baseline.
+        return;
+    }
 
-    int ready = 0;
-    // Counter to keep track of how many clients have successfully connected.
+    if (strncmp(line, "INPUT:", 6) == 0) {
+        const char *at = strchr(line, '@');
+        c->input = (Input)pong_parse_input(line);
+        frame_inputs++;
+        if (c->match >= 0) atomic_fetch_add_explicit(&match_stats[c->match].inputs, 1, memory_order_relaxed);
+        c->input_stamp = at ? (uint32_t)strtoul(at + 1, NULL, 10) : 0;
+        // INPUT:<dir>@<seq> tells which snapshot the player was looking at (see match_input_tick).
+        input_follow(c, lines_arrived);
+    }
+}
 
-    // === Wait for both players to connect ===
-    while (ready < 2) {
-        struct netconn *conn;
-        if (netconn_accept(listener, &conn) == ERR_OK) {
-            // Accept a new incoming TCP connection from a client.
-
-            struct netbuf *nbuf;
-            char buf[32] = {0}; 
-            // Temporary buffer to store the handshake message.
-
-            // Try to receive a message from the client to identify it.
-            if (netconn_recv(conn, &nbuf) == ERR_OK && nbuf) {
-                void *data; u16_t len;
-                netbuf_data(nbuf, &data, &len);
-                len = len > 31 ? 31 : len;
-                memcpy(buf, data, len); 
-                buf[len] = '\0'; 
-                netbuf_delete(nbuf);
-            }
+// Feeds received bytes into the client's line reassembler.
+// Called once per pbuf of a received chain, so lines split across segments
+// are joined back together in c->buffer before they are parsed.
+static void client_feed(Client *c, const char *bytes, u16_t len) {
+    for (u16_t i = 0; i < len; i++) {
+        if (bytes[i] == '\n') {
+            c->buffer[c->buffer_len] = '\0';
+            client_line(c, c->buffer);
+            c->buffer_len = 0;
+            // A complete line was handled, start collecting the next one.
+        } else if (c->buffer_len < MAX_INPUT_LEN - 1) {
+            c->buffer[c->buffer_len++] = bytes[i];
+        }
+        // Oversized lines are truncated; no valid command is that long.
+    }
+}
 
-            // Match incoming message to identify the client as player 1 or 2.
-            if (strncmp(buf, "HELLO:1", 7) == 0 && !clients[0].conn) {
-                clients[0] = (Client){ .conn = conn, .id = 1 };
-                netconn_write(conn, "WELCOME 1\n", 10, NETCONN_COPY);
-                ready++;
-            } else if (strncmp(buf, "HELLO:2", 7) == 0 && !clients[1].conn) {
-                clients[1] = (Client){ .conn = conn, .id = 2 };
-                netconn_write(conn, "WELCOME 2\n", 10, NETCONN_COPY);
-                ready++;
-            } else {
-                // If message is invalid or the slot is already taken, reject connection.
-                netconn_close(conn);
-                netconn_delete(conn);
-            }
+// Queues a reactor slot for the game loop, unless it is already in the ready ring.
+// Must be called with SYS_ARCH_PROTECT held. A slot is queued at most once, so
+// the ring can never hold more than MAX_CONNS entries.
+static void ready_push(int index) {
+    if (ready_queued[index]) return;
+    ready_queued[index] = 1;
+    ready_ring[(ready_head + ready_count++) % MAX_CONNS] = index;
+}
+
+// Takes the next ready slot out of the ring. Returns -1 if none is ready.
+static int ready_pop(void) {
+    SYS_ARCH_DECL_PROTECT(lev);
+    int index = -1;
+
+    SYS_ARCH_PROTECT(lev);
+    if (ready_count > 0) {
+        index = ready_ring[ready_head];
+        ready_head = (ready_head + 1) % MAX_CONNS;
+        ready_count--;
+        ready_queued[index] = 0;
+        // Events arriving from now on queue the slot again.
+    }
+    SYS_ARCH_UNPROTECT(lev);
+    return index;
+}
+
+// Netconn event callback, called from the tcpip thread for the listener and
+// every connection it accepts. This is the reactor's only source of readiness:
+// - on the listener it counts connections waiting to be accepted;
+// - on clients and spectators it counts queued receive events and marks the slot ready.
+// As in the sockets layer, conn->socket holds the reactor slot index; events that
+// arrive before the connection is bound to a slot are counted there as negative numbers.
+static void pong_netconn_event(struct netconn *conn, enum netconn_evt evt, u16_t len) {
+    SYS_ARCH_DECL_PROTECT(lev);
+    LWIP_UNUSED_ARG(len);
+
+    if (evt != NETCONN_EVT_RCVPLUS && evt != NETCONN_EVT_RCVMINUS) return;
+    int delta = (evt == NETCONN_EVT_RCVPLUS) ? 1 : -1;
+
+    SYS_ARCH_PROTECT(lev);
+    if (conn == listener) {
+        accept_pending += delta;
+    } else if (conn->socket >= 0) {
+        rcv_pending[conn->socket] += delta;
+        if (delta > 0) {
+            if (!rcv_at[conn->socket]) rcv_at[conn->socket] = pong_clock_ns();
+            ready_push(conn->socket);
         }
-        sys_msleep(100); 
-        // Avoid CPU overuse while polling for clients.
+    } else if (delta > 0) {
+        conn->socket--;
     }
+    SYS_ARCH_UNPROTECT(lev);
+}
 
-        // === Initialize game state ===
-    Player p1 = {FIELD_HEIGHT / 2 - PADDLE_HEIGHT / 2, NONE};
-    Player p2 = {FIELD_HEIGHT / 2 - PADDLE_HEIGHT / 2, NONE};
-    // Both paddles start centered vertically, with no input.
+// Binds a connection's receive events to a reactor slot. The events counted so far,
+// before the connection had a slot or on the slot it leaves, move along with it.
+static void conn_bind(struct netconn *conn, int index) {
+    SYS_ARCH_DECL_PROTECT(lev);
 
-    Ball ball;
-    int score1 = 0, score2 = 0;
-    // Initialize ball structure and player scores to 0.
+    SYS_ARCH_PROTECT(lev);
+    int pending;
+    if (conn->socket >= 0) {
+        pending = rcv_pending[conn->socket];
+        rcv_pending[conn->socket] = 0;
+    } else {
+        pending = -1 - conn->socket;
+    }
+    rcv_pending[index] = pending;
+    rcv_at[index] = 0;
+    conn->socket = index;
+    if (pending > 0) ready_push(index);
+    SYS_ARCH_UNPROTECT(lev);
+}
 
-    reset_ball(&ball, 1);
-    // Start the game with player 1 serving.
+// Detaches a connection from its reactor slot before the slot is reused.
+static void conn_unbind(struct netconn *conn) {
+    SYS_ARCH_DECL_PROTECT(lev);
 
-    // === Main game loop ===
-    while (1) {
-        // === Handle player input ===
-        for (int i = 0; i < 2; i++) {
-            struct netbuf *nbuf;
+    SYS_ARCH_PROTECT(lev);
+    conn->socket = -1;
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+// Returns 1 while the link has a connection.
+static int link_open(const Link *l) {
+    return l->conn || l->pcb;
+}
 
-            // Receive data from each client (non-blocking if no data).
-            if (clients[i].conn && netconn_recv(clients[i].conn, &nbuf) == ERR_OK && nbuf) {
-                void *data;
-                u16_t len;
-                netbuf_data(nbuf, &data, &len);
+// Returns the TCP pcb behind a link, or NULL once the connection is gone.
+static struct tcp_pcb *link_pcb(const Link *l) {
+    return l->conn ? l->conn->pcb.tcp : l->pcb;
+}
 
-                if (len >= 5) {
-                    Input in = parse_input_line(data);
-                    // Convert the received string into an input enum (UP/DOWN/NONE).
+// Routes a link's receive events to a reactor slot. A raw pcb carries slot + 1
+// as its callback argument (NULL once detached), like conn->socket for netconns.
+static void link_bind(const Link *l, int index) {
+    if (l->conn) {
+        conn_bind(l->conn, index);
+    } else {
+        rcv_pending[index] = 0;
+        tcp_arg(l->pcb, (void *)(intptr_t)(index + 1));
+    }
+}
 
-                    // Update the corresponding player’s input.
-                    if (clients[i].id == 1) p1.input = in;
-                    else p2.input = in;
-                }
-                netbuf_delete(nbuf);
+// Sends a short control line (WELCOME), copied into the stack.
+static void link_write(const Link *l, const char *data, int len) {
+    if (l->conn) {
+        netconn_write(l->conn, data, len, NETCONN_COPY);
+        handoffs++;
+    } else if (l->pcb && tcp_write(l->pcb, data, (u16_t)len, TCP_WRITE_FLAG_COPY) == ERR_OK) {
+        tcp_output(l->pcb);
+    }
+}
+
+// Closes a link. A raw pcb is detached from its slot and callbacks first, so
+// nothing of it reaches whoever gets the slot next.
+static void link_close(Link *l) {
+    if (l->conn) {
+        conn_unbind(l->conn);
+        netconn_close(l->conn);
+        netconn_delete(l->conn);
+        handoffs += 2;
+    } else if (l->pcb) {
+        tcp_arg(l->pcb, NULL);
+        tcp_recv(l->pcb, NULL);
+        tcp_sent(l->pcb, NULL);
+        tcp_err(l->pcb, NULL);
+        if (tcp_close(l->pcb) != ERR_OK) tcp_abort(l->pcb);
+        // Out of memory for the FIN: drop the connection instead of leaking it.
+    }
+    l->conn = NULL;
+    l->pcb = NULL;
+}
+
+// Takes a connection slot from the free list and binds the connection's
+// receive events to it. Returns NULL if the server is full.
+static Client *client_alloc(Link link) {
+    if (free_client_count == 0) return NULL;
+    int index = free_clients[--free_client_count];
+    Client *c = &clients[index];
+
+    *c = (Client){ .link = link, .match = -1, .input = NONE, .send_div = 1, .lobby_pos = -1, .closing_pos = -1,
+                   .accepted_at = sys_now() };
+    link_bind(&c->link, index);
+    // A stale entry of the previous owner may still be in the ready ring; its
+    // ready_queued flag stays set, so the slot is never queued twice.
+    return c;
+}
+
+// Gives a new connection a client slot and puts it in the lobby, where it
+// waits for its HELLO line. Returns 0 if the server is full.
+static int client_accept(Link link) {
+    Client *c = client_alloc(link);
+    if (!c) {
+        atomic_fetch_add_explicit(&pong_metrics.conns_rejected, 1, memory_order_relaxed);
+        return 0;
+    }
+    atomic_fetch_add_explicit(&pong_metrics.conns_accepted, 1, memory_order_relaxed);
+
+    c->lobby_pos = lobby_count;
+    lobby[lobby_count++] = (int)(c - clients);
+    return 1;
+}
+
+// Removes a client from the lobby of connections waiting for their HELLO.
+static void lobby_remove(Client *c) {
+    if (c->lobby_pos < 0) return;
+    int last = lobby[--lobby_count];
+    lobby[c->lobby_pos] = last;
+    clients[last].lobby_pos = c->lobby_pos;
+    c->lobby_pos = -1;
+}
+
+// Removes a client from the list of pending closes.
+static void closing_remove(Client *c) {
+    if (c->closing_pos < 0) return;
+    int last = closing[--closing_count];
+    closing[c->closing_pos] = last;
+    clients[last].closing_pos = c->closing_pos;
+    c->closing_pos = -1;
+}
+
+// Starts closing a client once the stack no longer needs our frames.
+// The client leaves its match right away; the connection is closed gracefully as soon
+// as every shared frame written to it has been acknowledged, or aborted after linger_ms.
+static void client_close(Client *c, u32_t linger_ms) {
+    c->match = -1;
+    c->close_deadline = sys_now() + linger_ms;
+    if (c->closing_pos < 0) {
+        c->closing_pos = closing_count;
+        closing[closing_count++] = (int)(c - clients);
+    }
+}
+
+// Closes the client's connection and returns its slot to the free list.
+// Frames written without copy may still sit in the connection's send queue;
+// in that case the connection is aborted by the next fan-out and released after it.
+static void client_release(Client *c) {
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    lobby_remove(c);
+    if (c->inflight_count > 0) {
+        client_close(c, 0);
+        return;
+    }
+    closing_remove(c);
+
+    link_close(&c->link);
+    rcv_pending[c - clients] = 0;
+    // Forget a lost mark of a raw connection (see raw_lost), the slot is free now.
+
+    SYS_ARCH_PROTECT(lev);
+    c->udp_token = 0;
+    SYS_ARCH_UNPROTECT(lev);
+    // Datagrams still on their way for this slot are ignored from now on.
+    c->match = -1;
+    free_clients[free_client_count++] = (int)(c - clients);
+    atomic_fetch_add_explicit(&pong_metrics.conns_closed, 1, memory_order_relaxed);
+}
+
+// Allocates the pbuf a frame is serialized into. The payload is written in place
+// and the pbuf trimmed to size afterwards, so each frame costs one allocation and
+// no copy besides the encoding itself.
+static struct pbuf *frame_alloc(u16_t cap) {
+    return pbuf_alloc(PBUF_RAW, cap, PBUF_RAM);
+}
+
+// Queues a serialized frame for a client. Takes a reference of its own,
+// so the caller still frees the pbuf once it has queued it for everybody.
+static void send_frame(Client *c, struct pbuf *p) {
+    if (!p || send_count == (int)(sizeof(send_queue) / sizeof(send_queue[0]))) return;
+    pbuf_ref(p);
+    send_queue[send_count] = (SendTarget){ .p = p, .client = (int)(c - clients) };
+    input_queued(c, &send_queue[send_count++]);
+}
+
+// Same for a datagram on the client's UDP channel.
+static void send_datagram(Client *c, struct pbuf *p) {
+    if (!p || send_count == (int)(sizeof(send_queue) / sizeof(send_queue[0]))) return;
+    pbuf_ref(p);
+    send_queue[send_count] = (SendTarget){ .p = p, .client = (int)(c - clients), .udp = 1 };
+    input_queued(c, &send_queue[send_count++]);
+}
+
+// Serializes a snapshot as a full binary frame. Returns NULL if out of memory.
+static struct pbuf *frame_snapshot(const PongSnapshot *snap) {
+    struct pbuf *p = frame_alloc(PONG_FRAME_MAX);
+    if (p) pbuf_realloc(p, (u16_t)pong_encode_snapshot(snap, p->payload, p->len));
+    return p;
+}
+
+// Serializes a snapshot as a delta frame against base (NULL for one without baseline).
+static struct pbuf *frame_delta(const PongSnapshot *snap, uint32_t seq,
+                                const PongSnapshot *base, uint32_t base_seq) {
+    struct pbuf *p = frame_alloc(PONG_FRAME_MAX);
+    if (p) pbuf_realloc(p, (u16_t)pong_encode_delta(snap, seq, base, base_seq, p->payload, p->len));
+    return p;
+}
+
+// Serializes a snapshot as a text STATE line.
+static struct pbuf *frame_text(const PongSnapshot *snap) {
+    struct pbuf *p = frame_alloc(128);
+    if (p) pbuf_realloc(p, (u16_t)pong_format_state(snap, p->payload, p->len));
+    return p;
+}
+
+// Serializes a snapshot as a datagram for the UDP channel.
+static struct pbuf *frame_datagram(const PongSnapshot *snap, uint32_t seq) {
+    struct pbuf *p = frame_alloc(PONG_DGRAM_MAX);
+    if (p) pbuf_realloc(p, (u16_t)pong_encode_snapshot_dgram(snap, seq, p->payload, p->len));
+    return p;
+}
+
+// Serializes the end-of-match message, binary or as a text line.
+static struct pbuf *frame_gameover(int binary, int winner) {
+    struct pbuf *p = frame_alloc(PONG_FRAME_MAX);
+    if (!p) return NULL;
+
+    size_t len = binary
+        ? pong_encode_gameover(winner, p->payload, p->len)
+        : (size_t)snprintf(p->payload, p->len, "GAMEOVER:%d\n", winner);
+    pbuf_realloc(p, (u16_t)len);
+    return p;
+}
+
+// Queues the end-of-match message in the client's protocol.
+static void send_gameover(Client *c, int winner) {
+    struct pbuf *p = frame_gameover(c->proto, winner);
+    if (!p) return;
+
+    send_frame(c, p);
+    pbuf_free(p);
+}
+
+// Drops the frames at the head of an in-flight FIFO of `size` entries that the
+// stack no longer references: the ones the peer acknowledged, or all of them once
+// the pcb is gone (its segments are freed together with it).
+// Runs in the tcpip thread.
+static void inflight_reap(InFlight *fifo, u8_t size, u8_t *head, u8_t *count, struct tcp_pcb *pcb) {
+    while (*count > 0) {
+        InFlight *f = &fifo[*head];
+        if (pcb && !TCP_SEQ_GEQ(pcb->lastack, f->end_seq)) break;
+
+        pbuf_free(f->p);
+        *head = (*head + 1) % size;
+        (*count)--;
+    }
+}
+
+// Writes a shared frame to a connection with tcp_write() without copying, and
+// moves our reference into the in-flight FIFO, which holds the pbuf alive until
+// the peer acknowledges it. Returns 1 on success; otherwise the reference is
+// dropped and the recipient just misses this frame.
+// Runs in the tcpip thread.
+static int inflight_write(InFlight *fifo, u8_t size, u8_t *head, u8_t *count,
+                          struct tcp_pcb *pcb, struct pbuf *p) {
+    if (!pcb || *count == size || tcp_sndbuf(pcb) < p->len ||
+        tcp_write(pcb, p->payload, p->len, 0) != ERR_OK) {
+        pbuf_free(p);
+        return 0;
+    }
+
+    fifo[(*head + (*count)++) % size] = (InFlight){ .p = p, .end_seq = pcb->snd_lbb };
+    tcp_output(pcb);
+    return 1;
+}
+
+// Fan-out, executed in the tcpip thread: through one tcpip_callback per frame in
+// netconn mode, or straight from the frame timer in raw mode.
+// Writes every queued frame without copying: each recipient's segment only
+// references the shared payload.
+static void fanout_write(void) {
+    for (int i = 0; i < send_count; i++) {
+        Client *c = &clients[send_queue[i].client];
+        struct tcp_pcb *pcb = link_pcb(&c->link);
+
+        struct pbuf *p = send_queue[i].p;
+        u16_t len = p->len;
+
+        if (send_queue[i].udp) {
+            if (udp_channel && c->udp_token && c->udp_bound == c->udp_token &&
+                udp_sendto(udp_channel, p, &c->udp_addr, c->udp_port) == ERR_OK) {
+                atomic_fetch_add_explicit(&pong_metrics.bytes_sent, len, memory_order_relaxed);
+                atomic_fetch_add_explicit(&pong_metrics.frames_sent, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&pong_metrics.datagrams_sent, 1, memory_order_relaxed);
+                if (send_queue[i].arrived) input_written(&send_queue[i]);
             }
+            pbuf_free(p);
+            continue;
+            // Nowhere to send it before the client's first datagram told us its address.
+            // udp_sendto() chains its own header pbuf, so the payload stays shared.
+        }
+
+        inflight_reap(c->inflight, MAX_INFLIGHT, &c->inflight_head, &c->inflight_count, pcb);
+        if (inflight_write(c->inflight, MAX_INFLIGHT, &c->inflight_head, &c->inflight_count, pcb, p)) {
+            atomic_fetch_add_explicit(&pong_metrics.bytes_sent, len, memory_order_relaxed);
+            atomic_fetch_add_explicit(&pong_metrics.frames_sent, 1, memory_order_relaxed);
+            if (send_queue[i].arrived) input_written(&send_queue[i]);
+        }
+        // A client that can't keep up just misses this frame; deltas are
+        // always relative to what it acknowledged, so nothing gets corrupted.
+    }
+
+    // === Pending closes ===
+    // Clients past their linger deadline that still have frames in flight are
+    // aborted: the pcb is freed with its segments, so our references can go too.
+    u32_t now = sys_now();
+    for (int i = 0; i < closing_count; i++) {
+        Client *c = &clients[closing[i]];
+        struct tcp_pcb *pcb = link_pcb(&c->link);
+
+        inflight_reap(c->inflight, MAX_INFLIGHT, &c->inflight_head, &c->inflight_count, pcb);
+        if (pcb && c->inflight_count > 0 && (s32_t)(now - c->close_deadline) >= 0) {
+            tcp_abort(pcb);
+            inflight_reap(c->inflight, MAX_INFLIGHT, &c->inflight_head, &c->inflight_count, NULL);
         }
+    }
+}
+
+// tcpip_callback wrapper of the netconn mode fan-out.
+static void fanout_tcpip(void *arg) {
+    LWIP_UNUSED_ARG(arg);
+    uint64_t started = trace_now();
+    fanout_write();
+    trace_tcpip(PONG_TRACE_FANOUT_WRITE, started, (uint32_t)send_count, fanout_posted);
+    sys_sem_signal(&fanout_done);
+}
 
-        // === Update paddle positions based on input ===
-        if (p1.input == UP)   p1.y--;
-        if (p1.input == DOWN) p1.y++;
-        if (p2.input == UP)   p2.y--;
-        if (p2.input == DOWN) p2.y++;
-
-        // Ensure paddles stay within screen bounds.
-        clamp_paddle(&p1);
-        clamp_paddle(&p2);
-
-    // === Move ball if serve timer is 0 ===
-        if (ball.serve_timer > 0) {
-            ball.serve_timer--;
-            // If a point was just scored, we wait SERVE_TIME frames before moving the ball.
-            // This gives players time to react after a reset.
+// Hands this frame's send queue to the tcpip thread and waits until it is written,
+// then finishes the closes whose frames are all acknowledged.
+// In raw mode we already are in the tcpip thread and just write it.
+static void fanout_run(void) {
+    if (raw_mode) {
+        fanout_write();
+    } else if (send_count > 0 || closing_count > 0) {
+        handoffs++;
+        fanout_posted = trace_now();
+        if (tcpip_callback_with_block(fanout_tcpip, NULL, 1) == ERR_OK) {
+            sys_sem_wait(&fanout_done);
         } else {
-            ball.x += ball.dx;
-            ball.y += ball.dy;
-            // Move the ball according to its current velocity.
+            for (int i = 0; i < send_count; i++) pbuf_free(send_queue[i].p);
+        }
+    }
+    send_count = 0;
+
+    for (int i = 0; i < closing_count; i++) {
+        Client *c = &clients[closing[i]];
+        if (c->inflight_count == 0) {
+            client_release(c);
+            i--;
+            // client_release() moved the last pending close into this position.
         }
+    }
+}
 
-        // === Bounce on top and bottom screen edges ===
-        if (ball.y < 0 || ball.y > FIELD_HEIGHT - 1)
-            ball.dy *= -1;
-        // If the ball goes above the top or below the bottom of the screen,
-        // invert its vertical direction to simulate a bounce.
-
-        // === Collision detection with paddle 1 (left side) ===
-        if (ball.dx < 0 && ball.x <= PADDLE_OFFSET_X + PADDLE_WIDTH) {
-            // Only check collision if the ball is moving left (dx < 0)
-            // and reaches the horizontal area where paddle 1 is located.
-
-            if (ball.y >= p1.y && ball.y <= p1.y + PADDLE_HEIGHT) {
-                // If the ball's vertical position is within paddle 1's height,
-                // it is considered a valid hit.
-                ball.dx *= -1;
-                // Invert the horizontal direction to simulate a bounce off paddle 1.
-            }
+// === Spectators ===
+
+// Frames of one feed for the spectator batch being built. Like the players' frames,
+// each representation is serialized at most once and shared by every spectator using it.
+typedef struct {
+    const PongSnapshot *snap;                // Delayed snapshot broadcast this frame (NULL if none yet)
+    uint32_t seq;                            // Its sequence number
+    int over;                                // 1 once the delayed stream has reached the end of the match
+    struct pbuf *delta[2];                   // Deltas, for the two first baselines seen
+    uint32_t delta_base[2];
+    struct pbuf *full, *text;                // Full binary frame and text line
+    struct pbuf *gameover_bin, *gameover_text;
+} FeedFrames;
+
+static FeedFrames feed_frames[MAX_FEEDS];
+
+// Stores a match snapshot in its spectator feed.
+static void feed_put(SpectatorFeed *f, uint32_t seq, const PongSnapshot *snap) {
+    f->snap[seq % FEED_HISTORY] = *snap;
+    f->snap_seq[seq % FEED_HISTORY] = seq;
+    f->seq = seq;
+}
+
+// Looks a snapshot up in a feed. Returns NULL for seq 0 or if it was overwritten.
+static const PongSnapshot *feed_get(const SpectatorFeed *f, uint32_t seq) {
+    if (seq == 0 || f->snap_seq[seq % FEED_HISTORY] != seq) return NULL;
+    return &f->snap[seq % FEED_HISTORY];
+}
+
+// Returns the feed of a match, opening one for its first spectator.
+// Returns -1 if the match doesn't exist or every feed is taken.
+static int feed_attach(int match) {
+    if (match < 0 || match >= MAX_MATCHES || matches[match].state == MATCH_FREE) return -1;
+
+    Match *m = &matches[match];
+    if (m->feed >= 0) return m->feed;
+    if (free_feed_count == 0) return -1;
+
+    int index = free_feeds[--free_feed_count];
+    SpectatorFeed *f = &feeds[index];
+    f->in_use = 1;
+    f->match = match;
+    f->viewers = 0;
+    f->seq = f->end_seq = 0;
+    f->winner = 0;
+    memset(f->snap_seq, 0, sizeof(f->snap_seq));
+    // Snapshots are only captured from now on; the broadcast starts once the delay has filled up.
+
+    m->feed = index;
+    return index;
+}
+
+// Detaches a feed from its match when the match ends. The spectators keep
+// watching what was captured and get the GAMEOVER once the delayed stream gets there.
+static void feed_end(Match *m, int winner) {
+    if (m->feed < 0) return;
+
+    SpectatorFeed *f = &feeds[m->feed];
+    f->match = -1;
+    f->end_seq = m->seq;
+    f->end_frame = snapshot_frames;
+    f->winner = winner;
+    m->feed = -1;
+}
+
+// Returns a feed nobody watches anymore to the free list.
+static void feed_release(int index) {
+    SpectatorFeed *f = &feeds[index];
+    if (f->match >= 0) matches[f->match].feed = -1;
+    f->match = -1;
+    f->in_use = 0;
+    free_feeds[free_feed_count++] = index;
+}
+
+// Picks the snapshot a feed broadcasts this frame: the one captured `delay`
+// frames ago, or the final one once the delay after the end of the match has passed.
+static void feed_play(const SpectatorFeed *f, u32_t delay, FeedFrames *ff) {
+    uint32_t head = f->seq;
+    if (f->match < 0) {
+        head += snapshot_frames - f->end_frame;
+        // Once the match is over the delayed stream keeps moving at the snapshot rate.
+        ff->over = snapshot_frames - f->end_frame >= delay;
+    }
+
+    ff->seq = head > delay ? head - delay : 0;
+    if (ff->seq > f->seq || ff->over) ff->seq = f->seq;
+    ff->snap = feed_get(f, ff->seq);
+}
+
+// Queues a frame for a spectator, taking a reference of its own.
+static void spectator_send(Spectator *s, struct pbuf *p, uint32_t seq) {
+    if (!p) return;
+    pbuf_ref(p);
+    spectator_queue[spectator_count++] = (SpectatorTarget){ .p = p, .spectator = (int)(s - spectators),
+                                                            .seq = seq };
+}
+
+// Queues the delayed snapshot for a spectator in its protocol.
+// Deltas are based on the last snapshot written to the connection: TCP delivers
+// it, in order, so unlike players spectators never need to acknowledge anything,
+// and all the ones that got the previous frame share the same delta.
+static void spectator_frame(Spectator *s, FeedFrames *ff) {
+    if (!ff->snap || ff->seq <= s->sent_seq) return;
+    // Nothing new since the last frame written (or the delay was raised meanwhile).
+
+    if (s->proto == PONG_PROTO_DELTA) {
+        const PongSnapshot *base = feed_get(&feeds[s->feed], s->sent_seq);
+        uint32_t base_seq = base ? s->sent_seq : 0;
+
+        if (base && pong_snapshot_diff(ff->snap, base) == 0) return;
+
+        int k = (!ff->delta[0] || ff->delta_base[0] == base_seq) ? 0 : 1;
+        if (ff->delta[k] && ff->delta_base[k] != base_seq) {
+            // Both cached deltas use other baselines: this one is the spectator's own.
+            struct pbuf *p = frame_delta(ff->snap, ff->seq, base, base_seq);
+            spectator_send(s, p, ff->seq);
+            if (p) pbuf_free(p);
+            return;
         }
+        if (!ff->delta[k]) {
+            ff->delta[k] = frame_delta(ff->snap, ff->seq, base, base_seq);
+            ff->delta_base[k] = base_seq;
+        }
+        spectator_send(s, ff->delta[k], ff->seq);
+    } else if (s->proto == PONG_PROTO_FULL) {
+        if (!ff->full) ff->full = frame_snapshot(ff->snap);
+        spectator_send(s, ff->full, ff->seq);
+    } else {
+        if (!ff->text) ff->text = frame_text(ff->snap);
+        spectator_send(s, ff->text, ff->seq);
+    }
+}
+
+// Starts disconnecting a spectator. Safe while a spectator batch is being written:
+// only the flag and deadline change here, the slot is released by spectators_run().
+static void spectator_close(Spectator *s, u32_t linger_ms) {
+    if (s->closing) return;
+    s->closing = 1;
+    s->close_deadline = sys_now() + linger_ms;
+}
+
+// Closes a spectator's connection and returns its slot to the free list.
+// Only called between batches, once nothing of it is in flight anymore.
+static void spectator_release(Spectator *s) {
+    int index = (int)(s - spectators);
+
+    link_close(&s->link);
+    rcv_pending[MAX_CLIENTS + index] = 0;
+    feeds[s->feed].viewers--;
+
+    // Remove it from the dense list by swapping in the last entry.
+    int last = spectating[--spectating_count];
+    spectating[s->active_pos] = last;
+    spectators[last].active_pos = s->active_pos;
 
-        // === Collision detection with paddle 2 (right side) ===
-        if (ball.dx > 0 && ball.x >= FIELD_WIDTH - PADDLE_OFFSET_X - PADDLE_WIDTH) {
-            // Ball is moving to the right and reaches paddle 2's area.
+    free_spectators[free_spectator_count++] = index;
+}
+
+// Turns a lobby client that sent WATCH:<match> into a spectator of that match.
+// The connection moves over to a spectator slot, and the much larger client
+// slot goes straight back to the free list.
+static void spectator_join(Client *c) {
+    int f = feed_attach(c->watch);
+    if (f < 0 || free_spectator_count == 0) {
+        client_release(c);
+        return;
+        // Unknown match, or no room for another spectator: reject the connection.
+    }
+
+    int index = free_spectators[--free_spectator_count];
+    Spectator *s = &spectators[index];
+    *s = (Spectator){ .link = c->link, .feed = (s16_t)f, .proto = (u8_t)c->proto,
+                      .active_pos = spectating_count };
+    spectating[spectating_count++] = index;
+    feeds[f].viewers++;
+
+    link_bind(&s->link, MAX_CLIENTS + index);
+    c->link = (Link){ NULL, NULL };
+    client_release(c);
+
+    char welcome[48];
+    int len = s->proto
+        ? snprintf(welcome, sizeof(welcome), "WELCOME 0 BIN:%d MATCH:%d\n", s->proto, c->watch)
+        : snprintf(welcome, sizeof(welcome), "WELCOME 0 MATCH:%d\n", c->watch);
+    // Player 0 tells the client it only watches.
+    link_write(&s->link, welcome, len);
+}
+
+// Discards whatever a spectator sends. Returns 0 if the connection was lost.
+static int spectator_drain(Spectator *s) {
+    int index = MAX_CLIENTS + (int)(s - spectators);
+    if (!s->link.conn) return rcv_pending[index] >= 0;
+    // Raw mode: the recv callback already dropped the data, only a loss is left to report.
+
+    while (rcv_pending[index] > 0) {
+        struct netbuf *nbuf;
+
+        err_t err = netconn_recv(s->link.conn, &nbuf);
+        handoffs++;
+        if (err != ERR_OK) return ERR_IS_FATAL(err) || err == ERR_CLSD ? 0 : 1;
+        netbuf_delete(nbuf);
+    }
+    return 1;
+}
+
+// Returns 1 when the TCP segment pool runs low enough that spectator writes
+// would take segments the players' frames need.
+static int spectator_pool_low(void) {
+#if MEMP_STATS
+    const struct stats_mem *seg = &lwip_stats.memp[MEMP_TCP_SEG];
+    return seg->avail - seg->used < SPECTATOR_SEG_RESERVE;
+#else
+    return 0;
+#endif
+}
+
+// Writes the spectator batch, executed in the tcpip thread. Every SPECTATOR_CHUNK
+// writes it re-posts itself behind whatever else is queued, so the players'
+// next fan-out never waits for a large audience to be served.
+static void spectators_tcpip(void *arg) {
+    SYS_ARCH_DECL_PROTECT(lev);
+    LWIP_UNUSED_ARG(arg);
+    u32_t now = sys_now();
+    uint64_t started = trace_now(), posted = spectators_posted;
+    int first = spectator_pos;
 
-            if (ball.y >= p2.y && ball.y <= p2.y + PADDLE_HEIGHT) {
-                // If it’s within the paddle’s vertical range, bounce it back.
-                ball.dx *= -1;
+    while (spectator_pos < spectator_count) {
+        int end = spectator_pos + SPECTATOR_CHUNK;
+        if (end > spectator_count) end = spectator_count;
+
+        for (; spectator_pos < end; spectator_pos++) {
+            SpectatorTarget *t = &spectator_queue[spectator_pos];
+            Spectator *s = &spectators[t->spectator];
+            struct tcp_pcb *pcb = link_pcb(&s->link);
+
+            inflight_reap(s->inflight, SPECTATOR_INFLIGHT, &s->inflight_head, &s->inflight_count, pcb);
+
+            if (t->p) {
+                if (spectator_pool_low()) {
+                    pbuf_free(t->p);
+                    continue;
+                }
+                u16_t len = t->p->len;
+                if (!inflight_write(s->inflight, SPECTATOR_INFLIGHT, &s->inflight_head,
+                                    &s->inflight_count, pcb, t->p)) continue;
+                if (t->seq) s->sent_seq = t->seq;
+                atomic_fetch_add_explicit(&pong_metrics.bytes_sent, len, memory_order_relaxed);
+                atomic_fetch_add_explicit(&pong_metrics.frames_sent, 1, memory_order_relaxed);
+            } else if (pcb && s->inflight_count > 0 && (s32_t)(now - s->close_deadline) >= 0) {
+                tcp_abort(pcb);
+                inflight_reap(s->inflight, SPECTATOR_INFLIGHT, &s->inflight_head, &s->inflight_count, NULL);
+                // Past the linger deadline: drop the connection together with its frames.
             }
         }
 
-        // === Scoring ===
-        if (ball.x < 0) {
-            // If the ball exits the field on the left side, player 2 scores.
-            score2++;
-            reset_ball(&ball, 1); // Restart the ball with player 1 serving.
-        } else if (ball.x > FIELD_WIDTH) {
-            // If the ball exits the field on the right side, player 1 scores.
-            score1++;
-            reset_ball(&ball, 2); // Restart the ball with player 2 serving.
+        spectators_posted = trace_now();
+        if (spectator_pos < spectator_count &&
+            tcpip_callback_with_block(spectators_tcpip, NULL, 0) == ERR_OK) {
+            trace_tcpip(PONG_TRACE_SPECTATOR_WRITE, started, (uint32_t)(spectator_pos - first), posted);
+            return;
         }
+        // If the mailbox is full, just carry on with the next chunk right away.
+    }
+    trace_tcpip(PONG_TRACE_SPECTATOR_WRITE, started, (uint32_t)(spectator_pos - first), posted);
+
+    SYS_ARCH_PROTECT(lev);
+    spectator_busy = 0;
+    SYS_ARCH_UNPROTECT(lev);
+}
 
-        // === Format the current game state into a string ===
-        char state[128];
-        snprintf(state, sizeof(state), "STATE:%d,%d,%.2f,%.2f,%.2f,%.2f,%d,%d,%d\n",
-                 p1.y, p2.y,         // Paddle positions (vertical only)
-                 ball.x, ball.y,     // Ball position (float precision)
-                 ball.dx, ball.dy,   // Ball velocity (dx = horizontal, dy = vertical)
-                 score1, score2,     // Current scores of both players
-                 ball.serve_timer);  // Remaining delay before next ball movement
+// Builds this frame's spectator batch and hands it to the tcpip thread without
+// waiting for it. While the previous batch is still being written nothing here
+// runs: the game loop doesn't touch any spectator, and they simply skip a frame.
+static void spectators_run(void) {
+    SYS_ARCH_DECL_PROTECT(lev);
 
-        // === Send the state to both connected clients ===
-        for (int i = 0; i < 2; i++) {
-            if (clients[i].conn) {
-                // Send the formatted string using LWIP's netconn API.
-                netconn_write(clients[i].conn, state, strlen(state), NETCONN_COPY);
-                // NETCONN_COPY tells LWIP to copy the data into its own buffer,
-                // allowing us to reuse or free our buffer safely after.
+    if (spectator_busy) {
+        spectator_skipped++;
+        return;
+    }
+    spectator_count = 0;
+
+    // === Pick what every feed broadcasts ===
+    uint64_t delay = (uint64_t)spectator_delay_ms * snapshot_hz / 1000;
+    if (delay > FEED_HISTORY - PONG_SNAPSHOT_HISTORY) delay = FEED_HISTORY - PONG_SNAPSHOT_HISTORY;
+    // In snapshot frames, capped to what a feed can hold while keeping room for
+    // the delta baselines behind it.
+    for (int i = 0; i < MAX_FEEDS; i++) {
+        feed_frames[i] = (FeedFrames){ .snap = NULL };
+        if (feeds[i].in_use) feed_play(&feeds[i], (u32_t)delay, &feed_frames[i]);
+    }
+
+    // === Queue frames and pending closes ===
+    for (int i = 0; i < spectating_count; i++) {
+        Spectator *s = &spectators[spectating[i]];
+
+        if (s->closing) {
+            if (s->inflight_count == 0) {
+                spectator_release(s);
+                i--;
+                // The last spectator was moved into this position.
+            } else {
+                spectator_queue[spectator_count++] = (SpectatorTarget){ .p = NULL, .spectator = spectating[i] };
+                // Lets the tcpip thread reap what was acknowledged, or abort after the deadline.
             }
+            continue;
+        }
+
+        FeedFrames *ff = &feed_frames[s->feed];
+        spectator_frame(s, ff);
+
+        if (ff->over) {
+            struct pbuf **p = s->proto ? &ff->gameover_bin : &ff->gameover_text;
+            if (!*p) *p = frame_gameover(s->proto, feeds[s->feed].winner);
+            spectator_send(s, *p, 0);
+            spectator_close(s, CLOSE_LINGER_MS);
+            // Same as the players, only later: the final state, then the GAMEOVER.
         }
+    }
+
+    // === Drop our own references and the feeds nobody watches ===
+    for (int i = 0; i < MAX_FEEDS; i++) {
+        FeedFrames *ff = &feed_frames[i];
+        struct pbuf *own[] = { ff->delta[0], ff->delta[1], ff->full, ff->text,
+                               ff->gameover_bin, ff->gameover_text };
+        for (size_t k = 0; k < sizeof(own) / sizeof(own[0]); k++)
+            if (own[k]) pbuf_free(own[k]);
+
+        if (feeds[i].in_use && feeds[i].viewers == 0) feed_release(i);
+    }
+
+    if (spectator_count == 0) return;
+
+    spectator_pos = 0;
+    SYS_ARCH_PROTECT(lev);
+    spectator_busy = 1;
+    SYS_ARCH_UNPROTECT(lev);
 
-        // === Control frame rate ===
-        sys_msleep(FRAME_TIME_MS);
-        // Pause execution for the duration of one frame.
-        // This ensures that updates occur at a fixed rate (e.g., 60 FPS).
+    spectators_posted = trace_now();
+    if (raw_mode) {
+        if (tcpip_callback_with_block(spectators_tcpip, NULL, 0) != ERR_OK) spectators_tcpip(NULL);
+        // Already in the tcpip thread: queue it behind the pending input, or write it now.
+        return;
+    }
+
+    handoffs++;
+    if (tcpip_callback_with_block(spectators_tcpip, NULL, 1) != ERR_OK) {
+        for (int i = 0; i < spectator_count; i++)
+            if (spectator_queue[i].p) pbuf_free(spectator_queue[i].p);
+        spectator_busy = 0;
     }
 }
 
-// Entry point to start the game logic thread from outside.
-// This function is called once at setup time to launch the server.
-void pong_init(void) {
-    sys_thread_new("pong_thread", pong_thread, NULL, DEFAULT_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
-    // Creates a new system thread named "pong_thread" to run the game logic.
-    // The stack size and priority are defined by LWIP's configuration.
+// Set once pong_init() or pong_init_raw() has run: the game loop reads the
+// settings below without locks, so they can't change under it afterwards.
+static int server_started;
+
+static int setting_too_late(const char *what) {
+    if (server_started) printf("pong: %s can only be set before the server starts, ignored\n", what);
+    return server_started;
+}
+
+// Sets the simulation, input and snapshot rates, before the server starts.
+// The input and snapshot rates are capped to the simulation rate; 0 keeps
+// the current value.
+void pong_set_rates(unsigned int physics, unsigned int input, unsigned int snapshot) {
+    if (setting_too_late("rates")) return;
+    if (physics) physics_hz = physics;
+    if (input) input_hz = input;
+    if (snapshot) snapshot_hz = snapshot;
+    if (input_hz > physics_hz) input_hz = physics_hz;
+    if (snapshot_hz > physics_hz) snapshot_hz = physics_hz;
+}
+
+// Caps the spectator delay to what a feed holds at the snapshot rate:
+// FEED_HISTORY snapshots, less the delta baselines kept behind the one shown
+// (224 snapshots, 3.7 s at 60 Hz). Logs it when the configured delay is longer.
+static void spectator_delay_clamp(void) {
+    u32_t max_ms = (u32_t)((uint64_t)(FEED_HISTORY - PONG_SNAPSHOT_HISTORY) * 1000 / snapshot_hz);
+    if (spectator_delay_ms <= max_ms) return;
+    printf("pong: spectator delay %u ms is more than a feed holds at %u snapshots/s, using %u ms\n",
+           (unsigned)spectator_delay_ms, (unsigned)snapshot_hz, (unsigned)max_ms);
+    spectator_delay_ms = max_ms;
+}
+
+// Sets the broadcast delay of the spectator stream, capped once the server
+// starts by spectator_delay_clamp().
+void pong_set_spectator_delay(unsigned int ms) {
+    spectator_delay_ms = ms;
+    if (server_started) spectator_delay_clamp();
+}
+
+// Journals every match to the given file, before the server starts. Matches
+// the file holds that were still running are restored at startup and resume
+// once both players are back. The file is mapped up to max_mb MiB (0 keeps
+// JOURNAL_MAX_MB), never less than it already holds; past that, records are
+// dropped, but for the JOURNAL_RESERVE bytes kept to close every match. The
+// file is compacted at startup to the matches it restores.
+void pong_set_journal(const char *path, unsigned int max_mb) {
+    if (setting_too_late("journal")) return;
+    journal_path = path;
+    if (max_mb) journal_max_size = (uint64_t)max_mb << 20 > SIZE_MAX ? SIZE_MAX : (size_t)((uint64_t)max_mb << 20);
+    // A 32-bit build can't map more than its address space.
+}
+
+// === Input journal ===
+
+// Stages a record of a match. Runs on any worker, like the step that calls it.
+static void journal_put(Match *m, int kind, uint32_t tick, uint32_t value) {
+    if (m->journal_lost) return;
+    if (m->journal_len + PONG_JOURNAL_RECORD_MAX > JOURNAL_STAGE) {
+        m->journal_lost = 1;
+        return;
+    }
+    // More steps in a frame than the stage holds: the match can't be replayed.
+
+    m->journal_len += pong_journal_event(m->journal_buf + m->journal_len, kind, (uint32_t)(m - matches),
+                                         tick - m->journal_last, value);
+    m->journal_last = tick;
+}
+
+// Stages the steps of a match that started before the given tick: what they
+// did is final, no late input can rewrite them any more. Only changes are
+// recorded, with a SYNC now and then so a restart loses little.
+static void match_journal(Match *m, uint32_t until) {
+    if (!m->journaled) return;
+
+    while ((int32_t)(until - m->journal_tick) > 0) {
+        const Rewind *r = &m->rewind[m->journal_tick % REWIND_TICKS];
+        uint32_t t = m->journal_tick;
+        int in[2] = { r->game.p1.input, r->game.p2.input };
+
+        for (int i = 0; i < 2; i++) {
+            if (in[i] != m->journal_in[i]) journal_put(m, PONG_JOURNAL_INPUT1 + i, t, (uint32_t)in[i]);
+            if (r->grace[i] != m->journal_grace[i]) journal_put(m, PONG_JOURNAL_GRACE1 + i, t, (uint32_t)r->grace[i]);
+            m->journal_in[i] = in[i];
+            m->journal_grace[i] = r->grace[i];
+        }
+        if (r->ticks != 1) journal_put(m, PONG_JOURNAL_STEP, t, r->ticks);
+        else if (t - m->journal_last >= PONG_JOURNAL_SYNC_TICKS) journal_put(m, PONG_JOURNAL_SYNC, t, 0);
+
+        m->journal_tick += r->ticks;
+    }
+}
+
+// Appends the records a match staged. final is set for the last ones, which
+// close the match: like a LOST, they may go in the journal's reserve, so a
+// full journal still tells a restart which matches are over. Runs on the game
+// loop's thread only.
+static void match_journal_flush(Match *m, int final) {
+    if (m->journal_lost) {
+        uint8_t rec[PONG_JOURNAL_RECORD_MAX];
+        if (pong_journal_append_end(&journal, rec,
+                                    pong_journal_event(rec, PONG_JOURNAL_LOST, (uint32_t)(m - matches), 0, 0)))
+            m->journaled = 0;
+        // The match goes on without a journal; the replay stops at the LOST.
+    } else if (m->journal_len) {
+        int ok = final ? pong_journal_append_end(&journal, m->journal_buf, m->journal_len)
+                       : pong_journal_append(&journal, m->journal_buf, m->journal_len);
+        if (!ok) m->journal_lost = 1;
+    }
+    m->journal_len = 0;
+}
+
+// Publishes a match's state to its row of the SNMP match table. Called by the
+// game loop whenever the match changes hands or has been stepped.
+static void match_stats_update(const Match *m) {
+    PongMatchStats *st = &match_stats[m - matches];
+    int lag = 0;
+    for (int i = 0; i < 2; i++)
+        if (m->players[i] && m->players[i]->lag_ticks > lag) lag = m->players[i]->lag_ticks;
+
+    atomic_store_explicit(&st->ticks, m->tick, memory_order_relaxed);
+    atomic_store_explicit(&st->snapshots, m->seq, memory_order_relaxed);
+    atomic_store_explicit(&st->lag, (uint32_t)lag, memory_order_relaxed);
+    atomic_store_explicit(&st->score1, (uint32_t)m->game.score1, memory_order_relaxed);
+    atomic_store_explicit(&st->score2, (uint32_t)m->game.score2, memory_order_relaxed);
+    atomic_store_explicit(&st->state, (uint32_t)m->state, memory_order_release);
+    // The state goes last: a reader that sees a new match sees its numbers too.
+}
+
+// Restores a match that was still running when the journal was last written,
+// into its old slot. Called back from pong_journal_open(), at startup.
+static void journal_recover(void *ctx, const PongReplay *r) {
+    LWIP_UNUSED_ARG(ctx);
+    if (!r->open || r->slot >= MAX_MATCHES) return;
+    // A slot this server doesn't have is never reused: its match stays open in the journal.
+
+    Match *m = &matches[r->slot];
+    m->journaled = 1;
+    m->journal_last = r->last;
+    if (r->hz != physics_hz || r->serve_ticks != (int)(SERVE_SECONDS * physics_hz)) {
+        journal_put(m, PONG_JOURNAL_ABORT, r->last, 0);
+        return;
+    }
+    // Played at another rate: it can't go on here, so it is called off
+    // (journal_start() appends the ABORT once the journal is open).
+    if (!r->resume[0] || !r->resume[1]) {
+        journal_put(m, PONG_JOURNAL_ABORT, r->last, 0);
+        return;
+    }
+    // Journaled without its players' tokens: nobody could ever claim it.
+
+    *m = (Match){ .state = MATCH_WAITING, .feed = -1, .recovered = 1, .journaled = 1 };
+    m->game = r->game;
+    m->resume[0] = r->resume[0];
+    m->resume[1] = r->resume[1];
+    m->tick = m->rewind_floor = m->input_tick = r->tick;
+    m->journal_tick = m->journal_last = r->tick;
+    m->journal_in[0] = r->game.p1.input;
+    m->journal_in[1] = r->game.p2.input;
+    m->journal_grace[0] = r->grace[0];
+    m->journal_grace[1] = r->grace[1];
+    // From the start of its last journaled tick on; nothing may rewind past it.
+
+    for (int i = 0; i < free_match_count; i++) {
+        if (free_matches[i] != (int)r->slot) continue;
+        free_matches[i] = free_matches[--free_match_count];
+        break;
+    }
+    m->active_pos = active_match_count;
+    active_matches[active_match_count++] = (int)r->slot;
+    journal_recovered++;
+    match_stats_update(m);
+}
+
+// Opens the journal asked for with pong_set_journal(), restoring the matches
+// it left open. Called once, after tables_init().
+static void journal_start(void) {
+    if (!journal_path) return;
+
+    if (!pong_journal_open(&journal, journal_path, journal_max_size, JOURNAL_RESERVE, journal_recover, NULL)) {
+        perror(journal_path);
+        return;
+    }
+    journal_on = 1;
+
+    for (int i = 0; i < MAX_MATCHES; i++) {
+        Match *m = &matches[i];
+        if (m->journal_len) match_journal_flush(m, 1);
+        if (m->journaled && m->journal_lost) match_journal_flush(m, 1);
+        if (m->state == MATCH_FREE) m->journaled = 0;
+    }
+    // The ABORTs of the matches that couldn't be restored.
+
+    if (journal_recovered)
+        printf("pong: %u matches recovered from %s\n", (unsigned)journal_recovered, journal_path);
+    resume_deadline = sys_now() + RESUME_TIMEOUT_MS;
+}
+
+// Allocates the profiler's rings asked for with pong_set_trace(). Called once,
+// before the first frame.
+static void trace_start(void) {
+    if (!trace_events) return;
+    if (!pong_trace_init(&pong_trace, trace_events)) {
+        printf("pong: no memory for a trace of %u events, tracing is off\n", (unsigned)trace_events);
+        return;
+    }
+    trace_on = 1;
+}
+
+// A random token for credentials another host must not guess, from the OS
+// (rand() is seeded with the start time, anyone can replay it). Never 0.
+static uint32_t random_token(void) {
+    static int fd = -1;
+    uint32_t v;
+
+    if (fd < 0) fd = open("/dev/urandom", O_RDONLY);
+    if (fd >= 0 && read(fd, &v, sizeof(v)) == (ssize_t)sizeof(v)) return v | 1;
+
+    static int warned;
+    if (!warned++) printf("pong: no /dev/urandom, tokens are predictable\n");
+    return ((((uint32_t)rand() << 16) ^ (uint32_t)rand()) ^ (uint32_t)pong_clock_ns()) | 1;
+}
+
+// Puts a match back into its initial state: centered paddles, no score,
+// player 1 serving. Journals its start, with the seed of its serves.
+static void match_reset(Match *m) {
+    uint32_t seed = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    pong_game_reset(&m->game, seed, SERVE_SECONDS * physics_hz);
+
+    m->rewind_floor = m->input_tick = m->tick;
+
+    if (!journal_on) return;
+    m->journaled = 1;
+    m->journal_lost = 0;
+    m->journal_tick = m->journal_last = m->tick;
+    m->journal_in[0] = m->journal_in[1] = NONE;
+    m->journal_grace[0] = m->journal_grace[1] = 0;
+    m->journal_len = (uint16_t)pong_journal_start(m->journal_buf, (uint32_t)(m - matches), m->tick, seed,
+                                                  physics_hz, SERVE_SECONDS * physics_hz);
+    for (int i = 0; i < 2; i++) journal_put(m, PONG_JOURNAL_RESUME1 + i, m->tick, m->resume[i]);
+    // A restarted server gives the match back to these two players only.
+}
+
+// Ends a match: tells the remaining players who won, closes their
+// connections and recycles both the connection and the match slots.
+// winner is 1 or 2, or 0 if the match was aborted without a winner.
+static void match_end(Match *m, int winner) {
+    if (m->journaled) {
+        match_journal(m, m->tick);
+        journal_put(m, winner && pong_game_winner(&m->game) == winner ? PONG_JOURNAL_END : PONG_JOURNAL_ABORT,
+                    m->tick, (uint32_t)winner);
+        match_journal_flush(m, 1);
+        if (m->journaled && m->journal_lost) match_journal_flush(m, 1);
+        m->journaled = 0;
+    }
+    // Every step is final now. A forfeit is an ABORT: the points didn't decide it.
+    // If even the reserve couldn't take them, a LOST closes the match.
+
+    feed_end(m, winner);
+    // Spectators see the end later, with the rest of the delayed stream.
+
+    for (int i = 0; i < 2; i++) {
+        Client *c = m->players[i];
+        if (!c) continue;
+        if (m->state == MATCH_PLAYING) {
+            send_gameover(c, winner);
+            client_close(c, CLOSE_LINGER_MS);
+            // The GAMEOVER goes out with this frame's fan-out, after the final state.
+        } else {
+            client_release(c);
+        }
+        m->players[i] = NULL;
+    }
+
+    // Remove the match from the dense active list by swapping in the last entry.
+    int last = active_matches[--active_match_count];
+    active_matches[m->active_pos] = last;
+    matches[last].active_pos = m->active_pos;
+
+    m->active_pos = -1;
+    m->state = MATCH_FREE;
+    free_matches[free_match_count++] = (int)(m - matches);
+    match_stats_update(m);
+}
+
+
+// Places a freshly connected player into a match. A restored match whose slot
+// the player's RESUME token reclaims comes first, then a waiting match whose
+// requested slot is still open, otherwise a new match is opened.
+// Returns the match, or NULL if every slot is taken or the server refuses new matches.
+static Match *match_join(Client *c) {
+    int slot = c->id - 1;
+
+    for (int pass = c->resume ? 0 : 1; pass < 2; pass++) {
+        for (int i = 0; i < active_match_count; i++) {
+            Match *m = &matches[active_matches[i]];
+            if (m->state != MATCH_WAITING || m->players[slot]) continue;
+            if (pass == 0 ? !m->recovered || m->resume[slot] != c->resume : m->recovered) continue;
+            // A restored match only takes back its own players: a stranger
+            // never resumes somebody else's score.
+
+            m->players[slot] = c;
+            c->match = (int)(m - matches);
+            if (!m->recovered) m->resume[slot] = random_token();
+            if (!m->players[1 - slot]) return m;
+            // A recovered match waits for both of its players.
+
+            m->state = MATCH_PLAYING;
+            if (!m->recovered) match_reset(m);
+            m->recovered = 0;
+            match_stats_update(m);
+            // Both players are here: the match starts ticking (or resumes) on the next frame.
+            return m;
+        }
+    }
+
+    if (free_match_count == 0 || load_level >= LOAD_REFUSE) return NULL;
+    // Under the highest load a player can still complete a waiting match, but
+    // nobody opens a new one.
+
+    Match *m = &matches[free_matches[--free_match_count]];
+    *m = (Match){ .state = MATCH_WAITING, .feed = -1 };
+    m->players[slot] = c;
+    m->resume[slot] = random_token();
+    c->match = (int)(m - matches);
+    atomic_store_explicit(&match_stats[m - matches].inputs, 0, memory_order_relaxed);
+    match_stats_update(m);
+
+    m->active_pos = active_match_count;
+    active_matches[active_match_count++] = (int)(m - matches);
+    return m;
+}
+
+// Drains every netbuf already queued on the client's connection and feeds it
+// to the line reassembler. Never blocks: only as many netconn_recv() calls are
+// made as there are pending receive events. Returns 0 if the connection was lost.
+static int client_drain(Client *c) {
+    SYS_ARCH_DECL_PROTECT(lev);
+    int index = (int)(c - clients);
+    if (!c->link.conn) return rcv_pending[index] >= 0;
+    // Raw mode: the recv callback already fed the data, only a loss is left to report.
+
+    SYS_ARCH_PROTECT(lev);
+    lines_arrived = rcv_at[index];
+    rcv_at[index] = 0;
+    SYS_ARCH_UNPROTECT(lev);
+    // The lines drained now are as old as the oldest of their segments.
+
+    while (rcv_pending[index] > 0) {
+        struct netbuf *nbuf;
+
+        err_t err = netconn_recv(c->link.conn, &nbuf);
+        handoffs++;
+        if (err != ERR_OK) return ERR_IS_FATAL(err) || err == ERR_CLSD ? 0 : 1;
+        // A fatal error or a closed connection means the player is gone.
+
+        netbuf_first(nbuf);
+        do {
+            void *data;
+            u16_t len;
+            netbuf_data(nbuf, &data, &len);
+            client_feed(c, data, len);
+        } while (netbuf_next(nbuf) >= 0);
+        netbuf_delete(nbuf);
+    }
+
+    SYS_ARCH_PROTECT(lev);
+    if (rcv_pending[index] <= 0) rcv_at[index] = 0;
+    SYS_ARCH_UNPROTECT(lev);
+    // Segments that arrived meanwhile were drained too; the others keep their time.
+    return 1;
+}
+
+// Called when a client's connection is gone. A player in a running match
+// forfeits it to the opponent; anyone else just frees their slots.
+static void client_lost(Client *c) {
+    if (c->match < 0) {
+        client_release(c);
+        return;
+    }
+
+    Match *m = &matches[c->match];
+    m->players[c->id - 1] = NULL;
+    client_release(c);
+    // The lost connection gets no GAMEOVER, only the opponent does.
+
+    match_end(m, m->state == MATCH_PLAYING ? 3 - c->id : 0);
+}
+
+// Finishes the handshake of a lobby client once its first line has arrived:
+// a valid HELLO gets the player into a match, a WATCH turns the connection
+// into a spectator, anything else is rejected.
+static void client_handshake(Client *c) {
+    lobby_remove(c);
+
+    if (c->id == WATCHER_ID) {
+        spectator_join(c);
+        return;
+    }
+
+    if (c->id > 0 && match_join(c)) {
+        char welcome[112];
+        int len = c->proto
+            ? snprintf(welcome, sizeof(welcome), "WELCOME %d BIN:%d MATCH:%d", c->id, c->proto, c->match)
+            : snprintf(welcome, sizeof(welcome), "WELCOME %d MATCH:%d", c->id, c->match);
+        // Echoing BIN:<version> confirms the switch to binary frames.
+        // MATCH:<index> is what spectators pass to WATCH.
+
+        if (journal_on)
+            len += snprintf(welcome + len, sizeof(welcome) - len, " RESUME:%u",
+                            (unsigned)matches[c->match].resume[c->id - 1]);
+        // With a journal the match can outlive a restart; the token gets the player back in.
+
+        if (c->udp && c->proto == PONG_PROTO_DELTA) {
+            SYS_ARCH_DECL_PROTECT(lev);
+            uint32_t token = random_token();
+            SYS_ARCH_PROTECT(lev);
+            c->udp_token = token;
+            SYS_ARCH_UNPROTECT(lev);
+            len += snprintf(welcome + len, sizeof(welcome) - len, " UDP:%d:%d:%u",
+                            PORT, (int)(c - clients), (unsigned)c->udp_token);
+            // The token keeps other hosts from feeding input into this slot.
+        }
+        len += snprintf(welcome + len, sizeof(welcome) - len, " HZ:%u:%u:%u\n",
+                        (unsigned)physics_hz, (unsigned)input_hz, (unsigned)snapshot_hz);
+        // The rates the client needs to predict: ticks, input sampling and snapshot
+        // sequence numbers per second.
+        link_write(&c->link, welcome, len);
+    } else {
+        // If message is invalid or the server is full, reject connection.
+        atomic_fetch_add_explicit(&pong_metrics.conns_rejected, 1, memory_order_relaxed);
+        client_release(c);
+    }
+}
+
+// Datagram arriving on the UDP channel, called from the tcpip thread.
+// Only the newest input datagram of each client counts; it is stored in the
+// client and handed to the game loop through the ready ring, like TCP input.
+static void udp_channel_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t port) {
+    SYS_ARCH_DECL_PROTECT(lev);
+    uint8_t buf[PONG_DGRAM_MAX];
+    PongInputDgram in;
+    LWIP_UNUSED_ARG(arg);
+    LWIP_UNUSED_ARG(pcb);
+
+    u16_t len = pbuf_copy_partial(p, buf, sizeof(buf), 0);
+    pbuf_free(p);
+    if (!pong_decode_input_dgram(buf, len, &in) || in.slot >= MAX_CLIENTS || in.token == 0) return;
+
+    Client *c = &clients[in.slot];
+    SYS_ARCH_PROTECT(lev);
+    if (c->udp_token == in.token) {
+        int first = c->udp_bound != in.token;
+        if (first || (s32_t)(in.seq - c->udp_seq) > 0) {
+            if (!first) {
+                uint32_t missed = in.seq - c->udp_seq - 1;
+                udp_inputs_recovered += missed < in.count - 1u ? missed : in.count - 1u;
+            }
+            // Inputs of datagrams lost in between ride along in this one.
+
+            c->udp_bound = in.token;
+            ip_addr_set(&c->udp_addr, addr);
+            c->udp_port = port;
+            // Snapshots follow the newest datagram, even if the client's address changed.
+
+            c->udp_seq = in.seq;
+            c->udp_input = (Input)in.inputs[0];
+            // PONG_INPUT_* and Input share their values.
+            c->udp_ack = in.ack;
+            c->udp_stamp = in.stamp;
+            c->udp_at = pong_clock_ns();
+            c->udp_fresh = 1;
+            ready_push((int)in.slot);
+        }
+        // Older or duplicated datagrams are dropped: the newest input always wins.
+    }
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+// Applies the newest input and ACK a UDP client sent by datagram.
+static void client_take_datagram(Client *c) {
+    SYS_ARCH_DECL_PROTECT(lev);
+    uint64_t arrived = 0;
+
+    SYS_ARCH_PROTECT(lev);
+    if (c->udp_fresh) {
+        c->input = c->udp_input;
+        c->input_stamp = c->udp_stamp;
+        c->acked_seq = c->udp_ack;
+        c->udp_fresh = 0;
+        arrived = c->udp_at;
+        frame_inputs++;
+        if (c->match >= 0) atomic_fetch_add_explicit(&match_stats[c->match].inputs, 1, memory_order_relaxed);
+    }
+    SYS_ARCH_UNPROTECT(lev);
+    input_follow(c, arrived);
+}
+
+// Opens the UDP channel, executed in the tcpip thread. Without it UDP clients
+// still play: their deltas simply keep coming over TCP.
+static void udp_channel_start(void *arg) {
+    LWIP_UNUSED_ARG(arg);
+
+    struct udp_pcb *pcb = udp_new();
+    if (!pcb) return;
+    if (udp_bind(pcb, IP_ADDR_ANY, PORT) != ERR_OK) {
+        udp_remove(pcb);
+        return;
+    }
+    udp_recv(pcb, udp_channel_recv, NULL);
+    udp_channel = pcb;
+}
+
+// Accepts every connection the listener has queued, without ever blocking.
+// New clients wait in the lobby until their HELLO line arrives.
+static void accept_ready(void) {
+    while (accept_pending > 0) {
+        struct netconn *conn;
+        if (netconn_accept(listener, &conn) != ERR_OK) break;
+        handoffs++;
+
+        if (!client_accept((Link){ .conn = conn })) {
+            // If the server is full, reject connection.
+            netconn_close(conn);
+            netconn_delete(conn);
+        }
+    }
+}
+
+// Handles every connection marked ready since the last frame: drains its input,
+// completes handshakes and detects lost connections.
+static void poll_ready(void) {
+    atomic_store_explicit(&pong_metrics.input_backlog, (uint32_t)ready_count, memory_order_relaxed);
+
+    for (int n = ready_count; n > 0; n--) {
+        int index = ready_pop();
+        if (index < 0) break;
+
+        if (!link_open(index < MAX_CLIENTS ? &clients[index].link : &spectators[index - MAX_CLIENTS].link) &&
+            rcv_pending[index] >= 0) continue;
+        // The slot was released after it was queued. A raw connection the stack
+        // dropped has no link anymore but is still marked lost (see raw_lost).
+
+        if (index >= MAX_CLIENTS) {
+            Spectator *s = &spectators[index - MAX_CLIENTS];
+            if (!spectator_drain(s)) spectator_close(s, 0);
+            continue;
+            // A lost spectator is released by the next spectator batch.
+        }
+
+        Client *c = &clients[index];
+        if (!client_drain(c)) client_lost(c);
+        else if (c->lobby_pos >= 0 && c->id != 0) client_handshake(c);
+        else if (c->udp_token) client_take_datagram(c);
+    }
+}
+
+// Drops lobby clients that didn't complete the handshake in time.
+static void lobby_expire(u32_t now) {
+    for (int i = 0; i < lobby_count; i++) {
+        Client *c = &clients[lobby[i]];
+        if (now - c->accepted_at >= HANDSHAKE_TIMEOUT_MS) {
+            atomic_fetch_add_explicit(&pong_metrics.conns_rejected, 1, memory_order_relaxed);
+            client_release(c);
+            i--;
+            // The last lobby entry was moved into this position.
+        }
+    }
+}
+
+// Calls off the restored matches whose players didn't both come back within
+// RESUME_TIMEOUT_MS of the restart. A player already back gets disconnected.
+static void recovered_expire(u32_t now) {
+    if (!journal_recovered || (s32_t)(now - resume_deadline) < 0) return;
+
+    for (int i = 0; i < active_match_count; i++) {
+        Match *m = &matches[active_matches[i]];
+        if (!m->recovered) continue;
+        match_end(m, 0);
+        i--;
+        // The last active match was moved into this position.
+    }
+    journal_recovered = 0;
+    // Only once: no match is restored after startup.
+}
+
+// Ticks a point may wait for the late input of the player who is losing it.
+static int match_grace(Match *m, int player) {
+    int lag = m->players[player]->lag_ticks;
+    return lag < REWIND_TICKS - 1 ? lag : REWIND_TICKS - 1;
+}
+
+// Simulates ticks (usually 1) of a match in a single step, with the inputs
+// stored in its paddles, recording the state it started from in the rewind
+// history. Several ticks at once cost as much as one: the swept ball path
+// covers them all.
+static void match_tick(Match *m, uint32_t ticks) {
+    match_journal(m, m->tick - (REWIND_TICKS - 1));
+    // The oldest step of the history is final: it goes to the journal before
+    // its entry is reused.
+
+    // A ball that left the field keeps flying for as many ticks as the input of
+    // the player who missed it lags behind, so a late input that would have hit
+    // it can still rewind the miss (see match_rewind).
+    Rewind *r = &m->rewind[m->tick % REWIND_TICKS];
+    r->game = m->game;
+    r->ticks = ticks;
+    r->grace[0] = match_grace(m, 0);
+    r->grace[1] = match_grace(m, 1);
+    if (pong_game_step(&m->game, m->tick, ticks, physics_hz, SERVE_SECONDS * physics_hz, r->grace))
+        m->rewind_floor = m->tick + 1;
+    // Rewinding never goes back past a point: it has been scored and served again.
+
+    m->tick += ticks;
+    if (ticks > 1) m->rewind_floor = m->tick;
+    // The history has a gap now: no input can rewind into it.
+}
+
+// Maps the stamp of a client's newest input to the tick it was meant for.
+// Returns the current tick if the input carries no stamp, or if it reaches
+// further back than the rewind window or the last point.
+static uint32_t match_input_tick(Match *m, Client *c) {
+    uint32_t stamp = c->input_stamp;
+    c->input_stamp = 0;
+    // A stamp is used once; the input then simply holds.
+
+    if (stamp == 0 || (int32_t)(m->seq - stamp) < 0) return m->tick;
+    if (m->seq - stamp >= REWIND_TICKS) {
+        c->lag_ticks = REWIND_TICKS;
+        return m->tick;
+    }
+    // A client predicting past the newest snapshot is simply on time.
+    // A snapshot older than the window is also older than the tick history.
+
+    uint32_t tick = m->frame_tick[stamp % REWIND_TICKS];
+    c->lag_ticks = (int)(m->tick - tick);
+    if (m->tick - tick >= REWIND_TICKS || (int32_t)(tick - m->rewind_floor) < 0) return m->tick;
+    return tick;
+}
+
+// Gives a player's input effect from the given tick on, rewriting the recorded
+// history. Returns the first tick whose input actually changed, or the current
+// tick if none did.
+static uint32_t match_rewrite_input(Match *m, int player, uint32_t from, Input input) {
+    uint32_t changed = m->tick;
+
+    for (uint32_t t = from; t != m->tick; t++) {
+        PongGame *g = &m->rewind[t % REWIND_TICKS].game;
+        PongPaddle *p = player ? &g->p2 : &g->p1;
+        if (p->input == (int)input) continue;
+        p->input = input;
+        if (changed == m->tick) changed = t;
+    }
+    return changed;
+}
+
+// Rewinds a match to the start of the given tick and simulates it again up to
+// the current one, with the inputs the history now holds.
+static void match_rewind(Match *m, uint32_t from) {
+    uint32_t now = m->tick;
+    int in1 = m->game.p1.input, in2 = m->game.p2.input;
+    // The inputs for the current tick.
+
+    m->game = m->rewind[from % REWIND_TICKS].game;
+    m->tick = from;
+
+    while (m->tick != now) {
+        PongGame *r = &m->rewind[m->tick % REWIND_TICKS].game;
+        m->game.p1.input = r->p1.input;
+        m->game.p2.input = r->p2.input;
+        match_tick(m, 1);
+    }
+    // No point was scored since from (see rewind_floor), so scores never go
+    // back; the replay itself may score one, a lost hit for the other player.
+
+    m->game.p1.input = in1;
+    m->game.p2.input = in2;
+}
+
+// Advances one match by the given number of ticks, 1 unless the match runs at
+// a reduced rate (see LOAD_SLOW_MATCHES).
+// Returns the winner (1 or 2), or 0 if the match goes on.
+static int match_step(Match *m, uint32_t ticks) {
+    // === Handle player input ===
+    // poll_ready() has already consumed everything queued since the last frame;
+    // only the newest input of each player is applied, so backed-up lines never add input lag.
+    // A stamped input that arrives late takes effect from the tick the player
+    // acted on: the match is rewound to it and simulated forward again.
+    uint32_t rewind_from = m->tick;
+    for (int i = 0; i < 2; i++) {
+        Client *c = m->players[i];
+        PongPaddle *p = i ? &m->game.p2 : &m->game.p1;
+        uint32_t from = match_input_tick(m, c);
+
+        if (p->input != (int)c->input) m->input_tick = m->tick;
+        p->input = c->input;
+        if (from != m->tick) {
+            from = match_rewrite_input(m, i, from, c->input);
+            if ((int32_t)(from - rewind_from) < 0) rewind_from = from;
+        }
+    }
+    if (rewind_from != m->tick) match_rewind(m, rewind_from);
+
+    match_tick(m, ticks);
+
+    for (int i = 0; i < 2; i++) {
+        Client *c = m->players[i];
+        if (c->lat_arrived && !c->lat_stepped) c->lat_stepped = pong_clock_ns();
+    }
+    // A followed input has made it into the game (see input_follow).
+
+    // === Check for the end of the match ===
+    return pong_game_winner(&m->game);
+}
+
+// Snapshot divisor the current load level imposes on every player.
+static uint32_t load_send_div(void) {
+    return load_level >= LOAD_SEND_THIRD ? 3 : load_level >= LOAD_SEND_HALF ? 2 : 1;
+}
+
+// Sends the current state of a match to both players, to those whose send rate
+// is due this snapshot, or to both if it is the final one.
+static void match_send_state(Match *m, int final) {
+    PongPaddle *p1 = &m->game.p1, *p2 = &m->game.p2;
+    PongBall *ball = &m->game.ball;
+
+    // === Quantize the current game state ===
+    PongSnapshot snap = {
+        .p1_y = (uint16_t)p1->y, .p2_y = (uint16_t)p2->y,              // Paddle positions (vertical only)
+        .ball_x = pong_fx_quantize(ball->x, PONG_POS_SCALE),             // Ball position
+        .ball_y = pong_fx_quantize(ball->y, PONG_POS_SCALE),
+        .ball_dx = pong_fx_quantize(ball->dx, PONG_VEL_SCALE),           // Ball velocity
+        .ball_dy = pong_fx_quantize(ball->dy, PONG_VEL_SCALE),
+        .score1 = (uint16_t)m->game.score1, .score2 = (uint16_t)m->game.score2, // Current scores of both players
+        .serve_timer = (uint16_t)ball->serve_timer                    // Remaining delay before next ball movement
+    };
+
+    m->seq++;
+    pong_ring_put(&m->history, m->seq, &snap);
+    m->frame_tick[m->seq % REWIND_TICKS] = m->tick;
+    // Stamped inputs name this snapshot; match_input_tick() needs its tick.
+    // Keep it as a possible baseline for the deltas of the coming frames.
+
+    if (m->feed >= 0) feed_put(&feeds[m->feed], m->seq, &snap);
+    // Spectators get it later, from their feed.
+
+    // Each representation is serialized at most once, into a pbuf shared by every
+    // player that uses it: full frames and text once per match, deltas once per
+    // distinct baseline.
+    struct pbuf *full = NULL, *text = NULL, *dgram = NULL;
+    struct pbuf *delta[2] = {NULL, NULL};
+    uint32_t delta_base[2];
+
+    // === Queue the state for both connected clients ===
+    for (int i = 0; i < 2; i++) {
+        Client *c = m->players[i];
+        if (!final && m->seq % (c->send_div * load_send_div()) != 0) continue;
+
+        if (c->proto == PONG_PROTO_DELTA) {
+            const PongSnapshot *base = pong_ring_get(&m->history, c->acked_seq);
+            uint32_t base_seq = base ? c->acked_seq : 0;
+            // Without a usable baseline (none acked yet, or too old) every field is sent.
+
+            if (c->udp_token) {
+                if (!dgram) dgram = frame_datagram(&snap, m->seq);
+                send_datagram(c, dgram);
+                if (base && base->score1 == snap.score1 && base->score2 == snap.score2) continue;
+                // The datagram is all a UDP client needs, unless it hasn't acknowledged
+                // the current score yet: that keeps going over TCP as well.
+            }
+
+            if (base && pong_snapshot_diff(&snap, base) == 0) continue;
+            // The client already has exactly this state: send nothing at all.
+
+            int k = (i == 1 && delta[0] && delta_base[0] == base_seq) ? 0 : i;
+            // Player 2 reuses player 1's delta when both acknowledged the same snapshot.
+            if (!delta[k]) {
+                delta[k] = frame_delta(&snap, m->seq, base, base_seq);
+                delta_base[k] = base_seq;
+            }
+            send_frame(c, delta[k]);
+        } else if (c->proto == PONG_PROTO_FULL) {
+            if (!full) full = frame_snapshot(&snap);
+            send_frame(c, full);
+        } else {
+            if (!text) text = frame_text(&snap);
+            send_frame(c, text);
+        }
+    }
+
+    // Drop our own references; the send queue holds one per recipient.
+    if (full) pbuf_free(full);
+    if (text) pbuf_free(text);
+    if (dgram) pbuf_free(dgram);
+    if (delta[0]) pbuf_free(delta[0]);
+    if (delta[1]) pbuf_free(delta[1]);
+}
+
+// Fills the connection and match tables with free slots.
+static void tables_init(void) {
+    for (int i = 0; i < MAX_CLIENTS; i++)
+        free_clients[i] = MAX_CLIENTS - 1 - i;
+    free_client_count = MAX_CLIENTS;
+
+    for (int i = 0; i < MAX_MATCHES; i++) {
+        matches[i] = (Match){ .state = MATCH_FREE, .active_pos = -1, .feed = -1 };
+        free_matches[i] = MAX_MATCHES - 1 - i;
+    }
+    free_match_count = MAX_MATCHES;
+    active_match_count = 0;
+
+    for (int i = 0; i < MAX_SPECTATORS; i++)
+        free_spectators[i] = MAX_SPECTATORS - 1 - i;
+    free_spectator_count = MAX_SPECTATORS;
+
+    for (int i = 0; i < MAX_FEEDS; i++)
+        free_feeds[i] = MAX_FEEDS - 1 - i;
+    free_feed_count = MAX_FEEDS;
+    // Free lists are filled backwards so low slot numbers are handed out first.
+
+    pong_metrics.match_stats = match_stats;
+    pong_metrics.max_matches = MAX_MATCHES;
+}
+
+// Accounts a frame's work time and prints the report once its window is over.
+static void report_frame(uint64_t work_ns) {
+    u32_t interval = report_interval_ms;
+    if (interval == 0) return;
+
+    report_frames++;
+    report_work_ns += work_ns;
+    if (work_ns > report_max_ns) report_max_ns = work_ns;
+
+    u32_t now = sys_now();
+    if (now - report_started < interval) return;
+
+    printf("pong[%s]: %u frames, work avg %.1f us max %.1f us, %u handoffs/frame, "
+           "late %llu skipped %llu, %d matches %d spectators, %u udp inputs recovered, "
+           "load %u%% level %d, %d workers %u steals, journal %llu KB %llu dropped\n",
+           raw_mode ? "raw" : "netconn", (unsigned)report_frames,
+           report_work_ns / 1000.0 / report_frames, report_max_ns / 1000.0,
+           (unsigned)(handoffs / report_frames),
+           (unsigned long long)sched.late_ticks, (unsigned long long)sched.skipped_ticks,
+           active_match_count, spectating_count, (unsigned)udp_inputs_recovered,
+           (unsigned)(load_avg / 16), (int)load_level, pool.workers, (unsigned)pong_pool_steals(&pool),
+           (unsigned long long)(journal_on ? atomic_load(&journal.used) / 1024 : 0),
+           (unsigned long long)journal.dropped);
+
+    report_started = now;
+    report_frames = 0;
+    report_work_ns = report_max_ns = 0;
+    handoffs = 0;
+}
+
+// Publishes the frame's numbers for the metrics pages (pong_http.c).
+static void metrics_frame(uint64_t work_ns, uint32_t steps) {
+    PongMetrics *pm = &pong_metrics;
+
+    atomic_store_explicit(&pm->late_ticks, sched.late_ticks, memory_order_relaxed);
+    atomic_store_explicit(&pm->skipped_ticks, sched.skipped_ticks, memory_order_relaxed);
+    atomic_store_explicit(&pm->matches, (uint32_t)active_match_count, memory_order_relaxed);
+    atomic_store_explicit(&pm->clients, (uint32_t)(MAX_CLIENTS - free_client_count), memory_order_relaxed);
+    atomic_store_explicit(&pm->spectators, (uint32_t)spectating_count, memory_order_relaxed);
+    atomic_store_explicit(&pm->load_pct, load_avg / 16, memory_order_relaxed);
+    atomic_store_explicit(&pm->load_level, (uint32_t)load_level, memory_order_relaxed);
+    atomic_store_explicit(&pm->workers, (uint32_t)pool.workers, memory_order_relaxed);
+
+    pong_metrics_frame(pm, sys_now(), work_ns, steps, frame_inputs);
+    frame_inputs = 0;
+}
+
+// Whether an event at rate_hz falls due within the next steps simulation ticks,
+// starting at tick first.
+static int rate_due(uint64_t first, uint32_t steps, u32_t rate_hz) {
+    return (first + steps) * rate_hz / physics_hz != first * rate_hz / physics_hz;
+}
+
+// Tracks how much of the tick budget frames use and moves between load levels.
+// A level is added when the smoothed load stays above LOAD_HIGH_PCT, and one is
+// taken back when it drops below LOAD_LOW_PCT, at most once per LOAD_HOLD_MS so
+// each change has time to show its effect. Changes are always logged.
+static void load_update(uint64_t work_ns, uint32_t steps) {
+    uint64_t budget_ns = sched.period_ns * steps;
+    u32_t pct = budget_ns ? (u32_t)(work_ns * 100 * 16 / budget_ns) : 0;
+    load_avg = load_avg - load_avg / 16 + pct / 16;
+    // Exponential average over about 16 frames, in 1/16 %.
+
+    u32_t now = sys_now();
+    if (now - load_changed_at < LOAD_HOLD_MS) return;
+
+    LoadLevel level = load_level;
+    if (load_avg > LOAD_HIGH_PCT * 16 && level < LOAD_LEVELS - 1) level++;
+    else if (load_avg < LOAD_LOW_PCT * 16 && level > LOAD_NORMAL) level--;
+    if (level == load_level) return;
+
+    printf("pong: load %u%%, level %d -> %d\n", (unsigned)(load_avg / 16), (int)load_level, (int)level);
+    load_level = level;
+    load_changed_at = now;
+}
+
+// Whether a match can be stepped at a reduced rate when shedding load: it waits
+// for a serve, or neither player has changed input for IDLE_MATCH_SECONDS. A
+// pending input change, stamped or not, makes it busy again at once, before the
+// coarser step could cost it a rewind.
+static int match_idle(const Match *m) {
+    for (int i = 0; i < 2; i++) {
+        const Client *c = m->players[i];
+        const PongPaddle *p = i ? &m->game.p2 : &m->game.p1;
+        if (p->input != (int)c->input || c->input_stamp) return 0;
+    }
+    return m->game.ball.serve_timer > 0 || m->tick - m->input_tick >= IDLE_MATCH_SECONDS * physics_hz;
+}
+
+// Steps the i-th active match for a frame of the given number of steps. Runs
+// on any worker of the pool: it only touches the match and its two players,
+// and leaves the outcome in m->frame_result for pong_frame() to act on.
+static void match_frame(void *arg, int i) {
+    uint32_t steps = *(const uint32_t *)arg;
+    Match *m = &matches[active_matches[i]];
+
+    m->frame_result = -1;
+    if (m->state != MATCH_PLAYING) return;
+
+    int winner = 0;
+    if (load_level >= LOAD_SLOW_MATCHES && m->feed < 0 && match_idle(m)) {
+        m->deferred += steps;
+        if (m->deferred < SLOW_MATCH_STRIDE) return;
+        winner = match_step(m, m->deferred);
+        m->deferred = 0;
+        // Nobody plays or watches it right now: a coarser step will do.
+    } else {
+        for (uint32_t k = 0; k < steps + m->deferred && winner == 0; k++)
+            winner = match_step(m, 1);
+        m->deferred = 0;
+        // Ticks still owed from a reduced rate are caught up here.
+    }
+    m->frame_result = winner;
+}
+
+// match_frame() timed for the profiler: each worker notes when its first match
+// of the step started, when its last one ended and the time spent in them.
+static void match_frame_traced(void *arg, int i) {
+    uint64_t start = pong_trace_cycles();
+    match_frame(arg, i);
+    uint64_t end = pong_trace_cycles();
+
+    WorkerSpan *w = &worker_spans[pong_pool_worker()];
+    if (w->matches++ == 0) w->first = start;
+    w->last = end;
+    w->busy += end - start;
+}
+
+// Traces each worker's share of the step that just ended, on the worker's own
+// track. The workers are idle again, so the game loop writes it for them.
+static void trace_workers(void) {
+    for (int w = 0; w < pool.workers; w++) {
+        WorkerSpan *s = &worker_spans[w];
+        if (s->matches == 0) continue;
+        pong_trace_put(&pong_trace.rings[PONG_TRACE_RING_LOOP], PONG_TRACE_MATCHES,
+                       w == 0 ? PONG_TRACE_TID_LOOP : PONG_TRACE_TID_WORKER + w - 1,
+                       s->first, s->last, s->matches, s->busy);
+        s->matches = 0;
+        s->busy = 0;
+    }
+}
+
+// Runs one frame of the server; the same in both modes.
+// steps is the number of simulation ticks due (more than 1 after an overrun).
+static void pong_frame(uint32_t steps) {
+    uint64_t started = pong_clock_ns();
+    uint64_t traced = trace_now(), t;
+    uint64_t first = sim_ticks;
+    sim_ticks += steps;
+
+    // === Handle network events ===
+    // At the input rate; in between the matches keep applying the last input.
+    if (rate_due(first, steps, input_hz)) {
+        u32_t inputs = frame_inputs;
+        t = trace_now();
+        accept_ready();
+        poll_ready();
+        lobby_expire(sys_now());
+        recovered_expire(sys_now());
+        trace_loop(PONG_TRACE_INPUT, t, frame_inputs - inputs, 0);
+    }
+
+    int snapshot = rate_due(first, steps, snapshot_hz);
+    if (snapshot) snapshot_frames++;
+
+    // === Tick every running match ===
+    t = trace_now();
+    int stepped = active_match_count;
+    pong_pool_run(&pool, trace_on ? match_frame_traced : match_frame, &steps, active_match_count);
+    // Returns once every match has been stepped: the barrier before the broadcast.
+    trace_loop(PONG_TRACE_STEP, t, (uint32_t)stepped, 0);
+    if (trace_on) trace_workers();
+
+    // === Broadcast the results ===
+    t = trace_now();
+    uint32_t sent = 0;
+    uint64_t serializing = 0;
+    for (int i = 0; i < active_match_count; i++) {
+        Match *m = &matches[active_matches[i]];
+        int winner = m->frame_result;
+        if (winner < 0) continue;
+
+        if (m->journaled) match_journal_flush(m, 0);
+        // What the workers staged goes to the journal, one append per match.
+
+        if (snapshot || winner != 0) {
+            uint64_t s = trace_now();
+            match_send_state(m, winner != 0);
+            serializing += trace_now() - s;
+            sent++;
+        }
+        // Catch-up frames only need the final state to go out.
+
+        if (winner != 0) {
+            match_end(m, winner);
+            i--;
+            // match_end() moved the last active match into this position,
+            // so visit the same index again.
+        } else {
+            match_stats_update(m);
+        }
+    }
+    trace_loop(PONG_TRACE_BROADCAST, t, sent, serializing);
+
+    // === Send this frame's snapshots ===
+    t = trace_now();
+    uint32_t frames = (uint32_t)send_count;
+    fanout_run();
+    // One tcpip message for all recipients instead of one netconn_write() each.
+    trace_loop(PONG_TRACE_FANOUT, t, frames, 0);
+
+    if (snapshot) {
+        t = trace_now();
+        spectators_run();
+        trace_loop(PONG_TRACE_SPECTATORS, t, (uint32_t)spectating_count, 0);
+    }
+    // After the players, and without waiting for it to be written.
+
+    uint64_t work_ns = pong_clock_ns() - started;
+    load_update(work_ns, steps);
+    report_frame(work_ns);
+    metrics_frame(work_ns, steps);
+    trace_loop(PONG_TRACE_FRAME, traced, steps, 0);
+}
+
+// Main server loop executed in a separate thread.
+// Works as a reactor: each frame it accepts new players, serves the connections
+// the tcpip thread flagged as ready, then ticks every match. It never blocks on a socket.
+static void pong_thread(void *arg) {
+    srand(time(NULL)); 
+    // Seeds each match's own generator (varying serve angles) and the UDP tokens.
+
+    listener = netconn_new_with_callback(NETCONN_TCP, pong_netconn_event);
+    if (!listener) return;
+    // Create a new TCP connection object for listening. If allocation fails, exit.
+    // Accepted connections inherit the callback that tracks their pending input.
+
+    // Bind the listener to any local IP and the predefined port.
+    // Then set it to listen mode to accept incoming connections.
+    if (netconn_bind(listener, NULL, PORT) != ERR_OK || netconn_listen(listener) != ERR_OK) {
+        netconn_delete(listener);
+        return;
+    }
+
+    if (sys_sem_new(&fanout_done, 0) != ERR_OK) {
+        netconn_delete(listener);
+        return;
+    }
+
+    // === Initialize the connection and match tables ===
+    tables_init();
+    spectator_delay_clamp();
+    journal_start();
+    pong_mib_init();
+    trace_start();
+    pong_pool_init(&pool, pool_workers);
+
+    tcpip_callback(udp_channel_start, NULL);
+    // The UDP channel lives in the tcpip thread in both modes.
+
+    tick_scheduler_init(&sched, physics_hz, MAX_CATCHUP_TICKS);
+    // Frames run on absolute deadlines of a monotonic clock, so the work done
+    // in a frame doesn't stretch the frame period.
+    report_started = sys_now();
+
+    // === Main game loop ===
+    while (1) {
+        uint64_t t = trace_now();
+        uint32_t steps = tick_scheduler_wait(&sched);
+        trace_loop(PONG_TRACE_SLEEP, t, steps, 0);
+        // Normally 1; after an overrun the missed frames are simulated back-to-back
+        // (up to MAX_CATCHUP_TICKS) so the game keeps its fixed rate.
+
+        pong_frame(steps);
+    }
+}
+
+// === Raw API mode ===
+// The whole server runs inside the tcpip thread: the stack calls us back for every
+// event and a lwIP timer drives the frames, so not a single message crosses threads.
+// Received data is fed to the client right in the recv callback. Finished handshakes
+// and lost connections go through the ready ring as in netconn mode and are handled
+// by the next frame, so nothing gets closed from inside a callback of the same pcb.
+
+// Returns the reactor slot a raw callback argument refers to, -1 if detached.
+static int raw_slot(void *arg) {
+    return (int)(intptr_t)arg - 1;
+}
+
+// Marks a raw connection as lost for poll_ready(). rcv_pending has no other use
+// in raw mode, -1 stands for "the stack dropped or the peer closed this connection".
+static void raw_lost(int index) {
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    SYS_ARCH_PROTECT(lev);
+    rcv_pending[index] = -1;
+    ready_push(index);
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+// Received data, or NULL once the peer closed its side.
+static err_t raw_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    SYS_ARCH_DECL_PROTECT(lev);
+    int index = raw_slot(arg);
+    LWIP_UNUSED_ARG(err);
+
+    if (!p) {
+        if (index >= 0) raw_lost(index);
+        return ERR_OK;
+    }
+
+    if (index >= 0 && index < MAX_CLIENTS) {
+        Client *c = &clients[index];
+        lines_arrived = pong_clock_ns();
+        for (struct pbuf *q = p; q; q = q->next)
+            client_feed(c, q->payload, q->len);
+
+        if (c->lobby_pos >= 0 && c->id != 0) {
+            SYS_ARCH_PROTECT(lev);
+            ready_push(index);
+            SYS_ARCH_UNPROTECT(lev);
+            // The handshake is completed by the next frame.
+        }
+    }
+    // Whatever spectators send is dropped.
+
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+// Data acknowledged: release the frames it covered right away instead of at the next fan-out.
+static err_t raw_sent(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    int index = raw_slot(arg);
+    LWIP_UNUSED_ARG(len);
+
+    if (index >= MAX_CLIENTS) {
+        Spectator *s = &spectators[index - MAX_CLIENTS];
+        inflight_reap(s->inflight, SPECTATOR_INFLIGHT, &s->inflight_head, &s->inflight_count, pcb);
+    } else if (index >= 0) {
+        Client *c = &clients[index];
+        inflight_reap(c->inflight, MAX_INFLIGHT, &c->inflight_head, &c->inflight_count, pcb);
+    }
+    return ERR_OK;
+}
+
+// The stack dropped the connection (reset, timeout, or our own tcp_abort);
+// the pcb is already freed.
+static void raw_err(void *arg, err_t err) {
+    int index = raw_slot(arg);
+    LWIP_UNUSED_ARG(err);
+    if (index < 0) return;
+
+    if (index >= MAX_CLIENTS) spectators[index - MAX_CLIENTS].link.pcb = NULL;
+    else clients[index].link.pcb = NULL;
+    raw_lost(index);
+}
+
+// A new connection on the listening pcb.
+static err_t raw_accept(void *arg, struct tcp_pcb *pcb, err_t err) {
+    LWIP_UNUSED_ARG(arg);
+    LWIP_UNUSED_ARG(err);
+    tcp_accepted(listen_pcb);
+
+    tcp_recv(pcb, raw_recv);
+    tcp_sent(pcb, raw_sent);
+    tcp_err(pcb, raw_err);
+    tcp_nagle_disable(pcb);
+    // Frames are small and must leave right away, as with TCP_NODELAY on the client.
+
+    if (!client_accept((Link){ .pcb = pcb })) {
+        // If the server is full, reject connection.
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+}
+
+// Frame timer: runs the frames that are due and re-arms itself for the next deadline.
+// The deadlines come from the same tick scheduler as in netconn mode, so the ms
+// resolution of lwIP timers only delays a frame, it never makes the clock drift.
+static void raw_tick(void *arg) {
+    LWIP_UNUSED_ARG(arg);
+
+    uint32_t steps = tick_scheduler_poll(&sched);
+    if (steps > 0) pong_frame(steps);
+
+    sys_timeout(tick_scheduler_ms_left(&sched), raw_tick, NULL);
+}
+
+// Sets up the raw mode server, executed in the tcpip thread.
+static void raw_start(void *arg) {
+    LWIP_UNUSED_ARG(arg);
+
+    srand(time(NULL));
+    // Seeds each match's own generator (varying serve angles) and the UDP tokens.
+
+    struct tcp_pcb *pcb = tcp_new();
+    if (!pcb) return;
+    if (tcp_bind(pcb, IP_ADDR_ANY, PORT) != ERR_OK || !(listen_pcb = tcp_listen(pcb))) {
+        tcp_close(pcb);
+        return;
+    }
+    tcp_accept(listen_pcb, raw_accept);
+    udp_channel_start(NULL);
+
+    tables_init();
+    spectator_delay_clamp();
+    journal_start();
+    pong_mib_init();
+    trace_start();
+    pong_pool_init(&pool, pool_workers);
+    tick_scheduler_init(&sched, physics_hz, MAX_CATCHUP_TICKS);
+    report_started = sys_now();
+    sys_timeout(tick_scheduler_ms_left(&sched), raw_tick, NULL);
+}
+
+// Entry point to start the game logic thread from outside.
+// This function is called once at setup time to launch the server.
+void pong_init(void) {
+    server_started = 1;
+    sys_thread_new("pong_thread", pong_thread, NULL, DEFAULT_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
+    // Creates a new system thread named "pong_thread" to run the game logic.
+    // The stack size and priority are defined by LWIP's configuration.
+}
+
+// Alternative entry point: the same server on the raw TCP API, run by the tcpip thread.
+void pong_init_raw(void) {
+    server_started = 1;
+    raw_mode = 1;
+    tcpip_callback(raw_start, NULL);
+}
+
+// Sets the number of workers the matches are stepped on, counting the game
+// loop's own thread: 1 keeps everything on it, 0 (the default) uses every CPU.
+void pong_set_workers(unsigned int workers) {
+    if (setting_too_late("workers")) return;
+    pool_workers = (int)workers;
+}
+
+// Times the phases of every frame into rings of the given number of events
+// (0 disables it), before the server starts. The HTTP server (-H) serves them
+// as a Chrome trace.
+void pong_set_trace(unsigned int events) {
+    if (setting_too_late("trace")) return;
+    trace_events = events;
+}
+
+// Enables the periodic frame timing report (0 disables it).
+void pong_set_report_interval(unsigned int seconds) {
+    report_interval_ms = seconds * 1000;
 }
 
 #endif /* LWIP_NETCONN */
@@ -2,5 +2,12 @@
 #define __PONG_H__
 
 void pong_init(void);
+void pong_init_raw(void);
+void pong_set_rates(unsigned int physics_hz, unsigned int input_hz, unsigned int snapshot_hz);
+void pong_set_spectator_delay(unsigned int ms);
+void pong_set_workers(unsigned int workers);
+void pong_set_journal(const char *path, unsigned int max_mb);
+void pong_set_report_interval(unsigned int seconds);
+void pong_set_trace(unsigned int events);
 
 #endif /* __PONG_H__ */
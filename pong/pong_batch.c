@@ -0,0 +1,227 @@
+#include "pong_batch.h"
+#include "pong_proto.h"
+
+// === Vector backends ===
+// The step below is written once against these few operations on vectors of
+// int32 lanes. Masks are lanes of all ones (true) or zero (false).
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define LANES 8
+#define ISA "avx2"
+typedef __m256i vec;
+
+static inline vec v_load(const int32_t *p)        { return _mm256_loadu_si256((const __m256i *)p); }
+static inline void v_store(int32_t *p, vec a)     { _mm256_storeu_si256((__m256i *)p, a); }
+static inline vec v_set(int32_t n)                { return _mm256_set1_epi32(n); }
+static inline vec v_add(vec a, vec b)             { return _mm256_add_epi32(a, b); }
+static inline vec v_sub(vec a, vec b)             { return _mm256_sub_epi32(a, b); }
+static inline vec v_and(vec a, vec b)             { return _mm256_and_si256(a, b); }
+static inline vec v_or(vec a, vec b)              { return _mm256_or_si256(a, b); }
+static inline vec v_andnot(vec a, vec b)          { return _mm256_andnot_si256(a, b); }   // ~a & b
+static inline vec v_gt(vec a, vec b)              { return _mm256_cmpgt_epi32(a, b); }
+static inline vec v_eq(vec a, vec b)              { return _mm256_cmpeq_epi32(a, b); }
+static inline vec v_min(vec a, vec b)             { return _mm256_min_epi32(a, b); }
+static inline vec v_max(vec a, vec b)             { return _mm256_max_epi32(a, b); }
+static inline vec v_abs(vec a)                    { return _mm256_abs_epi32(a); }
+static inline vec v_sign(vec a, vec s)            { return _mm256_sign_epi32(a, s); }     // a with the sign of s
+static inline vec v_blend(vec a, vec b, vec m)    { return _mm256_blendv_epi8(a, b, m); } // m ? b : a
+static inline unsigned v_bits(vec m)              { return (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(m)); }
+
+// pong_fx_mul() of two non-negative values: 32x32 -> 64 bit products of the
+// even lanes, then of the odd ones, each keeping bits 16 to 47.
+static inline vec v_mul_fx(vec a, vec b) {
+    vec even = _mm256_srli_epi64(_mm256_mul_epu32(a, b), PONG_FX_SHIFT);
+    vec odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    odd = _mm256_slli_epi64(_mm256_srli_epi64(odd, PONG_FX_SHIFT), 32);
+    return _mm256_blend_epi32(even, odd, 0xaa);
+}
+
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+
+#define LANES 4
+#define ISA "sse4.1"
+typedef __m128i vec;
+
+static inline vec v_load(const int32_t *p)        { return _mm_loadu_si128((const __m128i *)p); }
+static inline void v_store(int32_t *p, vec a)     { _mm_storeu_si128((__m128i *)p, a); }
+static inline vec v_set(int32_t n)                { return _mm_set1_epi32(n); }
+static inline vec v_add(vec a, vec b)             { return _mm_add_epi32(a, b); }
+static inline vec v_sub(vec a, vec b)             { return _mm_sub_epi32(a, b); }
+static inline vec v_and(vec a, vec b)             { return _mm_and_si128(a, b); }
+static inline vec v_or(vec a, vec b)              { return _mm_or_si128(a, b); }
+static inline vec v_andnot(vec a, vec b)          { return _mm_andnot_si128(a, b); }
+static inline vec v_gt(vec a, vec b)              { return _mm_cmpgt_epi32(a, b); }
+static inline vec v_eq(vec a, vec b)              { return _mm_cmpeq_epi32(a, b); }
+static inline vec v_min(vec a, vec b)             { return _mm_min_epi32(a, b); }
+static inline vec v_max(vec a, vec b)             { return _mm_max_epi32(a, b); }
+static inline vec v_abs(vec a)                    { return _mm_abs_epi32(a); }
+static inline vec v_sign(vec a, vec s)            { return _mm_sign_epi32(a, s); }
+static inline vec v_blend(vec a, vec b, vec m)    { return _mm_blendv_epi8(a, b, m); }
+static inline unsigned v_bits(vec m)              { return (unsigned)_mm_movemask_ps(_mm_castsi128_ps(m)); }
+
+static inline vec v_mul_fx(vec a, vec b) {
+    vec even = _mm_srli_epi64(_mm_mul_epu32(a, b), PONG_FX_SHIFT);
+    vec odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    odd = _mm_slli_epi64(_mm_srli_epi64(odd, PONG_FX_SHIFT), 32);
+    return _mm_blend_epi16(even, odd, 0xcc);
+}
+
+#else
+
+#define LANES 1
+#define ISA "scalar"
+typedef int32_t vec;
+
+static inline vec v_load(const int32_t *p)        { return *p; }
+static inline void v_store(int32_t *p, vec a)     { *p = a; }
+static inline vec v_set(int32_t n)                { return n; }
+static inline vec v_add(vec a, vec b)             { return (vec)((uint32_t)a + (uint32_t)b); }
+static inline vec v_sub(vec a, vec b)             { return (vec)((uint32_t)a - (uint32_t)b); }
+static inline vec v_and(vec a, vec b)             { return a & b; }
+static inline vec v_or(vec a, vec b)              { return a | b; }
+static inline vec v_andnot(vec a, vec b)          { return ~a & b; }
+static inline vec v_gt(vec a, vec b)              { return -(a > b); }
+static inline vec v_eq(vec a, vec b)              { return -(a == b); }
+static inline vec v_min(vec a, vec b)             { return a < b ? a : b; }
+static inline vec v_max(vec a, vec b)             { return a > b ? a : b; }
+static inline vec v_abs(vec a)                    { return a < 0 ? -a : a; }
+static inline vec v_sign(vec a, vec s)            { return s < 0 ? -a : s ? a : 0; }
+static inline vec v_blend(vec a, vec b, vec m)    { return m ? b : a; }
+static inline unsigned v_bits(vec m)              { return (unsigned)m & 1; }
+
+static inline vec v_mul_fx(vec a, vec b) {
+    return (vec)(((uint64_t)(uint32_t)a * (uint32_t)b) >> PONG_FX_SHIFT);
+}
+
+#endif
+
+#if PONG_BATCH_MAX % LANES
+#error "PONG_BATCH_MAX must be a multiple of the vector width"
+#endif
+
+const char *pong_batch_isa(void) {
+    return ISA;
+}
+
+// === Slots ===
+
+static void lane_get(const PongBatch *b, int i, PongGame *g) {
+    g->ball = (PongBall){
+        .x = b->x[i], .y = b->y[i], .dx = b->dx[i], .dy = b->dy[i], .speed = b->speed[i],
+        .serve_timer = b->serve_timer[i], .out_ticks = b->out_ticks[i]
+    };
+    g->p1 = (PongPaddle){ b->p1_y[i], b->p1_input[i] };
+    g->p2 = (PongPaddle){ b->p2_y[i], b->p2_input[i] };
+    g->score1 = b->score1[i];
+    g->score2 = b->score2[i];
+    g->rng.state = b->rng[i];
+}
+
+static void lane_put(PongBatch *b, int i, const PongGame *g) {
+    b->x[i] = g->ball.x;
+    b->y[i] = g->ball.y;
+    b->dx[i] = g->ball.dx;
+    b->dy[i] = g->ball.dy;
+    b->speed[i] = g->ball.speed;
+    b->serve_timer[i] = g->ball.serve_timer;
+    b->out_ticks[i] = g->ball.out_ticks;
+    b->p1_y[i] = g->p1.y;
+    b->p1_input[i] = g->p1.input;
+    b->p2_y[i] = g->p2.y;
+    b->p2_input[i] = g->p2.input;
+    b->score1[i] = g->score1;
+    b->score2[i] = g->score2;
+    b->rng[i] = g->rng.state;
+}
+
+void pong_batch_put(PongBatch *b, int i, const PongGame *g) {
+    lane_put(b, i, g);
+    b->grace1[i] = b->grace2[i] = 0;
+    b->scored[i] = 0;
+}
+
+void pong_batch_get(const PongBatch *b, int i, PongGame *g) {
+    lane_get(b, i, g);
+}
+
+// Steps the ball of one game the scalar way, its paddles having moved already.
+static int lane_step_ball(PongBatch *b, int i, uint32_t ticks, uint32_t hz, int serve_ticks) {
+    PongGame g;
+    const int grace[2] = { b->grace1[i], b->grace2[i] };
+
+    lane_get(b, i, &g);
+    int scorer = pong_game_step_ball(&g, ticks, hz, serve_ticks, grace);
+    lane_put(b, i, &g);
+    b->scored[i] = scorer;
+    return scorer != 0;
+}
+
+// === Step ===
+
+// Moves a vector of paddles by rows in the direction of their inputs, clamped to the field.
+static inline vec move_paddles(vec y, vec input, vec rows) {
+    y = v_sub(y, v_and(v_eq(input, v_set(PONG_INPUT_UP)), rows));
+    y = v_add(y, v_and(v_eq(input, v_set(PONG_INPUT_DOWN)), rows));
+    return v_min(v_max(y, v_set(0)), v_set(PONG_FIELD_HEIGHT - PONG_PADDLE_HEIGHT));
+}
+
+int pong_batch_step(PongBatch *b, uint32_t tick, uint32_t ticks, uint32_t hz, int serve_ticks) {
+    int rows = 0;
+    for (uint32_t t = 0; t < ticks; t++) rows += pong_paddle_rows(tick + t, hz);
+    // Paddles move one row per base tick, whatever the simulation rate.
+
+    const vec zero = v_set(0), ones = v_set(-1);
+    const vec v_rows = v_set(rows), dt = v_set(pong_fx_tick(hz) * (pong_fx)ticks);
+    const vec bottom = v_set(PONG_FX_INT(PONG_FIELD_HEIGHT - 1));
+    const vec face1 = v_set(PONG_FX_INT(PONG_PADDLE_OFFSET_X + PONG_PADDLE_WIDTH));
+    const vec face2 = v_set(PONG_FX_INT(PONG_FIELD_WIDTH - PONG_PADDLE_OFFSET_X - PONG_PADDLE_WIDTH));
+    const vec single = ticks == 1 ? ones : zero;
+    // Same values as pong_ball_step().
+    int points = 0;
+
+    for (int i = 0; i < b->count; i += LANES) {
+        // === Paddles ===
+        v_store(b->p1_y + i, move_paddles(v_load(b->p1_y + i), v_load(b->p1_input + i), v_rows));
+        v_store(b->p2_y + i, move_paddles(v_load(b->p2_y + i), v_load(b->p2_input + i), v_rows));
+
+        vec x = v_load(b->x + i), y = v_load(b->y + i);
+        vec dx = v_load(b->dx + i), dy = v_load(b->dy + i);
+        vec timer = v_load(b->serve_timer + i);
+
+        // === Ball in free flight ===
+        // Distance the ball covers this step along each axis, as pong_fx_mul()
+        // computes it: truncated toward zero, so the sign can go on afterwards.
+        vec ax = v_mul_fx(v_abs(dx), dt), ay = v_mul_fx(v_abs(dy), dt);
+
+        vec outside = v_or(v_gt(face1, x), v_gt(x, face2));
+        vec events = outside;
+        events = v_or(events, v_andnot(v_gt(y, ay), v_gt(zero, dy)));                   // Top edge in reach
+        events = v_or(events, v_andnot(v_gt(v_sub(bottom, y), ay), v_gt(dy, zero)));    // Bottom edge
+        events = v_or(events, v_andnot(v_gt(v_sub(x, face1), ax), v_gt(zero, dx)));     // Paddle 1's face
+        events = v_or(events, v_andnot(v_gt(v_sub(face2, x), ax), v_gt(dx, zero)));     // Paddle 2's face
+        // Conservative: a lane flagged here may still fly freely, but one that
+        // isn't flagged hits nothing in the whole step, so moving it in a
+        // straight line is exactly what the sweep would do.
+
+        vec serving = v_gt(timer, zero);
+        vec flying = v_andnot(v_or(serving, events), ones);
+        vec waiting = v_and(v_andnot(outside, serving), single);
+        // A single tick of a serve countdown only decrements the timer.
+
+        v_store(b->x + i, v_blend(x, v_add(x, v_sign(ax, dx)), flying));
+        v_store(b->y + i, v_blend(y, v_add(y, v_sign(ay, dy)), flying));
+        v_store(b->serve_timer + i, v_add(timer, waiting));
+        v_store(b->scored + i, zero);
+
+        // === Everything else ===
+        unsigned rest = ~v_bits(v_or(flying, waiting)) & ((1u << LANES) - 1);
+        for (int l = 0; l < LANES && i + l < b->count; l++)
+            if (rest & (1u << l)) points += lane_step_ball(b, i + l, ticks, hz, serve_ticks);
+        // Bounces, paddle hits, points and multi-tick serves are rare enough
+        // to take the scalar path.
+    }
+    return points;
+}
@@ -0,0 +1,55 @@
+#ifndef __PONG_BATCH_H__
+#define __PONG_BATCH_H__
+
+#include <stdint.h>
+#include "pong_game.h"
+
+// === Batch simulation of many matches ===
+//
+// The state of up to PONG_BATCH_MAX games laid out as one array per field
+// (structure of arrays), so a tick can be computed for a whole vector of
+// matches at once: 8 per instruction with AVX2, 4 with SSE4.1, one at a time
+// otherwise, picked at compile time.
+//
+// Most ticks the ball just flies: that case, the paddles and the serve
+// countdown are computed for every lane with branch-free masks. The lanes
+// where something happens (a bounce, a paddle in reach, a ball out of the
+// field) are handed to pong_game_step_ball() one by one. The results are
+// bit-identical to pong_game_step() on each game.
+
+#define PONG_BATCH_MAX 16384   // Games a batch holds (a multiple of every vector width)
+
+typedef struct {
+    // Ball
+    pong_fx x[PONG_BATCH_MAX], y[PONG_BATCH_MAX];
+    pong_fx dx[PONG_BATCH_MAX], dy[PONG_BATCH_MAX];
+    pong_fx speed[PONG_BATCH_MAX];
+    int32_t serve_timer[PONG_BATCH_MAX];
+    int32_t out_ticks[PONG_BATCH_MAX];
+
+    // Paddles
+    int32_t p1_y[PONG_BATCH_MAX], p2_y[PONG_BATCH_MAX];
+    int32_t p1_input[PONG_BATCH_MAX], p2_input[PONG_BATCH_MAX];   // PONG_INPUT_*, set by the caller
+
+    // Score
+    int32_t score1[PONG_BATCH_MAX], score2[PONG_BATCH_MAX];
+    int32_t grace1[PONG_BATCH_MAX], grace2[PONG_BATCH_MAX];       // See pong_game_step(), set by the caller
+    int32_t scored[PONG_BATCH_MAX];   // Player who scored in the last step (1 or 2), or 0
+    uint32_t rng[PONG_BATCH_MAX];
+
+    int count;                        // Games in use, indexes 0 to count - 1
+} PongBatch;
+
+// Copies a game into slot i of the batch, or out of it. pong_batch_put()
+// resets the slot's grace to 0 ticks.
+void pong_batch_put(PongBatch *b, int i, const PongGame *g);
+void pong_batch_get(const PongBatch *b, int i, PongGame *g);
+
+// Simulates ticks ticks of every game in the batch, as pong_game_step() would.
+// Returns the number of points scored, the scored[] of those games tells by whom.
+int pong_batch_step(PongBatch *b, uint32_t tick, uint32_t ticks, uint32_t hz, int serve_ticks);
+
+// Instruction set the batch step was compiled for: "avx2", "sse4.1" or "scalar".
+const char *pong_batch_isa(void);
+
+#endif /* __PONG_BATCH_H__ */
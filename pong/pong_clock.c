@@ -0,0 +1,99 @@
+#include "pong_clock.h"
+
+#include <time.h>
+#include <errno.h>
+
+#define NS_PER_SEC 1000000000ULL
+#define DEFAULT_SPIN_NS 200000ULL   // Typical sleep overshoot on a desktop kernel (0.2 ms)
+
+// Reads the monotonic clock in nanoseconds.
+uint64_t pong_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+// Sleeps until the given absolute monotonic time.
+static void sleep_until(uint64_t deadline) {
+    struct timespec ts = {
+        .tv_sec = deadline / NS_PER_SEC,
+        .tv_nsec = deadline % NS_PER_SEC
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+    // An absolute deadline lets us simply retry after a signal without drifting.
+}
+
+// Prepares a scheduler running at hz ticks per second, starting now.
+void tick_scheduler_init(TickScheduler *s, uint32_t hz, uint32_t max_catchup) {
+    s->period_ns = NS_PER_SEC / hz;
+    s->spin_ns = DEFAULT_SPIN_NS;
+    s->max_catchup = max_catchup;
+    s->next_deadline = pong_clock_ns() + s->period_ns;
+    s->ticks = s->late_ticks = s->skipped_ticks = 0;
+}
+
+// Handles a deadline that had already passed when the caller asked for it:
+// the missed ticks are either replayed or dropped.
+static uint32_t tick_scheduler_overrun(TickScheduler *s, uint64_t now) {
+    s->late_ticks++;
+    uint64_t behind = (now - s->next_deadline) / s->period_ns;
+    // Number of whole ticks missed on top of the one that is due now.
+
+    if (behind <= s->max_catchup) {
+        // Catch up: replay the missed ticks right away and keep the original timeline.
+        uint32_t run = (uint32_t)behind + 1;
+        s->next_deadline += run * s->period_ns;
+        s->ticks += run;
+        return run;
+    }
+
+    // Skip: too far behind to catch up without stalling again, so drop the
+    // missed ticks and restart the timeline from now.
+    s->skipped_ticks += behind;
+    s->next_deadline = now + s->period_ns;
+    s->ticks++;
+    return 1;
+}
+
+uint32_t tick_scheduler_wait(TickScheduler *s) {
+    uint64_t now = pong_clock_ns();
+
+    if (now < s->next_deadline) {
+        // === On time: hybrid sleep ===
+        // Sleep for the bulk of the wait, then spin through the last few hundred
+        // microseconds, which the kernel's timer slack would otherwise overshoot.
+        if (s->next_deadline - now > s->spin_ns)
+            sleep_until(s->next_deadline - s->spin_ns);
+        while (pong_clock_ns() < s->next_deadline)
+            ;
+
+        s->next_deadline += s->period_ns;
+        s->ticks++;
+        return 1;
+    }
+
+    // === Overrun: the previous tick ended after this deadline ===
+    return tick_scheduler_overrun(s, now);
+}
+
+uint32_t tick_scheduler_poll(TickScheduler *s) {
+    uint64_t now = pong_clock_ns();
+
+    if (now < s->next_deadline) return 0;
+
+    if (now - s->next_deadline < s->period_ns) {
+        // A timer always fires a little after its deadline; within the same
+        // period that is still on time.
+        s->next_deadline += s->period_ns;
+        s->ticks++;
+        return 1;
+    }
+    return tick_scheduler_overrun(s, now);
+}
+
+uint32_t tick_scheduler_ms_left(const TickScheduler *s) {
+    uint64_t now = pong_clock_ns();
+    if (now >= s->next_deadline) return 0;
+    return (uint32_t)((s->next_deadline - now + 999999) / 1000000);
+}
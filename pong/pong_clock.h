@@ -0,0 +1,37 @@
+#ifndef __PONG_CLOCK_H__
+#define __PONG_CLOCK_H__
+
+#include <stdint.h>
+
+// === Monotonic clock ===
+// Nanoseconds from an arbitrary fixed point, never affected by wall clock changes.
+uint64_t pong_clock_ns(void);
+
+// === Fixed-timestep tick scheduler ===
+// Ticks are scheduled on absolute deadlines (start + n * period), so the time
+// spent working inside a tick never shifts the ones after it.
+typedef struct {
+    uint64_t period_ns;       // Length of one tick
+    uint64_t spin_ns;         // Final stretch before a deadline that is busy-waited instead of slept
+    uint64_t next_deadline;   // Absolute time the next tick is due
+    uint32_t max_catchup;     // Max missed ticks replayed back-to-back before giving up on them
+
+    uint64_t ticks;           // Ticks handed out so far (including catch-up ticks)
+    uint64_t late_ticks;      // Times the loop reached a deadline after it had passed
+    uint64_t skipped_ticks;   // Ticks dropped because the loop fell too far behind
+} TickScheduler;
+
+void tick_scheduler_init(TickScheduler *s, uint32_t hz, uint32_t max_catchup);
+
+// Waits for the next deadline and returns how many ticks the caller must run now:
+// 1 when on time, more when catching up after an overrun.
+uint32_t tick_scheduler_wait(TickScheduler *s);
+
+// Non-blocking variant for callers driven by an external timer: returns the
+// number of ticks due now (0 if the next deadline hasn't come yet).
+uint32_t tick_scheduler_poll(TickScheduler *s);
+
+// Milliseconds until the next deadline, rounded up, for arming that timer.
+uint32_t tick_scheduler_ms_left(const TickScheduler *s);
+
+#endif /* __PONG_CLOCK_H__ */
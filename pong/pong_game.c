@@ -0,0 +1,82 @@
+#include "pong_game.h"
+#include "pong_proto.h"
+
+// Ensures that the paddle's vertical position stays within the boundaries of the game field.
+static void clamp_paddle(PongPaddle *p) {
+    if (p->y < 0) p->y = 0;
+    // If the paddle is above the top edge (y < 0), clamp it to the top.
+
+    if (p->y > PONG_FIELD_HEIGHT - PONG_PADDLE_HEIGHT)
+        p->y = PONG_FIELD_HEIGHT - PONG_PADDLE_HEIGHT;
+    // If the bottom of the paddle exceeds the bottom of the field,
+    // clamp it so its bottom aligns with the bottom edge.
+}
+
+static void move_paddle(PongPaddle *p, int rows) {
+    if (p->input == PONG_INPUT_UP)   p->y -= rows;
+    if (p->input == PONG_INPUT_DOWN) p->y += rows;
+    clamp_paddle(p);
+}
+
+void pong_game_reset(PongGame *g, uint32_t seed, int serve_ticks) {
+    g->p1 = (PongPaddle){PONG_FIELD_HEIGHT / 2 - PONG_PADDLE_HEIGHT / 2, PONG_INPUT_NONE};
+    g->p2 = (PongPaddle){PONG_FIELD_HEIGHT / 2 - PONG_PADDLE_HEIGHT / 2, PONG_INPUT_NONE};
+    // Both paddles start centered vertically, with no input.
+
+    g->score1 = g->score2 = 0;
+    pong_rng_seed(&g->rng, seed);
+    pong_ball_serve(&g->ball, &g->rng, 1, serve_ticks);
+    // Start the game with player 1 serving.
+}
+
+int pong_game_step(PongGame *g, uint32_t tick, uint32_t ticks, uint32_t hz,
+                   int serve_ticks, const int grace[2]) {
+    // === Update paddle positions based on input ===
+    int rows = 0;
+    for (uint32_t t = 0; t < ticks; t++) rows += pong_paddle_rows(tick + t, hz);
+    // Paddles move one row per base tick, whatever the simulation rate.
+    move_paddle(&g->p1, rows);
+    move_paddle(&g->p2, rows);
+
+    return pong_game_step_ball(g, ticks, hz, serve_ticks, grace);
+}
+
+int pong_game_step_ball(PongGame *g, uint32_t ticks, uint32_t hz, int serve_ticks, const int grace[2]) {
+    PongBall *ball = &g->ball;
+
+    // === Move the ball and bounce it off the edges and paddles ===
+    uint32_t moving = ticks;
+    while (moving > 1 && ball->serve_timer > 0) {
+        ball->serve_timer--;
+        moving--;
+    }
+    // Ticks spent waiting for the serve don't move the ball (pong_ball_step
+    // counts down the last one itself).
+    pong_ball_step(ball, g->p1.y, g->p2.y, pong_fx_tick(hz) * (pong_fx)moving);
+
+    // === Scoring ===
+    // A ball that left the field keeps flying for the grace ticks of the player
+    // who missed it, so a late input that would have hit it can still undo the miss.
+    if (ball->x < 0) {
+        // If the ball exits the field on the left side, player 2 scores.
+        if ((ball->out_ticks += (int)ticks) > grace[0]) {
+            g->score2++;
+            pong_ball_serve(ball, &g->rng, 1, serve_ticks); // Restart the ball with player 1 serving.
+            return 2;
+        }
+    } else if (ball->x > PONG_FX_INT(PONG_FIELD_WIDTH)) {
+        // If the ball exits the field on the right side, player 1 scores.
+        if ((ball->out_ticks += (int)ticks) > grace[1]) {
+            g->score1++;
+            pong_ball_serve(ball, &g->rng, 2, serve_ticks); // Restart the ball with player 2 serving.
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int pong_game_winner(const PongGame *g) {
+    if (g->score1 >= PONG_WIN_SCORE) return 1;
+    if (g->score2 >= PONG_WIN_SCORE) return 2;
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef __PONG_GAME_H__
+#define __PONG_GAME_H__
+
+#include <stdint.h>
+#include "pong_physics.h"
+
+// === Headless match simulation ===
+//
+// One match as the server simulates it: paddles driven by their inputs, the
+// ball, the score and the serve. No networking and no clock, so it can be
+// stepped from the server's game loop, a benchmark or a test harness alike.
+
+#define PONG_WIN_SCORE 11      // Points needed to win a match
+
+typedef struct {
+    int y;             // Paddle row
+    int input;         // PONG_INPUT_* the paddle moves with
+} PongPaddle;
+
+typedef struct {
+    PongPaddle p1, p2;
+    PongBall ball;
+    int score1, score2;
+    PongRng rng;       // Serve angles, seeded per match
+} PongGame;
+
+// Puts a game back into its initial state: centered paddles with no input,
+// no score, player 1 serving after serve_ticks.
+void pong_game_reset(PongGame *g, uint32_t seed, int serve_ticks);
+
+// Simulates ticks ticks of a game running at hz, the first of them being tick
+// (paddle rows depend on it, see pong_paddle_rows). Several ticks cost as much
+// as one: the swept ball path covers them all.
+// A ball past a paddle only scores once it has been out for more than
+// grace[player - 1] ticks, player being the one who missed it; the ball is then
+// served again after serve_ticks.
+// Returns the player who scored (1 or 2), or 0.
+int pong_game_step(PongGame *g, uint32_t tick, uint32_t ticks, uint32_t hz,
+                   int serve_ticks, const int grace[2]);
+
+// The ball and scoring half of pong_game_step(), for callers that have moved
+// the paddles already (see pong_batch.h).
+int pong_game_step_ball(PongGame *g, uint32_t ticks, uint32_t hz, int serve_ticks, const int grace[2]);
+
+// Returns the winner of the game (1 or 2) once a player has PONG_WIN_SCORE
+// points, or 0 while it goes on.
+int pong_game_winner(const PongGame *g);
+
+#endif /* __PONG_GAME_H__ */
@@ -0,0 +1,114 @@
+#include "pong_http.h"
+#include "pong_metrics.h"
+#include "pong_trace.h"
+#include "lwip/opt.h"
+
+#if LWIP_NETCONN
+
+#include "lwip/sys.h"
+#include "lwip/api.h"
+#include <stdlib.h>
+#include <string.h>
+
+// === HTTP server ===
+// Forked from the netconn HTTP server of lwip-contrib (httpserver-netconn.c): one
+// connection at a time on port 80, with the pong server's metrics added:
+//
+//   GET /metrics.json   JSON, for people and scripts
+//   GET /metrics        Prometheus text format, for scrapers
+//   GET /trace.json     Chrome trace of the last frames, when the profiler is on (-X)
+//   GET /               The index page, linking them
+//
+// Pages are rendered from pong_metrics, never from the game's own tables:
+// a scrape costs the game loop nothing.
+
+#define HTTP_PORT 80
+#define HTTP_PAGE_MAX 32768                // Largest rendered page
+
+static const char http_html_hdr[] = "HTTP/1.0 200 OK\r\nContent-type: text/html\r\n\r\n";
+static const char http_json_hdr[] = "HTTP/1.0 200 OK\r\nContent-type: application/json\r\n\r\n";
+static const char http_text_hdr[] = "HTTP/1.0 200 OK\r\nContent-type: text/plain; version=0.0.4\r\n\r\n";
+static const char http_404[] = "HTTP/1.0 404 Not Found\r\nContent-type: text/plain\r\n\r\nNot found\n";
+static const char http_no_trace[] =
+    "HTTP/1.0 404 Not Found\r\nContent-type: text/plain\r\n\r\nThe profiler is off: start the server with -X <events>\n";
+static const char http_index_html[] =
+    "<html><head><title>pong server</title></head><body><h1>pong server</h1><ul>"
+    "<li><a href=\"/metrics.json\">/metrics.json</a>: live metrics, JSON</li>"
+    "<li><a href=\"/metrics\">/metrics</a>: live metrics, Prometheus text format</li>"
+    "<li><a href=\"/trace.json\">/trace.json</a>: trace of the last frames, when the profiler is on (-X)</li>"
+    "</ul></body></html>";
+
+static char page[HTTP_PAGE_MAX];           // Only the HTTP thread renders pages
+
+// Whether the request line asks for the given path.
+static int http_path_is(const char *buf, u16_t len, const char *path) {
+    size_t n = strlen(path);
+    return len >= 4 + n + 1 && memcmp(buf + 4, path, n) == 0 && (buf[4 + n] == ' ' || buf[4 + n] == '?');
+}
+
+// Serves the one request of a connection, then closes it.
+static void http_serve(struct netconn *conn) {
+    struct netbuf *inbuf;
+    char *buf;
+    u16_t buflen;
+
+    if (netconn_recv(conn, &inbuf) != ERR_OK) return;
+    netbuf_data(inbuf, (void **)&buf, &buflen);
+    // The request line arrives in the first segment, which is all we look at.
+
+    if (buflen >= 5 && memcmp(buf, "GET /", 5) == 0) {
+        if (http_path_is(buf, buflen, "/metrics.json")) {
+            size_t len = pong_metrics_json(&pong_metrics, page, sizeof(page));
+            netconn_write(conn, http_json_hdr, sizeof(http_json_hdr) - 1, NETCONN_NOCOPY);
+            netconn_write(conn, page, len, NETCONN_COPY);
+        } else if (http_path_is(buf, buflen, "/metrics")) {
+            size_t len = pong_metrics_prometheus(&pong_metrics, page, sizeof(page));
+            netconn_write(conn, http_text_hdr, sizeof(http_text_hdr) - 1, NETCONN_NOCOPY);
+            netconn_write(conn, page, len, NETCONN_COPY);
+        } else if (http_path_is(buf, buflen, "/trace.json")) {
+            char *trace;
+            size_t len = pong_trace_json(&pong_trace, &trace);
+            if (trace) {
+                netconn_write(conn, http_json_hdr, sizeof(http_json_hdr) - 1, NETCONN_NOCOPY);
+                netconn_write(conn, trace, len, NETCONN_COPY);
+                free(trace);
+            } else {
+                netconn_write(conn, http_no_trace, sizeof(http_no_trace) - 1, NETCONN_NOCOPY);
+            }
+            // Rendered on demand from a copy of the rings: the game loop keeps writing them.
+        } else if (http_path_is(buf, buflen, "/") || http_path_is(buf, buflen, "/index.html")) {
+            netconn_write(conn, http_html_hdr, sizeof(http_html_hdr) - 1, NETCONN_NOCOPY);
+            netconn_write(conn, http_index_html, sizeof(http_index_html) - 1, NETCONN_NOCOPY);
+        } else {
+            netconn_write(conn, http_404, sizeof(http_404) - 1, NETCONN_NOCOPY);
+        }
+    }
+
+    netconn_close(conn);
+    netbuf_delete(inbuf);
+}
+
+static void http_thread(void *arg) {
+    struct netconn *conn, *newconn;
+    LWIP_UNUSED_ARG(arg);
+
+    conn = netconn_new(NETCONN_TCP);
+    if (!conn) return;
+    if (netconn_bind(conn, NULL, HTTP_PORT) != ERR_OK || netconn_listen(conn) != ERR_OK) {
+        netconn_delete(conn);
+        return;
+    }
+
+    while (netconn_accept(conn, &newconn) == ERR_OK) {
+        http_serve(newconn);
+        netconn_delete(newconn);
+    }
+    netconn_delete(conn);
+}
+
+// Starts the HTTP server in a thread of its own.
+void pong_http_init(void) {
+    sys_thread_new("pong_http", http_thread, NULL, DEFAULT_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
+}
+
+#endif /* LWIP_NETCONN */
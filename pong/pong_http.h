@@ -0,0 +1,6 @@
+#ifndef __PONG_HTTP_H__
+#define __PONG_HTTP_H__
+
+void pong_http_init(void);
+
+#endif /* __PONG_HTTP_H__ */
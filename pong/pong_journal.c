@@ -0,0 +1,417 @@
+#include "pong_journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define JOURNAL_MAGIC "PONGJRN1"
+#define JOURNAL_MAGIC_SIZE 8
+#define JOURNAL_SEGMENT (4u << 20)      // File allocated ahead of the writer at a time
+#define JOURNAL_HELPER_MS 50            // Period of the helper thread
+#define JOURNAL_PAGE 4096
+
+// === Records ===
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// Reads a varint of at most 5 bytes. Returns NULL if it runs past end or is too long.
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *v) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        value |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = value;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+size_t pong_journal_start(uint8_t *out, uint32_t slot, uint32_t tick, uint32_t seed, uint32_t hz, uint32_t serve_ticks) {
+    uint8_t *p = out;
+    *p++ = PONG_JOURNAL_START;
+    p = put_varint(p, slot);
+    p = put_varint(p, tick);
+    p = put_varint(p, seed);
+    p = put_varint(p, hz);
+    p = put_varint(p, serve_ticks);
+    return (size_t)(p - out);
+}
+
+// Whether a kind carries a value after its tick delta.
+static int kind_has_value(int kind) {
+    return kind != PONG_JOURNAL_SYNC && kind != PONG_JOURNAL_LOST;
+}
+
+size_t pong_journal_event(uint8_t *out, int kind, uint32_t slot, uint32_t delta, uint32_t value) {
+    uint8_t *p = out;
+    *p++ = (uint8_t)kind;
+    p = put_varint(p, slot);
+    p = put_varint(p, delta);
+    if (kind_has_value(kind)) p = put_varint(p, value);
+    return (size_t)(p - out);
+}
+
+// === Replay ===
+
+typedef struct {
+    PongReplay **slots;       // Matches open in each slot, allocated on first use
+    PongReplayFn fn;
+    void *ctx;
+    size_t offset;            // Offset of the record being applied
+} Replayer;
+
+// Simulates a match up to the start of the given tick. Steps are the ones the
+// server took, so a STEP that would jump over a record means records are missing.
+static void replay_advance(PongReplay *r, uint32_t tick) {
+    while (!r->lost && (int32_t)(tick - r->tick) > 0) {
+        uint32_t ticks = r->step_ticks;
+        if ((int32_t)(tick - r->tick - ticks) < 0) {
+            r->lost = 1;
+            return;
+        }
+        pong_game_step(&r->game, r->tick, ticks, r->hz, r->serve_ticks, r->grace);
+        r->tick += ticks;
+        r->step_ticks = 1;
+    }
+}
+
+// Hands a match over to the callback and frees its slot.
+static void replay_finish(Replayer *rp, PongReplay *r) {
+    if (rp->fn) rp->fn(rp->ctx, r);
+    rp->slots[r->slot] = NULL;
+    free(r);
+}
+
+// Applies one record. Returns 0 if it doesn't make sense.
+static int replay_record(Replayer *rp, int kind, uint32_t slot, uint32_t tick, const uint32_t *v) {
+    PongReplay *r = rp->slots[slot];
+
+    if (kind == PONG_JOURNAL_START) {
+        if (v[1] == 0) return 0;
+        if (r) {
+            r->lost = 1;
+            replay_finish(rp, r);
+        }
+        // The slot was reused without its match ending in the journal.
+
+        r = calloc(1, sizeof(*r));
+        if (!r) return 0;
+        r->slot = slot;
+        r->start_offset = rp->offset;
+        r->start_tick = r->tick = r->last = tick;
+        r->hz = v[1];
+        r->serve_ticks = (int)v[2];
+        r->step_ticks = 1;
+        pong_game_reset(&r->game, v[0], r->serve_ticks);
+        rp->slots[slot] = r;
+        return 1;
+    }
+    if (!r) return 1;
+    // A match whose start is older than the journal: nothing to do with it.
+
+    r->last = tick;
+    replay_advance(r, tick);
+
+    switch (kind) {
+    case PONG_JOURNAL_INPUT1:
+    case PONG_JOURNAL_INPUT2:
+        if (v[0] > 2) return 0;
+        if (kind == PONG_JOURNAL_INPUT1) r->game.p1.input = (int)v[0];
+        else r->game.p2.input = (int)v[0];
+        break;
+    case PONG_JOURNAL_GRACE1:
+    case PONG_JOURNAL_GRACE2:
+        r->grace[kind - PONG_JOURNAL_GRACE1] = (int)v[0];
+        break;
+    case PONG_JOURNAL_RESUME1:
+    case PONG_JOURNAL_RESUME2:
+        r->resume[kind - PONG_JOURNAL_RESUME1] = v[0];
+        break;
+    case PONG_JOURNAL_STEP:
+        if (v[0] == 0) return 0;
+        r->step_ticks = v[0];
+        break;
+    case PONG_JOURNAL_END:
+    case PONG_JOURNAL_ABORT:
+        r->ended = 1;
+        r->winner = (int)v[0];
+        r->mismatch = !r->lost && pong_game_winner(&r->game) != (kind == PONG_JOURNAL_END ? r->winner : 0);
+        // Points decide an END; an ABORT comes before anyone had enough of them.
+        replay_finish(rp, r);
+        break;
+    case PONG_JOURNAL_LOST:
+        r->lost = 1;
+        replay_finish(rp, r);
+        break;
+    }
+    return 1;
+}
+
+// Decodes the record at p. Returns the end of it, or NULL at the end of the
+// records: zero bytes, garbage, or a record cut short by the end of the data
+// (one that was being written).
+static const uint8_t *record_parse(const uint8_t *p, const uint8_t *end, int *kind, uint32_t *slot,
+                                   uint32_t *tick, uint32_t *v) {
+    *kind = *p;
+    if (*kind == PONG_JOURNAL_NONE || *kind >= PONG_JOURNAL_KINDS) return NULL;
+
+    const uint8_t *q = get_varint(p + 1, end, slot);
+    if (q) q = get_varint(q, end, tick);
+    if (*kind == PONG_JOURNAL_START)
+        for (int i = 0; i < 3 && q; i++) q = get_varint(q, end, &v[i]);
+    else if (q && kind_has_value(*kind))
+        q = get_varint(q, end, &v[0]);
+    return q && *slot < PONG_JOURNAL_MAX_SLOTS ? q : NULL;
+}
+
+size_t pong_journal_replay(const uint8_t *data, size_t len, PongReplayFn fn, void *ctx) {
+    Replayer rp = { calloc(PONG_JOURNAL_MAX_SLOTS, sizeof(PongReplay *)), fn, ctx, 0 };
+    if (!rp.slots) return 0;
+
+    const uint8_t *p = data, *end = data + len;
+    while (p < end) {
+        int kind;
+        uint32_t slot, tick, v[3] = {0, 0, 0};
+        const uint8_t *q = record_parse(p, end, &kind, &slot, &tick, v);
+        if (!q) break;
+
+        if (kind != PONG_JOURNAL_START && rp.slots[slot]) tick += rp.slots[slot]->last;
+        rp.offset = (size_t)(p - data);
+        if (!replay_record(&rp, kind, slot, tick, v)) break;
+        p = q;
+    }
+
+    for (uint32_t s = 0; s < PONG_JOURNAL_MAX_SLOTS; s++) {
+        PongReplay *r = rp.slots[s];
+        if (!r) continue;
+        r->open = !r->lost;
+        replay_finish(&rp, r);
+    }
+    // Matches still running when the journal stops, in slot order.
+
+    free(rp.slots);
+    return (size_t)(p - data);
+}
+
+// === Compaction ===
+
+// Notes where each match still open at the end of a journal starts.
+static void compact_note(void *ctx, const PongReplay *r) {
+    size_t *from = ctx;
+    if (r->open) from[r->slot] = r->start_offset;
+}
+
+// Rewrites a journal with only the records of the matches still open in it,
+// from their START on, and puts it in place of the old one with a rename.
+// Ended, aborted and lost matches go: what a journal holds after a restart is
+// what the restart restores, never the whole history. Returns 0 if it
+// couldn't be rewritten (or isn't a journal); the old file is then left as it is.
+static int journal_compact(const char *path, int fd, size_t size) {
+    uint8_t *old = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (old == MAP_FAILED) return 0;
+    if (size < JOURNAL_MAGIC_SIZE || memcmp(old, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) != 0) {
+        munmap(old, size);
+        return 0;
+    }
+
+    size_t *from = malloc(PONG_JOURNAL_MAX_SLOTS * sizeof(size_t));
+    char *tmp = malloc(strlen(path) + 5);
+    FILE *out = NULL;
+    int ok = 0;
+    if (!from || !tmp) goto done;
+    for (uint32_t s = 0; s < PONG_JOURNAL_MAX_SLOTS; s++) from[s] = SIZE_MAX;
+
+    const uint8_t *data = old + JOURNAL_MAGIC_SIZE;
+    size_t len = pong_journal_replay(data, size - JOURNAL_MAGIC_SIZE, compact_note, from);
+
+    strcpy(tmp, path);
+    strcat(tmp, ".tmp");
+    out = fopen(tmp, "wb");
+    if (!out) goto done;
+    fwrite(JOURNAL_MAGIC, 1, JOURNAL_MAGIC_SIZE, out);
+
+    for (const uint8_t *p = data, *q; p < data + len; p = q) {
+        int kind;
+        uint32_t slot, tick, v[3];
+        q = record_parse(p, data + len, &kind, &slot, &tick, v);
+        if (!q) break;
+        if (from[slot] != SIZE_MAX && (size_t)(p - data) >= from[slot]) fwrite(p, 1, (size_t)(q - p), out);
+    }
+    // Tick deltas are per match, so keeping all of a match's records from its
+    // START keeps them right, whatever went in between.
+
+    ok = fflush(out) == 0 && fsync(fileno(out)) == 0;
+    ok = fclose(out) == 0 && ok;
+    out = NULL;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) unlink(tmp);
+
+done:
+    if (out) {
+        fclose(out);
+        unlink(tmp);
+    }
+    free(tmp);
+    free(from);
+    munmap(old, size);
+    return ok;
+}
+
+// === Memory-mapped writer ===
+
+// Allocates the file up to new_size and faults its pages in, so the writer
+// never waits for the file system or a page fault.
+static int journal_grow(PongJournal *j, size_t size, size_t new_size) {
+    if (posix_fallocate(j->fd, (off_t)size, (off_t)(new_size - size)) != 0 &&
+        ftruncate(j->fd, (off_t)new_size) != 0)
+        return 0;
+    // Without fallocate support, a sparse file still works.
+
+    for (size_t off = size; off < new_size; off += JOURNAL_PAGE)
+        ((volatile uint8_t *)j->map)[off] = 0;
+    // The new pages are all zero: writing one maps it in writable.
+    atomic_store_explicit(&j->size, new_size, memory_order_release);
+    return 1;
+}
+
+static void *journal_helper(void *arg) {
+    PongJournal *j = arg;
+    size_t synced = 0;
+    struct timespec period = { 0, JOURNAL_HELPER_MS * 1000000L };
+
+    while (!atomic_load(&j->stop)) {
+        nanosleep(&period, NULL);
+
+        size_t used = atomic_load_explicit(&j->used, memory_order_acquire);
+        size_t size = atomic_load_explicit(&j->size, memory_order_relaxed);
+        if (size - used < JOURNAL_SEGMENT && size < j->max_size)
+            journal_grow(j, size, size + JOURNAL_SEGMENT < j->max_size ? size + JOURNAL_SEGMENT : j->max_size);
+        // Always a segment ahead: the writer only drops records if it outruns
+        // a segment per period.
+
+        size_t from = synced & ~(size_t)(JOURNAL_PAGE - 1);
+        if (used > synced && msync(j->map + from, used - from, MS_ASYNC) == 0) synced = used;
+        // Starts the write-back; a server crash leaves it to the kernel anyway.
+    }
+    return NULL;
+}
+
+int pong_journal_open(PongJournal *j, const char *path, size_t max_size, size_t reserve,
+                      PongReplayFn recover, void *ctx) {
+    struct stat st;
+
+    j->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (j->fd < 0) return 0;
+    if (fstat(j->fd, &st) != 0) goto fail;
+
+    if (st.st_size > 0 && journal_compact(path, j->fd, (size_t)st.st_size)) {
+        close(j->fd);
+        j->fd = open(path, O_RDWR);
+        if (j->fd < 0) return 0;
+        if (fstat(j->fd, &st) != 0) goto fail;
+    }
+    // The rename left the old file to the descriptor: open the new one.
+
+    size_t size = (size_t)st.st_size;
+    if (size > max_size) max_size = size;
+    if (max_size < JOURNAL_MAGIC_SIZE + JOURNAL_SEGMENT + reserve) max_size = JOURNAL_MAGIC_SIZE + JOURNAL_SEGMENT + reserve;
+    j->max_size = max_size;
+    j->reserve = reserve;
+    j->dropped = 0;
+    atomic_init(&j->stop, 0);
+
+    j->map = mmap(NULL, max_size, PROT_READ | PROT_WRITE, MAP_SHARED, j->fd, 0);
+    if (j->map == MAP_FAILED) goto fail;
+    // The whole address range is reserved now; only the allocated part of the
+    // file may be touched.
+
+    atomic_init(&j->size, size);
+    if (size == 0) {
+        if (!journal_grow(j, 0, JOURNAL_SEGMENT)) goto fail_map;
+        memcpy(j->map, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE);
+        size = JOURNAL_SEGMENT;
+    } else if (size < JOURNAL_MAGIC_SIZE || memcmp(j->map, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) != 0) {
+        errno = EINVAL;
+        goto fail_map;
+    }
+
+    size_t used = JOURNAL_MAGIC_SIZE + pong_journal_replay(j->map + JOURNAL_MAGIC_SIZE, size - JOURNAL_MAGIC_SIZE,
+                                                           recover, ctx);
+    memset(j->map + used, 0, size - used);
+    // Whatever follows the last valid record is a torn one: new records go over it.
+    atomic_init(&j->used, used);
+
+    if (size - used < JOURNAL_SEGMENT && size < max_size) {
+        size_t new_size = size + JOURNAL_SEGMENT < max_size ? size + JOURNAL_SEGMENT : max_size;
+        if (!journal_grow(j, size, new_size)) goto fail_map;
+    }
+
+    errno = pthread_create(&j->helper, NULL, journal_helper, j);
+    if (errno != 0) goto fail_map;
+    return 1;
+
+fail_map:
+    munmap(j->map, max_size);
+fail:
+    {
+        int err = errno;
+        close(j->fd);
+        j->fd = -1;
+        errno = err;
+    }
+    return 0;
+}
+
+// Appends records below the given limit (max_size, or less the reserve).
+static int journal_append(PongJournal *j, const uint8_t *data, size_t len, size_t limit) {
+    size_t used = atomic_load_explicit(&j->used, memory_order_relaxed);
+    if (len == 0) return 1;
+    if (used + len > limit || used + len > atomic_load_explicit(&j->size, memory_order_acquire)) {
+        j->dropped += len;
+        return 0;
+    }
+
+    memcpy(j->map + used + 1, data + 1, len - 1);
+    atomic_thread_fence(memory_order_release);
+    ((volatile uint8_t *)j->map)[used] = data[0];
+    // The first kind byte goes in last: until then the replay stops in front
+    // of the whole append, so a crash in the middle of it never leaves half of it.
+
+    atomic_store_explicit(&j->used, used + len, memory_order_release);
+    return 1;
+}
+
+int pong_journal_append(PongJournal *j, const uint8_t *data, size_t len) {
+    return journal_append(j, data, len, j->max_size - j->reserve);
+}
+
+int pong_journal_append_end(PongJournal *j, const uint8_t *data, size_t len) {
+    return journal_append(j, data, len, j->max_size);
+}
+
+void pong_journal_close(PongJournal *j) {
+    if (j->fd < 0) return;
+
+    atomic_store(&j->stop, 1);
+    pthread_join(j->helper, NULL);
+
+    msync(j->map, atomic_load(&j->used), MS_SYNC);
+    munmap(j->map, j->max_size);
+    close(j->fd);
+    j->fd = -1;
+}
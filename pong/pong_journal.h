@@ -0,0 +1,126 @@
+#ifndef __PONG_JOURNAL_H__
+#define __PONG_JOURNAL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "pong_game.h"
+
+// === Input journal ===
+//
+// A log of everything a match's simulation depends on: the serve PRNG seed it
+// started from and, tick by tick, the changes to its inputs. Replaying the
+// log runs pong_game_step() again with the same arguments, so it reproduces
+// every match exactly, and rebuilds the matches that were still running when
+// a server stopped.
+//
+// File layout: "PONGJRN1", then records, then zero bytes up to the end of the
+// file. A record is a kind byte, the match slot and a tick as varints, and up
+// to four varint values:
+//
+//   START    slot tick seed hz serve_ticks   A new match in the slot, from this absolute tick
+//   INPUT1/2 slot delta input                Player 1's / 2's input (PONG_INPUT_*) from this tick on
+//   GRACE1/2 slot delta ticks                Scoring grace of player 1 / 2 from this tick on
+//   STEP     slot delta ticks                The step starting at this tick covers that many ticks
+//   SYNC     slot delta                      Nothing changed until this tick
+//   END      slot delta winner               The match ended here, with a winner by points
+//   ABORT    slot delta winner               The match was called off here (winner by forfeit, or 0)
+//   LOST     slot delta                      Records of the match were dropped: it can't be replayed
+//   RESUME1/2 slot delta token               Token player 1 / 2 rejoins the match with after a restart
+//
+// Apart from START, ticks are deltas from the match's previous record. Steps
+// are one tick long unless a STEP record says otherwise. A record costs 4 or 5
+// bytes and is only written when something changes, plus a SYNC once per
+// PONG_JOURNAL_SYNC_TICKS.
+
+#define PONG_JOURNAL_RECORD_MAX 26      // Longest record (START)
+#define PONG_JOURNAL_SYNC_TICKS 60      // Longest stretch without a record: what a restart may lose
+#define PONG_JOURNAL_MAX_SLOTS 65536
+
+enum {
+    PONG_JOURNAL_NONE,                  // Zero bytes: nothing was written past this point
+    PONG_JOURNAL_START,
+    PONG_JOURNAL_INPUT1, PONG_JOURNAL_INPUT2,
+    PONG_JOURNAL_GRACE1, PONG_JOURNAL_GRACE2,
+    PONG_JOURNAL_STEP,
+    PONG_JOURNAL_SYNC,
+    PONG_JOURNAL_END,
+    PONG_JOURNAL_ABORT,
+    PONG_JOURNAL_LOST,
+    PONG_JOURNAL_RESUME1, PONG_JOURNAL_RESUME2,
+    PONG_JOURNAL_KINDS
+};
+
+// Encodes a START record, or any other kind with its tick delta and value
+// (ignored by SYNC and LOST). Return the record length.
+size_t pong_journal_start(uint8_t *out, uint32_t slot, uint32_t tick, uint32_t seed, uint32_t hz, uint32_t serve_ticks);
+size_t pong_journal_event(uint8_t *out, int kind, uint32_t slot, uint32_t delta, uint32_t value);
+
+// === Replay ===
+typedef struct {
+    uint32_t slot;
+    size_t start_offset;      // Offset of its START record in the data replayed
+    PongGame game;            // State at the start of tick, with the last journaled inputs
+    uint32_t start_tick;      // Tick of the START record
+    uint32_t tick;            // Next tick to simulate
+    uint32_t last;            // Tick of the match's last record
+    uint32_t hz;
+    int serve_ticks;
+    int grace[2];
+    uint32_t resume[2];       // Resume tokens of its players (0 = none journaled)
+    uint32_t step_ticks;      // Length of the step starting at tick
+    int winner;               // Winner of the END or ABORT record
+    int ended;                // 1 after END or ABORT
+    int open;                 // 1 if the match was still running at the end of the journal
+    int lost;                 // 1 if the journal doesn't hold all of it
+    int mismatch;             // 1 if the replay's winner isn't the one END recorded
+} PongReplay;
+
+// Called for every match of a journal: when it ends, when a new START takes
+// its slot, or at the end of the journal for those still open.
+typedef void (*PongReplayFn)(void *ctx, const PongReplay *r);
+
+// Replays the records of data (without the file magic) and returns the length
+// of the valid ones: a torn record at the end, or garbage, stops the replay.
+size_t pong_journal_replay(const uint8_t *data, size_t len, PongReplayFn fn, void *ctx);
+
+// === Memory-mapped writer ===
+// The file is mapped once, up to max_size, and a helper thread keeps
+// allocating it a segment ahead of the writer and syncs it in the background,
+// so an append is a copy into memory that never waits for the disk. The last
+// reserve bytes are kept for the records that close a match (END, ABORT,
+// LOST): once the journal is full, every match it holds can still be closed,
+// and no restart brings back a match that went on without its records.
+typedef struct {
+    int fd;
+    uint8_t *map;
+    size_t max_size;
+    size_t reserve;           // Tail of max_size only pong_journal_append_end() may fill
+    _Atomic size_t used;      // Bytes written, magic included (advanced by the writer only)
+    _Atomic size_t size;      // Bytes of file allocated and mapped in (advanced by the helper only)
+    _Atomic int stop;
+    pthread_t helper;
+    uint64_t dropped;         // Bytes that found no room
+} PongJournal;
+
+// Opens or creates a journal, replays what it already holds through recover
+// (may be NULL) and positions the writer after the last valid record. An
+// existing file is first compacted to the matches still open in it (through a
+// "<path>.tmp" file renamed over it), so it starts again from what a restart
+// restores; if that fails, it is used as it is.
+// Returns 1 on success, 0 with errno set otherwise.
+int pong_journal_open(PongJournal *j, const char *path, size_t max_size, size_t reserve,
+                      PongReplayFn recover, void *ctx);
+
+// Appends records. Never blocks: returns 0 and counts them as dropped if the
+// helper hasn't made room for them (or the journal reached max_size - reserve).
+int pong_journal_append(PongJournal *j, const uint8_t *data, size_t len);
+
+// The same for records that close a match, which may use the reserve too.
+int pong_journal_append_end(PongJournal *j, const uint8_t *data, size_t len);
+
+// Stops the helper, syncs the file and unmaps it.
+void pong_journal_close(PongJournal *j);
+
+#endif /* __PONG_JOURNAL_H__ */
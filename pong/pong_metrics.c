@@ -0,0 +1,265 @@
+#include "pong_metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+PongMetrics pong_metrics;
+
+#define LOAD(x) atomic_load_explicit(&(x), memory_order_relaxed)
+#define STORE(x, v) atomic_store_explicit(&(x), (v), memory_order_relaxed)
+#define ADD(x, v) atomic_fetch_add_explicit(&(x), (v), memory_order_relaxed)
+
+// === Histogram ===
+
+static int hist_bucket(uint64_t ns) {
+    if (ns < 1024) return 0;
+    int e = 63 - __builtin_clzll(ns);
+    if (e >= 10 + PONG_HIST_OCTAVES) return PONG_HIST_BUCKETS - 1;
+    return 1 + (e - 10) * 4 + (int)((ns >> (e - 2)) & 3);
+    // The two bits below the leading one pick the quarter of the octave.
+}
+
+// Largest value a bucket holds (exclusive), UINT64_MAX for the last one.
+static uint64_t hist_upper(int b) {
+    if (b == 0) return 1024;
+    if (b == PONG_HIST_BUCKETS - 1) return UINT64_MAX;
+    int e = 10 + (b - 1) / 4;
+    return (uint64_t)(5 + (b - 1) % 4) << (e - 2);
+}
+
+void pong_hist_add(PongHistogram *h, uint64_t ns) {
+    ADD(h->buckets[hist_bucket(ns)], 1);
+    ADD(h->count, 1);
+    ADD(h->sum_ns, ns);
+    if (ns > LOAD(h->max_ns)) STORE(h->max_ns, ns);
+    // Single writer: no compare-and-swap needed.
+}
+
+uint64_t pong_hist_quantile(const PongHistogram *h, double q) {
+    uint64_t count = LOAD(h->count), max = LOAD(h->max_ns);
+    if (count == 0) return 0;
+
+    uint64_t rank = (uint64_t)(q * (double)count + 0.5), seen = 0;
+    if (rank == 0) rank = 1;
+    for (int b = 0; b < PONG_HIST_BUCKETS; b++) {
+        seen += LOAD(h->buckets[b]);
+        if (seen >= rank) return hist_upper(b) < max ? hist_upper(b) : max;
+    }
+    return max;
+}
+
+// Copies a histogram into another one, field by field.
+static void hist_copy(PongHistogram *to, const PongHistogram *from) {
+    for (int b = 0; b < PONG_HIST_BUCKETS; b++) STORE(to->buckets[b], LOAD(from->buckets[b]));
+    STORE(to->count, LOAD(from->count));
+    STORE(to->sum_ns, LOAD(from->sum_ns));
+    STORE(to->max_ns, LOAD(from->max_ns));
+}
+
+static void hist_clear(PongHistogram *h) {
+    for (int b = 0; b < PONG_HIST_BUCKETS; b++) STORE(h->buckets[b], 0);
+    STORE(h->count, 0);
+    STORE(h->sum_ns, 0);
+    STORE(h->max_ns, 0);
+}
+
+// === Updates ===
+
+void pong_metrics_frame(PongMetrics *m, uint32_t now_ms, uint64_t work_ns, uint32_t ticks, uint32_t inputs) {
+    pong_hist_add(&m->frame_ns, work_ns);
+    pong_hist_add(&m->frame_ns_current, work_ns);
+    ADD(m->frames, 1);
+    ADD(m->ticks, ticks);
+    ADD(m->input_lines, inputs);
+
+    m->second_inputs += inputs;
+    m->second_ticks += ticks;
+    uint32_t per_tick = ticks ? (inputs + ticks - 1) / ticks : inputs;
+    if (per_tick > m->second_max) m->second_max = per_tick;
+    // A frame that catches up several ticks drains their inputs at once: spread them.
+
+    uint32_t elapsed = now_ms - m->second_started;
+    if (elapsed < 1000) return;
+
+    uint64_t bytes = LOAD(m->bytes_sent), frames = LOAD(m->frames_sent);
+    STORE(m->bytes_per_sec, (uint32_t)((bytes - m->second_bytes) * 1000 / elapsed));
+    STORE(m->frames_per_sec, (uint32_t)((frames - m->second_frames) * 1000 / elapsed));
+    STORE(m->inputs_last, m->second_inputs);
+    STORE(m->ticks_last, m->second_ticks);
+    STORE(m->inputs_max, m->second_max);
+    hist_copy(&m->frame_ns_last, &m->frame_ns_current);
+    hist_clear(&m->frame_ns_current);
+
+    m->second_started = now_ms;
+    m->second_bytes = bytes;
+    m->second_frames = frames;
+    m->second_inputs = m->second_ticks = m->second_max = 0;
+}
+
+// === Rendering ===
+
+typedef struct {
+    char *buf;
+    size_t cap, len;
+} Out;
+
+static void out(Out *o, const char *fmt, ...) {
+    if (o->len + 1 >= o->cap) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+    va_end(ap);
+    o->len = n < 0 || o->len + (size_t)n >= o->cap ? o->cap - 1 : o->len + (size_t)n;
+}
+
+static double us(uint64_t ns) {
+    return (double)ns / 1000.0;
+}
+
+static void json_frame_time(Out *o, const char *name, const PongHistogram *h) {
+    uint64_t count = LOAD(h->count);
+    out(o, "  \"%s\": {\"frames\": %llu, \"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f, \"avg\": %.1f},\n",
+        name, (unsigned long long)count, us(pong_hist_quantile(h, 0.5)), us(pong_hist_quantile(h, 0.99)),
+        us(LOAD(h->max_ns)), count ? us(LOAD(h->sum_ns)) / (double)count : 0.0);
+}
+
+// The input latency stages, in the order an input goes through them.
+static const struct {
+    const char *name;
+    size_t offset;
+} input_stages[] = {
+    { "queue", offsetof(PongMetrics, input_queue_ns) },
+    { "tick", offsetof(PongMetrics, input_tick_ns) },
+    { "snapshot", offsetof(PongMetrics, input_snapshot_ns) },
+    { "send", offsetof(PongMetrics, input_send_ns) },
+    { "total", offsetof(PongMetrics, input_total_ns) },
+};
+#define INPUT_STAGES (sizeof(input_stages) / sizeof(input_stages[0]))
+
+static const PongHistogram *input_stage(const PongMetrics *m, size_t i) {
+    return (const PongHistogram *)((const char *)m + input_stages[i].offset);
+}
+
+static void json_input_latency(Out *o, const PongMetrics *m) {
+    out(o, "  \"input_latency_us\": {\n");
+    for (size_t i = 0; i < INPUT_STAGES; i++) {
+        const PongHistogram *h = input_stage(m, i);
+        uint64_t count = LOAD(h->count);
+        out(o, "    \"%s\": {\"inputs\": %llu, \"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f, \"avg\": %.1f}%s\n",
+            input_stages[i].name, (unsigned long long)count, us(pong_hist_quantile(h, 0.5)),
+            us(pong_hist_quantile(h, 0.99)), us(LOAD(h->max_ns)), count ? us(LOAD(h->sum_ns)) / (double)count : 0.0,
+            i + 1 < INPUT_STAGES ? "," : "");
+    }
+    out(o, "  },\n");
+}
+
+size_t pong_metrics_json(const PongMetrics *m, char *buf, size_t cap) {
+    Out o = { buf, cap, 0 };
+    uint32_t clients = LOAD(m->clients), spectators = LOAD(m->spectators);
+    uint32_t ticks_last = LOAD(m->ticks_last);
+
+    out(&o, "{\n");
+    out(&o, "  \"frames\": %llu,\n  \"ticks\": %llu,\n  \"late_ticks\": %llu,\n  \"skipped_ticks\": %llu,\n",
+        (unsigned long long)LOAD(m->frames), (unsigned long long)LOAD(m->ticks),
+        (unsigned long long)LOAD(m->late_ticks), (unsigned long long)LOAD(m->skipped_ticks));
+    json_frame_time(&o, "frame_us_last_second", &m->frame_ns_last);
+    json_frame_time(&o, "frame_us_total", &m->frame_ns);
+    out(&o, "  \"matches\": %u,\n  \"clients\": %u,\n  \"spectators\": %u,\n  \"connections\": %u,\n",
+        (unsigned)LOAD(m->matches), (unsigned)clients, (unsigned)spectators, (unsigned)(clients + spectators));
+    out(&o, "  \"connections_accepted\": %llu,\n  \"connections_rejected\": %llu,\n  \"connections_closed\": %llu,\n",
+        (unsigned long long)LOAD(m->conns_accepted), (unsigned long long)LOAD(m->conns_rejected),
+        (unsigned long long)LOAD(m->conns_closed));
+    out(&o, "  \"load_pct\": %u,\n  \"load_level\": %u,\n  \"workers\": %u,\n",
+        (unsigned)LOAD(m->load_pct), (unsigned)LOAD(m->load_level), (unsigned)LOAD(m->workers));
+    out(&o, "  \"bytes_per_sec\": %u,\n  \"snapshots_per_sec\": %u,\n",
+        (unsigned)LOAD(m->bytes_per_sec), (unsigned)LOAD(m->frames_per_sec));
+    out(&o, "  \"bytes_sent\": %llu,\n  \"snapshots_sent\": %llu,\n  \"datagrams_sent\": %llu,\n",
+        (unsigned long long)LOAD(m->bytes_sent), (unsigned long long)LOAD(m->frames_sent),
+        (unsigned long long)LOAD(m->datagrams_sent));
+    out(&o, "  \"input_backlog\": %u,\n", (unsigned)LOAD(m->input_backlog));
+    json_input_latency(&o, m);
+    out(&o, "  \"input_lines\": %llu,\n  \"input_lines_per_tick\": %.2f,\n  \"input_lines_per_tick_max\": %u\n",
+        (unsigned long long)LOAD(m->input_lines),
+        ticks_last ? (double)LOAD(m->inputs_last) / ticks_last : 0.0, (unsigned)LOAD(m->inputs_max));
+    out(&o, "}\n");
+    return o.len;
+}
+
+static void prom_metric(Out *o, const char *name, const char *type, const char *help) {
+    out(o, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void prom_counter(Out *o, const char *name, const char *help, uint64_t v) {
+    prom_metric(o, name, "counter", help);
+    out(o, "%s %llu\n", name, (unsigned long long)v);
+}
+
+static void prom_gauge(Out *o, const char *name, const char *help, double v) {
+    prom_metric(o, name, "gauge", help);
+    out(o, "%s %g\n", name, v);
+}
+
+// One series of a histogram metric; labels is empty or ends with a comma.
+static void prom_histogram(Out *o, const char *name, const char *labels, const PongHistogram *h) {
+    uint64_t cumulative = 0;
+    for (int b = 0; b < PONG_HIST_BUCKETS - 1; b++) {
+        cumulative += LOAD(h->buckets[b]);
+        if (b == 0 || b % 4 == 0)
+            out(o, "%s_bucket{%sle=\"%g\"} %llu\n", name, labels, (double)hist_upper(b) / 1e9,
+                (unsigned long long)cumulative);
+        // The text format only gets the powers of two: the quarters stay in the JSON quantiles.
+    }
+    out(o, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, labels, (unsigned long long)LOAD(h->count));
+
+    size_t n = strlen(labels);
+    if (n) out(o, "%s_sum{%.*s} %g\n%s_count{%.*s} %llu\n", name, (int)n - 1, labels, (double)LOAD(h->sum_ns) / 1e9,
+               name, (int)n - 1, labels, (unsigned long long)LOAD(h->count));
+    else out(o, "%s_sum %g\n%s_count %llu\n", name, (double)LOAD(h->sum_ns) / 1e9, name,
+             (unsigned long long)LOAD(h->count));
+}
+
+size_t pong_metrics_prometheus(const PongMetrics *m, char *buf, size_t cap) {
+    Out o = { buf, cap, 0 };
+    const PongHistogram *last = &m->frame_ns_last;
+
+    prom_metric(&o, "pong_frame_seconds", "histogram", "Work time of the server's frames.");
+    prom_histogram(&o, "pong_frame_seconds", "", &m->frame_ns);
+
+    prom_metric(&o, "pong_frame_last_second_seconds", "summary", "Work time of the frames of the last full second.");
+    out(&o, "pong_frame_last_second_seconds{quantile=\"0.5\"} %g\n", (double)pong_hist_quantile(last, 0.5) / 1e9);
+    out(&o, "pong_frame_last_second_seconds{quantile=\"0.99\"} %g\n", (double)pong_hist_quantile(last, 0.99) / 1e9);
+    out(&o, "pong_frame_last_second_seconds{quantile=\"1\"} %g\n", (double)LOAD(last->max_ns) / 1e9);
+    out(&o, "pong_frame_last_second_seconds_sum %g\npong_frame_last_second_seconds_count %llu\n",
+        (double)LOAD(last->sum_ns) / 1e9, (unsigned long long)LOAD(last->count));
+
+    prom_metric(&o, "pong_input_latency_seconds", "histogram",
+                "Time followed inputs spent in each stage on their way to a snapshot, total for all of them.");
+    for (size_t i = 0; i < INPUT_STAGES; i++) {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "stage=\"%s\",", input_stages[i].name);
+        prom_histogram(&o, "pong_input_latency_seconds", labels, input_stage(m, i));
+    }
+
+    prom_counter(&o, "pong_ticks_total", "Simulation ticks run.", LOAD(m->ticks));
+    prom_counter(&o, "pong_late_ticks_total", "Ticks whose frame started after its deadline.", LOAD(m->late_ticks));
+    prom_counter(&o, "pong_skipped_ticks_total", "Ticks dropped after an overrun.", LOAD(m->skipped_ticks));
+    prom_counter(&o, "pong_input_lines_total", "Input lines and datagrams drained.", LOAD(m->input_lines));
+    prom_counter(&o, "pong_connections_accepted_total", "Player connections accepted.", LOAD(m->conns_accepted));
+    prom_counter(&o, "pong_connections_rejected_total", "Player connections turned away.", LOAD(m->conns_rejected));
+    prom_counter(&o, "pong_connections_closed_total", "Player connections closed.", LOAD(m->conns_closed));
+    prom_counter(&o, "pong_sent_bytes_total", "Frame bytes written to players and spectators.", LOAD(m->bytes_sent));
+    prom_counter(&o, "pong_sent_snapshots_total", "Snapshot frames written to players and spectators.", LOAD(m->frames_sent));
+    prom_counter(&o, "pong_sent_datagrams_total", "Snapshot frames sent over the UDP channel.", LOAD(m->datagrams_sent));
+
+    prom_gauge(&o, "pong_matches", "Matches waiting or being played.", LOAD(m->matches));
+    prom_gauge(&o, "pong_clients", "Connected players, handshaking ones included.", LOAD(m->clients));
+    prom_gauge(&o, "pong_spectators", "Connected spectators.", LOAD(m->spectators));
+    prom_gauge(&o, "pong_load_ratio", "Smoothed share of the tick budget used.", LOAD(m->load_pct) / 100.0);
+    prom_gauge(&o, "pong_load_level", "Current load shedding level.", LOAD(m->load_level));
+    prom_gauge(&o, "pong_workers", "Threads the matches are stepped on.", LOAD(m->workers));
+    prom_gauge(&o, "pong_input_backlog", "Connections with input waiting at the last drain.", LOAD(m->input_backlog));
+    prom_gauge(&o, "pong_input_lines_per_tick_max", "Most input lines drained in a tick, last full second.",
+               LOAD(m->inputs_max));
+    return o.len;
+}
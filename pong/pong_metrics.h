@@ -0,0 +1,98 @@
+#ifndef __PONG_METRICS_H__
+#define __PONG_METRICS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// === Live server metrics ===
+//
+// Counters and gauges the server updates as it runs, rendered as JSON or in
+// the Prometheus text format by the HTTP server (pong_http.c) and served as a
+// private MIB by the SNMP agent (pong_mib.c). Every field has a single writer,
+// the game loop or the tcpip thread, and is read with relaxed atomics: a page
+// may mix values a frame apart, never torn ones.
+
+// Frame time histogram: 4 buckets per power of two from 1 us to 1 s, then
+// one for anything slower. Bucket 0 holds everything up to 1024 ns.
+#define PONG_HIST_OCTAVES 21
+#define PONG_HIST_BUCKETS (1 + PONG_HIST_OCTAVES * 4 + 1)
+
+typedef struct {
+    _Atomic uint64_t buckets[PONG_HIST_BUCKETS];
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t max_ns;
+} PongHistogram;
+
+// One match slot, for the per-match SNMP table (pong_mib.c).
+typedef struct {
+    _Atomic uint32_t state;           // 0 free, 1 waiting for players, 2 playing
+    _Atomic uint32_t ticks;           // Ticks simulated
+    _Atomic uint32_t snapshots;       // Snapshots taken for its players
+    _Atomic uint32_t inputs;          // Input lines and datagrams of its players
+    _Atomic uint32_t lag;             // Ticks behind which the later player's inputs arrive
+    _Atomic uint32_t score1, score2;
+} PongMatchStats;
+
+typedef struct {
+    // Game loop
+    PongHistogram frame_ns;           // Work time of every frame since the start
+    PongHistogram frame_ns_last;      // ... of the frames of the last full second
+    PongHistogram frame_ns_current;   // ... of the current second, moved to frame_ns_last once it is over
+    _Atomic uint64_t frames;
+    _Atomic uint64_t ticks;           // Simulation ticks, more than frames after overruns
+    _Atomic uint64_t late_ticks, skipped_ticks;   // From the tick scheduler
+    _Atomic uint64_t input_lines;     // Input lines and datagrams drained
+    _Atomic uint32_t matches, clients, spectators;
+    _Atomic uint32_t load_pct, load_level, workers;
+    _Atomic uint32_t input_backlog;   // Connections with input waiting when the last frame drained them
+    _Atomic uint64_t conns_accepted;  // Player connections accepted,
+    _Atomic uint64_t conns_rejected;  // ... turned away (server full, bad or missing HELLO),
+    _Atomic uint64_t conns_closed;    // ... and closed, whatever the reason
+    PongMatchStats *match_stats;      // One per match slot, set before the server starts
+    int max_matches;
+
+    // Input latency, stage by stage: one input per player at a time is followed
+    // from the wire to the stack (see pong.c). Game loop, then tcpip thread.
+    PongHistogram input_queue_ns;     // Reached the tcpip thread -> taken by the game loop
+    PongHistogram input_tick_ns;      // ... -> its match stepped with it
+    PongHistogram input_snapshot_ns;  // ... -> a snapshot showing it queued for the player
+    PongHistogram input_send_ns;      // ... -> written to the stack (tcpip thread)
+    PongHistogram input_total_ns;     // Reached the tcpip thread -> written to the stack (tcpip thread)
+
+    // tcpip thread
+    _Atomic uint64_t bytes_sent;      // Frame payload written to players and spectators
+    _Atomic uint64_t frames_sent;     // Snapshot frames (and the few GAMEOVERs) written
+    _Atomic uint64_t datagrams_sent;  // Of which over the UDP channel
+
+    // Last full second, computed by the game loop
+    _Atomic uint32_t bytes_per_sec, frames_per_sec;
+    _Atomic uint32_t inputs_last, ticks_last;     // Input lines drained over the ticks of the second
+    _Atomic uint32_t inputs_max;                  // Most input lines drained in a single tick
+
+    // Game loop only
+    uint32_t second_started;          // Time in ms the current second started
+    uint64_t second_bytes, second_frames;         // Totals when it started
+    uint32_t second_inputs, second_ticks, second_max;
+} PongMetrics;
+
+extern PongMetrics pong_metrics;
+
+void pong_hist_add(PongHistogram *h, uint64_t ns);
+
+// Upper bound of the bucket holding the q-th quantile (0..1), capped by the
+// largest value seen. 0 if the histogram is empty.
+uint64_t pong_hist_quantile(const PongHistogram *h, double q);
+
+// Accounts a frame of the given simulation ticks, its work time and the input
+// lines it drained. now_ms is any millisecond clock: when a second has passed
+// the per-second values are computed again.
+void pong_metrics_frame(PongMetrics *m, uint32_t now_ms, uint64_t work_ns, uint32_t ticks, uint32_t inputs);
+
+// Renders the metrics into buf, always NUL-terminated. Return the length, or
+// cap - 1 if the output was cut short.
+size_t pong_metrics_json(const PongMetrics *m, char *buf, size_t cap);
+size_t pong_metrics_prometheus(const PongMetrics *m, char *buf, size_t cap);
+
+#endif /* __PONG_METRICS_H__ */
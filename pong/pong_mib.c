@@ -0,0 +1,301 @@
+#include "pong_mib.h"
+#include "pong_metrics.h"
+#include "lwip/opt.h"
+
+#if LWIP_SNMP && SNMP_PRIVATE_MIB
+
+#include "lwip/snmp.h"
+#include "lwip/snmp_asn1.h"
+#include "lwip/snmp_structs.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include <stdlib.h>
+
+// === Private MIB ===
+// The pong server's counters, for the SNMP agent linked into the stack, under
+// the private subtree mib2.c hangs next to MIB-II:
+//
+//   .1.3.6.1.4.1.<PONG_MIB_ENTERPRISE>.<PONG_MIB_ARC>    pongMIB
+//     .1       pongGlobal       Scalars of the whole server
+//     .2.1     pongMatchEntry   One row per match slot in use, indexed by slot + 1
+//
+// Every value is read from pong_metrics, where the game loop publishes it with
+// relaxed atomics; the agent runs in the tcpip thread and never touches the
+// game's own tables, so a walk doesn't pause the tick.
+
+#ifndef PONG_MIB_ENTERPRISE
+#define PONG_MIB_ENTERPRISE 26381          // lwIP's enterprise number, as in the lwip-contrib example MIB
+#endif
+#ifndef PONG_MIB_ARC
+#define PONG_MIB_ARC 2                     // .1 is taken by that example
+#endif
+
+#define PONG_MIB_ROWS_MS 1000              // How often the list of rows is taken again
+
+#define ASN1_COUNTER (SNMP_ASN1_APPLIC | SNMP_ASN1_PRIMIT | SNMP_ASN1_COUNTER)
+#define ASN1_GAUGE   (SNMP_ASN1_APPLIC | SNMP_ASN1_PRIMIT | SNMP_ASN1_GAUGE)
+#define ASN1_INTEGER (SNMP_ASN1_UNIV | SNMP_ASN1_PRIMIT | SNMP_ASN1_INTEG)
+
+// === pongGlobal ===
+
+enum {
+    GLOBAL_TICKS = 1,          // Counter32: simulation ticks
+    GLOBAL_LATE_TICKS,         // Counter32: ticks that started after their deadline (overruns)
+    GLOBAL_SKIPPED_TICKS,      // Counter32: ticks dropped after a stall
+    GLOBAL_SNAPSHOTS_SENT,     // Counter32: snapshot frames written
+    GLOBAL_BYTES_SENT,         // Counter32: frame payload written
+    GLOBAL_INPUTS,             // Counter32: input lines and datagrams drained
+    GLOBAL_INPUT_BACKLOG,      // Gauge32: connections with input waiting at the last drain
+    GLOBAL_CONNS_ACCEPTED,     // Counter32
+    GLOBAL_CONNS_CLOSED,       // Counter32
+    GLOBAL_CONNS_REJECTED,     // Counter32
+    GLOBAL_MATCHES,            // Gauge32: active matches
+    GLOBAL_CLIENTS,            // Gauge32: connected players
+    GLOBAL_SPECTATORS,         // Gauge32: connected spectators
+    GLOBAL_FRAME_P99_US,       // Gauge32: 99th percentile frame work time of the last second
+    GLOBAL_LOAD_LEVEL,         // Gauge32: load shedding level (0 is none)
+    GLOBAL_COUNT = GLOBAL_LOAD_LEVEL
+};
+
+static void global_get_object_def(u8_t ident_len, s32_t *ident, struct obj_def *od) {
+    ident_len += 1;
+    ident -= 1;
+    // Back to the object's own arc, in front of the .0 instance.
+
+    if (ident_len != 2 || ident[0] < 1 || ident[0] > GLOBAL_COUNT) {
+        od->instance = MIB_OBJECT_NONE;
+        return;
+    }
+    od->id_inst_len = ident_len;
+    od->id_inst_ptr = ident;
+    od->instance = MIB_OBJECT_SCALAR;
+    od->access = MIB_OBJECT_READ_ONLY;
+    od->v_len = sizeof(u32_t);
+
+    switch (ident[0]) {
+    case GLOBAL_INPUT_BACKLOG: case GLOBAL_MATCHES: case GLOBAL_CLIENTS: case GLOBAL_SPECTATORS:
+    case GLOBAL_FRAME_P99_US: case GLOBAL_LOAD_LEVEL:
+        od->asn_type = ASN1_GAUGE;
+        break;
+    default:
+        od->asn_type = ASN1_COUNTER;
+    }
+}
+
+#define LOAD(field) atomic_load_explicit(&pong_metrics.field, memory_order_relaxed)
+
+static void global_get_value(struct obj_def *od, u16_t len, void *value) {
+    u32_t *v = (u32_t *)value;
+    LWIP_UNUSED_ARG(len);
+
+    switch (od->id_inst_ptr[0]) {
+    case GLOBAL_TICKS:          *v = (u32_t)LOAD(ticks); break;
+    case GLOBAL_LATE_TICKS:     *v = (u32_t)LOAD(late_ticks); break;
+    case GLOBAL_SKIPPED_TICKS:  *v = (u32_t)LOAD(skipped_ticks); break;
+    case GLOBAL_SNAPSHOTS_SENT: *v = (u32_t)LOAD(frames_sent); break;
+    case GLOBAL_BYTES_SENT:     *v = (u32_t)LOAD(bytes_sent); break;
+    case GLOBAL_INPUTS:         *v = (u32_t)LOAD(input_lines); break;
+    case GLOBAL_INPUT_BACKLOG:  *v = LOAD(input_backlog); break;
+    case GLOBAL_CONNS_ACCEPTED: *v = (u32_t)LOAD(conns_accepted); break;
+    case GLOBAL_CONNS_CLOSED:   *v = (u32_t)LOAD(conns_closed); break;
+    case GLOBAL_CONNS_REJECTED: *v = (u32_t)LOAD(conns_rejected); break;
+    case GLOBAL_MATCHES:        *v = LOAD(matches); break;
+    case GLOBAL_CLIENTS:        *v = LOAD(clients); break;
+    case GLOBAL_SPECTATORS:     *v = LOAD(spectators); break;
+    case GLOBAL_FRAME_P99_US:   *v = (u32_t)(pong_hist_quantile(&pong_metrics.frame_ns_last, 0.99) / 1000); break;
+    case GLOBAL_LOAD_LEVEL:     *v = LOAD(load_level); break;
+    default:                    *v = 0;
+    }
+    // Counter32 keeps the low 32 bits of the server's 64-bit totals: managers expect them to wrap.
+}
+
+static u8_t readonly_set_test(struct obj_def *od, u16_t len, void *value) {
+    LWIP_UNUSED_ARG(od);
+    LWIP_UNUSED_ARG(len);
+    LWIP_UNUSED_ARG(value);
+    return 0;
+}
+
+static const mib_scalar_node global_scalar = {
+    &global_get_object_def, &global_get_value, &readonly_set_test, &noleafs_set_value, MIB_NODE_SC, 0
+};
+
+static const s32_t global_ids[GLOBAL_COUNT] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+static struct mib_node *const global_nodes[GLOBAL_COUNT] = {
+    (struct mib_node *)&global_scalar, (struct mib_node *)&global_scalar, (struct mib_node *)&global_scalar,
+    (struct mib_node *)&global_scalar, (struct mib_node *)&global_scalar, (struct mib_node *)&global_scalar,
+    (struct mib_node *)&global_scalar, (struct mib_node *)&global_scalar, (struct mib_node *)&global_scalar,
+    (struct mib_node *)&global_scalar, (struct mib_node *)&global_scalar, (struct mib_node *)&global_scalar,
+    (struct mib_node *)&global_scalar, (struct mib_node *)&global_scalar, (struct mib_node *)&global_scalar
+};
+static const struct mib_array_node pong_global = {
+    &noleafs_get_object_def, &noleafs_get_value, &noleafs_set_test, &noleafs_set_value,
+    MIB_NODE_AR, GLOBAL_COUNT, global_ids, global_nodes
+};
+
+// === pongMatchTable ===
+
+enum {
+    MATCH_INDEX = 1,           // INTEGER: slot + 1
+    MATCH_STATE,               // INTEGER: 0 free, 1 waiting for players, 2 playing
+    MATCH_TICKS,               // Counter32: ticks simulated
+    MATCH_SCORE1,              // Gauge32
+    MATCH_SCORE2,              // Gauge32
+    MATCH_SNAPSHOTS,           // Counter32: snapshots taken for its players
+    MATCH_INPUTS,              // Counter32: input lines and datagrams of its players
+    MATCH_LAG,                 // Gauge32: ticks behind which the later player's inputs arrive
+    MATCH_COLUMNS = MATCH_LAG
+};
+
+// Rows are the slots in use, as of the last rows_update(). The objids and
+// leaves are sized for every slot once, at startup; maxlength says how many
+// are current. Only the tcpip thread reads or writes them.
+static s32_t *row_ids;
+static struct mib_node **row_nodes;        // All NULL: each row is a leaf of this node
+
+static void match_get_object_def(u8_t ident_len, s32_t *ident, struct obj_def *od);
+static void match_get_value(struct obj_def *od, u16_t len, void *value);
+
+static struct mib_ram_array_node match_rows = {
+    &match_get_object_def, &match_get_value, &readonly_set_test, &noleafs_set_value,
+    MIB_NODE_RA, 0, NULL, NULL
+};
+
+static void match_get_object_def(u8_t ident_len, s32_t *ident, struct obj_def *od) {
+    ident_len += 1;
+    ident -= 1;
+    // Back to the column, in front of the row index.
+
+    if (ident_len != 2 || ident[0] < 1 || ident[0] > MATCH_COLUMNS ||
+        ident[1] < 1 || ident[1] > pong_metrics.max_matches) {
+        od->instance = MIB_OBJECT_NONE;
+        return;
+    }
+    od->id_inst_len = ident_len;
+    od->id_inst_ptr = ident;
+    od->instance = MIB_OBJECT_TAB;
+    od->access = MIB_OBJECT_READ_ONLY;
+
+    switch (ident[0]) {
+    case MATCH_INDEX: case MATCH_STATE:
+        od->asn_type = ASN1_INTEGER;
+        od->v_len = sizeof(s32_t);
+        break;
+    case MATCH_SCORE1: case MATCH_SCORE2: case MATCH_LAG:
+        od->asn_type = ASN1_GAUGE;
+        od->v_len = sizeof(u32_t);
+        break;
+    default:
+        od->asn_type = ASN1_COUNTER;
+        od->v_len = sizeof(u32_t);
+    }
+}
+
+static void match_get_value(struct obj_def *od, u16_t len, void *value) {
+    int32_t row = od->id_inst_ptr[1];
+    const PongMatchStats *st = &pong_metrics.match_stats[row - 1];
+    u32_t *v = (u32_t *)value;
+    LWIP_UNUSED_ARG(len);
+
+    switch (od->id_inst_ptr[0]) {
+    case MATCH_INDEX:     *(s32_t *)value = row; break;
+    case MATCH_STATE:     *(s32_t *)value = (s32_t)atomic_load_explicit(&st->state, memory_order_acquire); break;
+    case MATCH_TICKS:     *v = atomic_load_explicit(&st->ticks, memory_order_relaxed); break;
+    case MATCH_SCORE1:    *v = atomic_load_explicit(&st->score1, memory_order_relaxed); break;
+    case MATCH_SCORE2:    *v = atomic_load_explicit(&st->score2, memory_order_relaxed); break;
+    case MATCH_SNAPSHOTS: *v = atomic_load_explicit(&st->snapshots, memory_order_relaxed); break;
+    case MATCH_INPUTS:    *v = atomic_load_explicit(&st->inputs, memory_order_relaxed); break;
+    case MATCH_LAG:       *v = atomic_load_explicit(&st->lag, memory_order_relaxed); break;
+    default:              *v = 0;
+    }
+    // A row freed since the last rows_update() reads as state 0 until then.
+}
+
+static const s32_t entry_ids[MATCH_COLUMNS] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+static struct mib_node *const entry_nodes[MATCH_COLUMNS] = {
+    (struct mib_node *)&match_rows, (struct mib_node *)&match_rows, (struct mib_node *)&match_rows,
+    (struct mib_node *)&match_rows, (struct mib_node *)&match_rows, (struct mib_node *)&match_rows,
+    (struct mib_node *)&match_rows, (struct mib_node *)&match_rows
+};
+static const struct mib_array_node match_entry = {
+    &noleafs_get_object_def, &noleafs_get_value, &noleafs_set_test, &noleafs_set_value,
+    MIB_NODE_AR, MATCH_COLUMNS, entry_ids, entry_nodes
+};
+
+static const s32_t table_ids[1] = { 1 };
+static struct mib_node *const table_nodes[1] = { (struct mib_node *)&match_entry };
+static const struct mib_array_node match_table = {
+    &noleafs_get_object_def, &noleafs_get_value, &noleafs_set_test, &noleafs_set_value,
+    MIB_NODE_AR, 1, table_ids, table_nodes
+};
+
+// === The subtree down from mib_private ===
+
+static const s32_t pong_ids[2] = { 1, 2 };
+static struct mib_node *const pong_nodes[2] = { (struct mib_node *)&pong_global, (struct mib_node *)&match_table };
+static const struct mib_array_node pong_mib = {
+    &noleafs_get_object_def, &noleafs_get_value, &noleafs_set_test, &noleafs_set_value,
+    MIB_NODE_AR, 2, pong_ids, pong_nodes
+};
+
+static const s32_t vendor_ids[1] = { PONG_MIB_ARC };
+static struct mib_node *const vendor_nodes[1] = { (struct mib_node *)&pong_mib };
+static const struct mib_array_node vendor = {
+    &noleafs_get_object_def, &noleafs_get_value, &noleafs_set_test, &noleafs_set_value,
+    MIB_NODE_AR, 1, vendor_ids, vendor_nodes
+};
+
+static const s32_t enterprises_ids[1] = { PONG_MIB_ENTERPRISE };
+static struct mib_node *const enterprises_nodes[1] = { (struct mib_node *)&vendor };
+static const struct mib_array_node enterprises = {
+    &noleafs_get_object_def, &noleafs_get_value, &noleafs_set_test, &noleafs_set_value,
+    MIB_NODE_AR, 1, enterprises_ids, enterprises_nodes
+};
+
+static const s32_t private_ids[1] = { 1 };
+static struct mib_node *const private_nodes[1] = { (struct mib_node *)&enterprises };
+const struct mib_array_node mib_private = {
+    &noleafs_get_object_def, &noleafs_get_value, &noleafs_set_test, &noleafs_set_value,
+    MIB_NODE_AR, 1, private_ids, private_nodes
+};
+
+// Takes the list of rows again from the slots' published states, in slot
+// order as a walk needs them. Runs every PONG_MIB_ROWS_MS in the tcpip thread.
+static void rows_update(void *arg) {
+    LWIP_UNUSED_ARG(arg);
+    u16_t n = 0;
+    for (int i = 0; i < pong_metrics.max_matches; i++)
+        if (atomic_load_explicit(&pong_metrics.match_stats[i].state, memory_order_acquire) != 0)
+            row_ids[n++] = i + 1;
+    match_rows.maxlength = n;
+
+    sys_timeout(PONG_MIB_ROWS_MS, rows_update, NULL);
+}
+
+static void rows_start(void *arg) {
+    LWIP_UNUSED_ARG(arg);
+    row_ids = calloc((size_t)pong_metrics.max_matches, sizeof(*row_ids));
+    row_nodes = calloc((size_t)pong_metrics.max_matches, sizeof(*row_nodes));
+    if (!row_ids || !row_nodes) {
+        free(row_ids);
+        free(row_nodes);
+        return;
+    }
+    // Without them the table stays empty; the scalars still answer.
+
+    match_rows.objid = row_ids;
+    match_rows.nptr = row_nodes;
+    rows_update(NULL);
+}
+
+void pong_mib_init(void) {
+    if (!pong_metrics.match_stats) return;
+    tcpip_callback(rows_start, NULL);
+}
+
+#else /* LWIP_SNMP && SNMP_PRIVATE_MIB */
+
+void pong_mib_init(void) {
+}
+
+#endif /* LWIP_SNMP && SNMP_PRIVATE_MIB */
@@ -0,0 +1,9 @@
+#ifndef __PONG_MIB_H__
+#define __PONG_MIB_H__
+
+// Starts serving the pong server's counters as a private MIB of the lwIP SNMP
+// agent (see pong_mib.c). Does nothing unless lwipopts.h enables LWIP_SNMP and
+// SNMP_PRIVATE_MIB. Call once, from any thread, after the match tables exist.
+void pong_mib_init(void);
+
+#endif /* __PONG_MIB_H__ */
@@ -0,0 +1,219 @@
+#include "pong_physics.h"
+
+// === Fixed point ===
+
+pong_fx pong_fx_mul(pong_fx a, pong_fx b) {
+    return (pong_fx)(((int64_t)a * b) / PONG_FX_ONE);
+    // Integer division truncates toward zero in C99, unlike a right shift of a
+    // negative number, which is implementation-defined.
+}
+
+pong_fx pong_fx_div(pong_fx a, pong_fx b) {
+    return (pong_fx)(((int64_t)a * PONG_FX_ONE) / b);
+}
+
+pong_fx pong_fx_tick(uint32_t hz) {
+    return (pong_fx)((int64_t)PONG_FX_ONE * PONG_BASE_HZ / hz);
+}
+
+int pong_paddle_rows(uint32_t tick, uint32_t hz) {
+    return (int)(((uint64_t)tick + 1) * PONG_BASE_HZ / hz - (uint64_t)tick * PONG_BASE_HZ / hz);
+    // Base ticks completed by the end of this tick, minus those completed before it.
+}
+
+// sin() of the first quarter turn, PONG_ANGLE_TURN / 4 + 1 entries in Q16.16.
+// Generated once with round(sin(i * pi / 512) * 65536); the values are the
+// table, never recomputed, so no libm is involved.
+static const pong_fx sin_table[PONG_ANGLE_TURN / 4 + 1] = {
+    0, 402, 804, 1206, 1608, 2010, 2412, 2814,
+    3216, 3617, 4019, 4420, 4821, 5222, 5623, 6023,
+    6424, 6824, 7224, 7623, 8022, 8421, 8820, 9218,
+    9616, 10014, 10411, 10808, 11204, 11600, 11996, 12391,
+    12785, 13180, 13573, 13966, 14359, 14751, 15143, 15534,
+    15924, 16314, 16703, 17091, 17479, 17867, 18253, 18639,
+    19024, 19409, 19792, 20175, 20557, 20939, 21320, 21699,
+    22078, 22457, 22834, 23210, 23586, 23961, 24335, 24708,
+    25080, 25451, 25821, 26190, 26558, 26925, 27291, 27656,
+    28020, 28383, 28745, 29106, 29466, 29824, 30182, 30538,
+    30893, 31248, 31600, 31952, 32303, 32652, 33000, 33347,
+    33692, 34037, 34380, 34721, 35062, 35401, 35738, 36075,
+    36410, 36744, 37076, 37407, 37736, 38064, 38391, 38716,
+    39040, 39362, 39683, 40002, 40320, 40636, 40951, 41264,
+    41576, 41886, 42194, 42501, 42806, 43110, 43412, 43713,
+    44011, 44308, 44604, 44898, 45190, 45480, 45769, 46056,
+    46341, 46624, 46906, 47186, 47464, 47741, 48015, 48288,
+    48559, 48828, 49095, 49361, 49624, 49886, 50146, 50404,
+    50660, 50914, 51166, 51417, 51665, 51911, 52156, 52398,
+    52639, 52878, 53114, 53349, 53581, 53812, 54040, 54267,
+    54491, 54714, 54934, 55152, 55368, 55582, 55794, 56004,
+    56212, 56418, 56621, 56823, 57022, 57219, 57414, 57607,
+    57798, 57986, 58172, 58356, 58538, 58718, 58896, 59071,
+    59244, 59415, 59583, 59750, 59914, 60075, 60235, 60392,
+    60547, 60700, 60851, 60999, 61145, 61288, 61429, 61568,
+    61705, 61839, 61971, 62101, 62228, 62353, 62476, 62596,
+    62714, 62830, 62943, 63054, 63162, 63268, 63372, 63473,
+    63572, 63668, 63763, 63854, 63944, 64031, 64115, 64197,
+    64277, 64354, 64429, 64501, 64571, 64639, 64704, 64766,
+    64827, 64884, 64940, 64993, 65043, 65091, 65137, 65180,
+    65220, 65259, 65294, 65328, 65358, 65387, 65413, 65436,
+    65457, 65476, 65492, 65505, 65516, 65525, 65531, 65535,
+    65536,
+};
+
+pong_fx pong_fx_sin(int angle) {
+    int a = angle & (PONG_ANGLE_TURN - 1);
+    int quarter = PONG_ANGLE_TURN / 4;
+    // Reduce to one turn; the mask also maps negative angles correctly in two's complement.
+
+    if (a < quarter) return sin_table[a];
+    if (a < 2 * quarter) return sin_table[2 * quarter - a];
+    if (a < 3 * quarter) return -sin_table[a - 2 * quarter];
+    return -sin_table[4 * quarter - a];
+}
+
+pong_fx pong_fx_cos(int angle) {
+    return pong_fx_sin(angle + PONG_ANGLE_TURN / 4);
+}
+
+int16_t pong_fx_quantize(pong_fx value, int scale) {
+    int64_t scaled = (int64_t)value * scale;
+    scaled = (scaled + (scaled >= 0 ? PONG_FX_ONE / 2 : -PONG_FX_ONE / 2)) / PONG_FX_ONE;
+    // Rounds half away from zero, like roundf() in pong_quantize().
+    if (scaled > INT16_MAX) return INT16_MAX;
+    if (scaled < INT16_MIN) return INT16_MIN;
+    return (int16_t)scaled;
+}
+
+pong_fx pong_fx_dequantize(int16_t value, int scale) {
+    return (pong_fx)((int64_t)value * PONG_FX_ONE / scale);
+}
+
+// === Random numbers ===
+
+void pong_rng_seed(PongRng *rng, uint32_t seed) {
+    rng->state = seed ? seed : 0x9e3779b9u;
+    // xorshift never leaves 0, so that seed is replaced.
+}
+
+uint32_t pong_rng_next(PongRng *rng) {
+    uint32_t x = rng->state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rng->state = x;
+}
+
+uint32_t pong_rng_below(PongRng *rng, uint32_t n) {
+    return (uint32_t)(((uint64_t)pong_rng_next(rng) * n) >> 32);
+    // Multiply-high instead of modulo: no bias toward the low bits.
+}
+
+// === Ball ===
+
+void pong_ball_serve(PongBall *ball, PongRng *rng, int serving_player, int serve_ticks) {
+    ball->x = PONG_FX_INT(PONG_FIELD_WIDTH / 2);
+    ball->y = PONG_FX_INT(PONG_FIELD_HEIGHT / 2);
+    // Places the ball at the center of the field.
+
+    ball->speed = PONG_BALL_SPEED_INITIAL;
+
+    int angle;
+    pong_fx sin;
+    do {
+        angle = (int)pong_rng_below(rng, 2 * PONG_SERVE_ANGLE + 1) - PONG_SERVE_ANGLE;
+        sin = pong_fx_sin(angle);
+    } while (sin > -PONG_SERVE_MIN_SIN && sin < PONG_SERVE_MIN_SIN);
+    // Almost horizontal serves are boring: draw again until the vertical component is large enough.
+
+    pong_fx dx = pong_fx_mul(ball->speed, pong_fx_cos(angle));
+    ball->dx = serving_player == 1 ? dx : -dx;
+    ball->dy = pong_fx_mul(ball->speed, sin);
+    // If player 1 is serving, the ball goes right (positive x); otherwise, it goes left.
+
+    ball->serve_timer = serve_ticks;
+    ball->out_ticks = 0;
+}
+
+// What the ball runs into first within a tick.
+enum { HIT_NONE, HIT_TOP, HIT_BOTTOM, HIT_PADDLE1, HIT_PADDLE2 };
+
+// Speeds the ball up after a paddle hit, up to PONG_BALL_SPEED_MAX,
+// keeping its direction.
+static void ball_speed_up(PongBall *ball) {
+    pong_fx speed = pong_fx_mul(ball->speed, PONG_SPEED_INCREASE_FACTOR);
+    if (speed > PONG_BALL_SPEED_MAX) speed = PONG_BALL_SPEED_MAX;
+    if (speed <= ball->speed) return;
+
+    pong_fx scale = pong_fx_div(speed, ball->speed);
+    ball->dx = pong_fx_mul(ball->dx, scale);
+    ball->dy = pong_fx_mul(ball->dy, scale);
+    ball->speed = speed;
+}
+
+// Time, in base ticks, the ball needs to travel dist at vel. Returns
+// a value above limit if it doesn't get there within limit (or moves away).
+static pong_fx time_to(pong_fx dist, pong_fx vel, pong_fx limit) {
+    if (vel == 0 || (dist < 0) != (vel < 0)) return limit + 1;
+    if ((int64_t)dist * (dist < 0 ? -1 : 1) > (int64_t)pong_fx_mul(vel < 0 ? -vel : vel, limit)) return limit + 1;
+    // Out of reach this tick: also keeps the division below from overflowing.
+    return pong_fx_div(dist, vel);
+}
+
+// Whether row y lies on a paddle whose top is at paddle_y.
+static int on_paddle(pong_fx y, int paddle_y) {
+    return y >= PONG_FX_INT(paddle_y) && y <= PONG_FX_INT(paddle_y + PONG_PADDLE_HEIGHT);
+}
+
+void pong_ball_step(PongBall *ball, int p1_y, int p2_y, pong_fx dt) {
+    const pong_fx top = 0, bottom = PONG_FX_INT(PONG_FIELD_HEIGHT - 1);
+    const pong_fx face1 = PONG_FX_INT(PONG_PADDLE_OFFSET_X + PONG_PADDLE_WIDTH);
+    const pong_fx face2 = PONG_FX_INT(PONG_FIELD_WIDTH - PONG_PADDLE_OFFSET_X - PONG_PADDLE_WIDTH);
+
+    if (ball->serve_timer > 0) {
+        ball->serve_timer--;
+        return;
+        // After a point the ball waits for the serve, giving players time to react.
+    }
+
+    // === Sweep the tick's path, bounce by bounce ===
+    // Each pass finds the first edge or paddle face the segment the ball still
+    // has to travel crosses, moves the ball exactly there and reflects it. No
+    // speed or tick rate can make the ball skip through a paddle.
+    pong_fx left = dt;
+    for (int pass = 0; pass < PONG_MAX_BOUNCES && left > 0; pass++) {
+        pong_fx t = left, tc;
+        int hit = HIT_NONE;
+
+        if (ball->dy < 0 && (tc = time_to(top - ball->y, ball->dy, t)) <= t) t = tc, hit = HIT_TOP;
+        if (ball->dy > 0 && (tc = time_to(bottom - ball->y, ball->dy, t)) <= t) t = tc, hit = HIT_BOTTOM;
+        if (ball->dx < 0 && ball->x >= face1 && (tc = time_to(face1 - ball->x, ball->dx, t)) <= t &&
+            on_paddle(ball->y + pong_fx_mul(ball->dy, tc), p1_y)) t = tc, hit = HIT_PADDLE1;
+        if (ball->dx > 0 && ball->x <= face2 && (tc = time_to(face2 - ball->x, ball->dx, t)) <= t &&
+            on_paddle(ball->y + pong_fx_mul(ball->dy, tc), p2_y)) t = tc, hit = HIT_PADDLE2;
+        // A face only counts where the ball crosses it at a row the paddle covers.
+
+        ball->x += pong_fx_mul(ball->dx, t);
+        ball->y += pong_fx_mul(ball->dy, t);
+        left -= t;
+
+        switch (hit) {
+        case HIT_TOP:     ball->y = top;    ball->dy = -ball->dy; break;
+        case HIT_BOTTOM:  ball->y = bottom; ball->dy = -ball->dy; break;
+        case HIT_PADDLE1: ball->x = face1;  ball->dx = -ball->dx; ball_speed_up(ball); break;
+        case HIT_PADDLE2: ball->x = face2;  ball->dx = -ball->dx; ball_speed_up(ball); break;
+        default: left = 0; break;
+        }
+        // Snapping to the exact contact point keeps rounding from building up.
+    }
+
+    // === Paddle moved onto the ball ===
+    // A ball already between a paddle's face and the edge of the field still
+    // bounces if the paddle slides over it, as it always did.
+    if (ball->dx < 0 && ball->x >= 0 && ball->x < face1 && on_paddle(ball->y, p1_y)) {
+        ball->dx = -ball->dx;
+        ball_speed_up(ball);
+    } else if (ball->dx > 0 && ball->x <= PONG_FX_INT(PONG_FIELD_WIDTH) && ball->x > face2 && on_paddle(ball->y, p2_y)) {
+        ball->dx = -ball->dx;
+        ball_speed_up(ball);
+    }
+}
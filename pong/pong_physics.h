@@ -0,0 +1,94 @@
+#ifndef __PONG_PHYSICS_H__
+#define __PONG_PHYSICS_H__
+
+#include <stdint.h>
+
+// === Fixed-point physics shared by the server and the client ===
+//
+// Everything here is integer math: Q16.16 fixed point, a seeded PRNG and a
+// sine table instead of float, rand() and sinf()/cosf(). The same state and
+// inputs give bit-identical results with any compiler on any machine, so the
+// client can run exactly the simulation the server runs.
+
+typedef int32_t pong_fx;                // Q16.16 fixed point
+
+#define PONG_FX_SHIFT 16
+#define PONG_FX_ONE (1 << PONG_FX_SHIFT)
+#define PONG_FX_INT(n) ((pong_fx)(n) * PONG_FX_ONE)
+
+// Field layout, in field units
+#define PONG_FIELD_WIDTH 80
+#define PONG_FIELD_HEIGHT 24
+#define PONG_PADDLE_HEIGHT 4
+#define PONG_PADDLE_WIDTH 2
+#define PONG_PADDLE_OFFSET_X 2          // Distance of each paddle from its edge
+
+// Velocities are in field units per base tick, 1/PONG_BASE_HZ of a second,
+// whatever the rate the simulation actually runs at (see pong_fx_tick).
+#define PONG_BASE_HZ 60
+
+// Angles are in PONG_ANGLE_TURN units per full turn.
+#define PONG_ANGLE_TURN 1024
+
+// Ball movement configuration (Q16.16 field units per base tick, angles as above)
+#define PONG_BALL_SPEED_INITIAL 32768   // 0.5
+#define PONG_BALL_SPEED_MAX 78643       // 1.2
+#define PONG_SPEED_INCREASE_FACTOR 67502   // 1.03, applied on every paddle hit
+#define PONG_BOUNCE_ANGLE_MAX (PONG_ANGLE_TURN / 8)     // pi/4
+#define PONG_BOUNCE_ANGLE_MIN 49                        // 0.3 rad
+#define PONG_SERVE_ANGLE (PONG_ANGLE_TURN / 12)         // Serves leave within +-30 degrees
+#define PONG_SERVE_MIN_SIN 19661                        // ... but never flatter than sin = 0.3
+#define PONG_MAX_BOUNCES 4              // Bounces resolved within one tick, more than any path can hit
+
+// Multiplies or divides two fixed-point values, truncating toward zero.
+// The quotient must fit in Q16.16.
+pong_fx pong_fx_mul(pong_fx a, pong_fx b);
+pong_fx pong_fx_div(pong_fx a, pong_fx b);
+
+// Length of one tick of a simulation running at hz, in base ticks.
+pong_fx pong_fx_tick(uint32_t hz);
+
+// Rows a paddle moves during the given tick of a simulation running at hz:
+// one per base tick, spread evenly over the ticks.
+int pong_paddle_rows(uint32_t tick, uint32_t hz);
+
+// Sine and cosine of an angle in PONG_ANGLE_TURN units, from a table.
+pong_fx pong_fx_sin(int angle);
+pong_fx pong_fx_cos(int angle);
+
+// Converts to and from the wire representation of pong_proto.h (value × scale).
+int16_t pong_fx_quantize(pong_fx value, int scale);
+pong_fx pong_fx_dequantize(int16_t value, int scale);
+
+// === Random numbers ===
+// xorshift32: small, fast and the same sequence everywhere for a given seed.
+typedef struct {
+    uint32_t state;
+} PongRng;
+
+void pong_rng_seed(PongRng *rng, uint32_t seed);
+uint32_t pong_rng_next(PongRng *rng);
+
+// Returns a number in [0, n).
+uint32_t pong_rng_below(PongRng *rng, uint32_t n);
+
+// === Ball ===
+typedef struct {
+    pong_fx x, y;      // Ball position
+    pong_fx dx, dy;    // Ball velocity, per base tick
+    pong_fx speed;     // Current ball speed
+    int serve_timer;   // Ticks before the ball is served
+    int out_ticks;     // Ticks the ball has been past a paddle, before the point counts (server)
+} PongBall;
+
+// Puts the ball back in the center and serves it toward the opponent of
+// serving_player (1 or 2) after serve_ticks, at a random angle.
+void pong_ball_serve(PongBall *ball, PongRng *rng, int serving_player, int serve_ticks);
+
+// Advances the ball by one tick of length dt (pong_fx_tick), given the paddle
+// rows: counts down the serve, or moves the ball along its path, bouncing it off the top and bottom edges
+// and the paddles at the exact point it reaches them. Each paddle hit speeds
+// the ball up by PONG_SPEED_INCREASE_FACTOR, up to PONG_BALL_SPEED_MAX.
+void pong_ball_step(PongBall *ball, int p1_y, int p2_y, pong_fx dt);
+
+#endif /* __PONG_PHYSICS_H__ */
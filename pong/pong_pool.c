@@ -0,0 +1,180 @@
+#include "pong_pool.h"
+
+#include <unistd.h>
+
+// === Shares ===
+
+static uint64_t range_pack(uint32_t begin, uint32_t end) {
+    return (uint64_t)end << 32 | begin;
+}
+
+// Takes up to PONG_POOL_CHUNK indexes from the front of a worker's own share.
+static int range_take(PongPoolQueue *q, uint32_t *begin, uint32_t *end) {
+    uint64_t r = atomic_load(&q->range);
+    for (;;) {
+        uint32_t b = (uint32_t)r, e = (uint32_t)(r >> 32);
+        if (b >= e) return 0;
+
+        uint32_t next = e - b > PONG_POOL_CHUNK ? b + PONG_POOL_CHUNK : e;
+        if (atomic_compare_exchange_weak(&q->range, &r, range_pack(next, e))) {
+            *begin = b;
+            *end = next;
+            return 1;
+        }
+        // A thief shortened the share meanwhile: r now holds what is left.
+    }
+}
+
+// Steals the back half of the largest share of the other workers and makes it
+// the thief's own share. Returns 0 once there is nothing left anywhere.
+static int range_steal(PongPool *pool, int self) {
+    for (;;) {
+        int victim = -1;
+        uint32_t most = 0;
+        uint64_t r = 0;
+
+        for (int w = 0; w < pool->workers; w++) {
+            if (w == self) continue;
+            uint64_t v = atomic_load(&pool->queue[w].range);
+            uint32_t left = (uint32_t)(v >> 32) - (uint32_t)v;
+            if ((int32_t)left > (int32_t)most) {
+                victim = w;
+                most = left;
+                r = v;
+            }
+        }
+        if (victim < 0) return 0;
+
+        uint32_t b = (uint32_t)r, e = (uint32_t)(r >> 32);
+        uint32_t split = e - (e - b + 1) / 2;
+        if (atomic_compare_exchange_strong(&pool->queue[victim].range, &r, range_pack(b, split))) {
+            atomic_store(&pool->queue[self].range, range_pack(split, e));
+            atomic_fetch_add_explicit(&pool->queue[self].steals, 1, memory_order_relaxed);
+            return 1;
+        }
+        // The victim or another thief got there first: look again.
+    }
+}
+
+static _Thread_local int pool_self;       // Worker index of the calling thread
+
+// Runs the current task until no worker has indexes left.
+static void pool_work(PongPool *pool, int self) {
+    PongPoolQueue *q = &pool->queue[self];
+    uint32_t begin, end;
+
+    pool_self = self;
+
+    do {
+        while (range_take(q, &begin, &end))
+            for (uint32_t i = begin; i < end; i++) pool->task(pool->ctx, (int)i);
+    } while (range_steal(pool, self));
+}
+
+// === Threads ===
+
+static void *pool_thread(void *arg) {
+    PongPoolQueue *q = arg;
+    PongPool *pool = q->pool;
+    uint32_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen && !pool->stop) pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->stop) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_work(pool, q->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int pong_pool_init(PongPool *pool, int workers) {
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    if (workers > PONG_POOL_MAX_WORKERS) workers = PONG_POOL_MAX_WORKERS;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->generation = 0;
+    pool->busy = 0;
+    pool->stop = 0;
+
+    for (int w = 0; w < PONG_POOL_MAX_WORKERS; w++) {
+        atomic_init(&pool->queue[w].range, 0);
+        atomic_init(&pool->queue[w].steals, 0);
+        pool->queue[w].pool = pool;
+        pool->queue[w].index = w;
+    }
+
+    pool->workers = 1;
+    while (pool->workers < workers &&
+           pthread_create(&pool->threads[pool->workers], NULL, pool_thread, &pool->queue[pool->workers]) == 0)
+        pool->workers++;
+    // Fewer threads than asked for still make a working pool.
+    return pool->workers;
+}
+
+void pong_pool_run(PongPool *pool, PongPoolTask task, void *ctx, int count) {
+    if (pool->workers <= 1 || count <= PONG_POOL_CHUNK) {
+        pool_self = 0;
+        for (int i = 0; i < count; i++) task(ctx, i);
+        return;
+    }
+    // Not worth waking anyone up.
+
+    for (int w = 0; w < pool->workers; w++) {
+        uint32_t begin = (uint32_t)((int64_t)count * w / pool->workers);
+        uint32_t end = (uint32_t)((int64_t)count * (w + 1) / pool->workers);
+        atomic_store(&pool->queue[w].range, range_pack(begin, end));
+    }
+    // Consecutive indexes stay on the same core, unless stolen.
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->ctx = ctx;
+    pool->generation++;
+    pool->busy = pool->workers - 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    // Every helper has left pool_work(), so every index has run.
+}
+
+int pong_pool_worker(void) {
+    return pool_self;
+}
+
+uint32_t pong_pool_steals(PongPool *pool) {
+    uint32_t steals = 0;
+    for (int w = 0; w < pool->workers; w++)
+        steals += atomic_load_explicit(&pool->queue[w].steals, memory_order_relaxed);
+    return steals;
+}
+
+void pong_pool_destroy(PongPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int w = 1; w < pool->workers; w++) pthread_join(pool->threads[w], NULL);
+    pool->workers = 1;
+
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+}
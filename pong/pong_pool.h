@@ -0,0 +1,67 @@
+#ifndef __PONG_POOL_H__
+#define __PONG_POOL_H__
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// === Work-stealing worker pool ===
+//
+// Runs a task over a range of indexes (the matches of a tick) on several
+// cores. The range is split evenly between the workers; each one takes
+// chunks of PONG_POOL_CHUNK from the front of its own share, and a worker
+// that runs out steals the back half of the largest share left. The thread
+// calling pong_pool_run() works as worker 0, and the call returns once every
+// index has been run: the end of the call is the barrier.
+
+#define PONG_POOL_MAX_WORKERS 64
+#define PONG_POOL_CHUNK 16              // Indexes taken at a time; runs smaller than this stay on the caller
+#define PONG_CACHE_LINE 64
+
+// Runs one index of the range, from any worker.
+typedef void (*PongPoolTask)(void *ctx, int index);
+
+struct PongPool;
+
+// One worker's share of the current run, on its own cache line: the owner
+// and the thieves only ever meet on it with a compare-and-swap.
+typedef struct {
+    _Alignas(PONG_CACHE_LINE) _Atomic uint64_t range;   // Indexes left: begin in the low 32 bits, end in the high 32
+    _Atomic uint32_t steals;          // Shares this worker stole, in total
+    struct PongPool *pool;
+    int index;
+} PongPoolQueue;
+
+typedef struct PongPool {
+    PongPoolQueue queue[PONG_POOL_MAX_WORKERS];
+    pthread_t threads[PONG_POOL_MAX_WORKERS];   // threads[0] unused: worker 0 is the caller
+    int workers;                      // Workers, counting the caller
+
+    pthread_mutex_t lock;             // Protects the fields below
+    pthread_cond_t start, done;
+    uint32_t generation;              // Bumped by every run the helpers take part in
+    int busy;                         // Helpers still working on the current run
+    int stop;
+    PongPoolTask task;
+    void *ctx;
+} PongPool;
+
+// Starts a pool of the given number of workers, counting the caller; 0 means
+// one per online CPU. Returns the number of workers running, which is 1 (the
+// caller alone) if no thread could be started.
+int pong_pool_init(PongPool *pool, int workers);
+
+// Runs task(ctx, i) for every i in [0, count) and returns when all are done.
+void pong_pool_run(PongPool *pool, PongPoolTask task, void *ctx, int count);
+
+// Index of the worker running the calling thread's task, from inside the
+// task: 0 on the caller of pong_pool_run().
+int pong_pool_worker(void);
+
+// Shares stolen by all workers since the pool started.
+uint32_t pong_pool_steals(PongPool *pool);
+
+// Stops the helper threads and waits for them to exit.
+void pong_pool_destroy(PongPool *pool);
+
+#endif /* __PONG_POOL_H__ */
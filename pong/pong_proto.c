@@ -0,0 +1,324 @@
+#include "pong_proto.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// === Primitive encoders ===
+
+// Writes an unsigned LEB128 varint: 7 bits per byte, high bit set while more follow.
+// Small values such as scores and paddle rows take a single byte.
+static uint8_t *put_varint(uint8_t *p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// Reads a varint, never past end. Returns NULL on truncated or oversized input.
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *v) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        result |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Fixed 16-bit fields are little-endian, independent of the host byte order.
+static uint8_t *put_s16(uint8_t *p, int16_t v) {
+    p[0] = (uint8_t)((uint16_t)v & 0xff);
+    p[1] = (uint8_t)((uint16_t)v >> 8);
+    return p + 2;
+}
+
+static const uint8_t *get_s16(const uint8_t *p, const uint8_t *end, int16_t *v) {
+    if (end - p < 2) return NULL;
+    *v = (int16_t)(uint16_t)(p[0] | (p[1] << 8));
+    return p + 2;
+}
+
+// === Quantization ===
+
+int16_t pong_quantize(float value, int scale) {
+    float scaled = roundf(value * scale);
+    if (scaled > INT16_MAX) return INT16_MAX;
+    if (scaled < INT16_MIN) return INT16_MIN;
+    return (int16_t)scaled;
+}
+
+float pong_dequantize(int16_t value, int scale) {
+    return (float)value / scale;
+}
+
+// === Snapshot fields ===
+// Paddle rows, scores and the serve timer are small unsigned values and go out as
+// varints; ball position and velocity are signed fixed point and use 16 bits.
+
+static int field_is_fixed(int f) {
+    return f >= PONG_FIELD_BALL_X && f <= PONG_FIELD_BALL_DY;
+}
+
+static int32_t field_get(const PongSnapshot *s, int f) {
+    switch (f) {
+    case PONG_FIELD_P1_Y:        return s->p1_y;
+    case PONG_FIELD_P2_Y:        return s->p2_y;
+    case PONG_FIELD_BALL_X:      return s->ball_x;
+    case PONG_FIELD_BALL_Y:      return s->ball_y;
+    case PONG_FIELD_BALL_DX:     return s->ball_dx;
+    case PONG_FIELD_BALL_DY:     return s->ball_dy;
+    case PONG_FIELD_SCORE1:      return s->score1;
+    case PONG_FIELD_SCORE2:      return s->score2;
+    default:                     return s->serve_timer;
+    }
+}
+
+static void field_set(PongSnapshot *s, int f, int32_t v) {
+    switch (f) {
+    case PONG_FIELD_P1_Y:        s->p1_y = (uint16_t)v; break;
+    case PONG_FIELD_P2_Y:        s->p2_y = (uint16_t)v; break;
+    case PONG_FIELD_BALL_X:      s->ball_x = (int16_t)v; break;
+    case PONG_FIELD_BALL_Y:      s->ball_y = (int16_t)v; break;
+    case PONG_FIELD_BALL_DX:     s->ball_dx = (int16_t)v; break;
+    case PONG_FIELD_BALL_DY:     s->ball_dy = (int16_t)v; break;
+    case PONG_FIELD_SCORE1:      s->score1 = (uint16_t)v; break;
+    case PONG_FIELD_SCORE2:      s->score2 = (uint16_t)v; break;
+    default:                     s->serve_timer = (uint16_t)v; break;
+    }
+}
+
+// Writes the fields selected by mask, in wire order.
+static uint8_t *put_fields(uint8_t *p, const PongSnapshot *snap, uint32_t mask) {
+    for (int f = 0; f < PONG_FIELD_COUNT; f++) {
+        if (!(mask & (1u << f))) continue;
+        if (field_is_fixed(f)) p = put_s16(p, (int16_t)field_get(snap, f));
+        else p = put_varint(p, (uint32_t)field_get(snap, f));
+    }
+    return p;
+}
+
+// Reads the fields selected by mask into snap, leaving the others untouched.
+static const uint8_t *get_fields(const uint8_t *p, const uint8_t *end, PongSnapshot *snap, uint32_t mask) {
+    for (int f = 0; f < PONG_FIELD_COUNT && p; f++) {
+        if (!(mask & (1u << f))) continue;
+        if (field_is_fixed(f)) {
+            int16_t v;
+            if ((p = get_s16(p, end, &v))) field_set(snap, f, v);
+        } else {
+            uint32_t v;
+            if ((p = get_varint(p, end, &v))) field_set(snap, f, (int32_t)v);
+        }
+    }
+    return p;
+}
+
+// === Frames ===
+
+// Fills in the two header bytes once the payload has been written.
+static size_t finish_frame(uint8_t *out, uint8_t type, const uint8_t *end) {
+    size_t len = (size_t)(end - out);
+    out[0] = type;
+    out[1] = (uint8_t)(len - PONG_FRAME_HEADER);
+    return len;
+}
+
+size_t pong_encode_snapshot(const PongSnapshot *snap, uint8_t *out, size_t cap) {
+    if (cap < PONG_FRAME_MAX) return 0;
+    // Worst case is well below PONG_FRAME_MAX, so no per-field bound checks are needed.
+
+    uint8_t *p = put_fields(out + PONG_FRAME_HEADER, snap, PONG_FIELDS_ALL);
+    return finish_frame(out, PONG_FRAME_SNAPSHOT, p);
+}
+
+size_t pong_encode_gameover(int winner, uint8_t *out, size_t cap) {
+    if (cap < PONG_FRAME_HEADER + 5) return 0;
+    uint8_t *p = put_varint(out + PONG_FRAME_HEADER, (uint32_t)winner);
+    return finish_frame(out, PONG_FRAME_GAMEOVER, p);
+}
+
+int pong_frame_peek(const uint8_t *buf, size_t len, uint8_t *type) {
+    if (len < PONG_FRAME_HEADER) return 0;
+    if (buf[0] != PONG_FRAME_SNAPSHOT && buf[0] != PONG_FRAME_GAMEOVER && buf[0] != PONG_FRAME_DELTA)
+        return -1;
+
+    size_t total = PONG_FRAME_HEADER + buf[1];
+    if (len < total) return 0;
+    *type = buf[0];
+    return (int)total;
+}
+
+int pong_decode_snapshot(const uint8_t *frame, size_t len, PongSnapshot *snap) {
+    return get_fields(frame + PONG_FRAME_HEADER, frame + len, snap, PONG_FIELDS_ALL) != NULL;
+}
+
+int pong_decode_gameover(const uint8_t *frame, size_t len, int *winner) {
+    uint32_t w;
+    if (!get_varint(frame + PONG_FRAME_HEADER, frame + len, &w)) return 0;
+    *winner = (int)w;
+    return 1;
+}
+
+// === Delta frames ===
+
+uint32_t pong_snapshot_diff(const PongSnapshot *a, const PongSnapshot *b) {
+    uint32_t mask = 0;
+    for (int f = 0; f < PONG_FIELD_COUNT; f++)
+        if (field_get(a, f) != field_get(b, f)) mask |= 1u << f;
+    return mask;
+}
+
+size_t pong_encode_delta(const PongSnapshot *snap, uint32_t seq,
+                         const PongSnapshot *base, uint32_t base_seq,
+                         uint8_t *out, size_t cap) {
+    if (cap < PONG_FRAME_MAX) return 0;
+
+    uint32_t mask = base ? pong_snapshot_diff(snap, base) : PONG_FIELDS_ALL;
+    uint8_t *p = out + PONG_FRAME_HEADER;
+    p = put_varint(p, seq);
+    p = put_varint(p, base ? seq - base_seq : 0);
+    p = put_varint(p, mask);
+    p = put_fields(p, snap, mask);
+    return finish_frame(out, PONG_FRAME_DELTA, p);
+}
+
+int pong_decode_delta_header(const uint8_t *frame, size_t len, uint32_t *seq, uint32_t *base_seq) {
+    const uint8_t *p = frame + PONG_FRAME_HEADER, *end = frame + len;
+    uint32_t offset;
+
+    if (!(p = get_varint(p, end, seq))) return 0;
+    if (!(p = get_varint(p, end, &offset))) return 0;
+    if (offset > *seq) return 0;
+    *base_seq = offset ? *seq - offset : 0;
+    return 1;
+}
+
+int pong_decode_delta(const uint8_t *frame, size_t len, PongSnapshot *snap) {
+    const uint8_t *p = frame + PONG_FRAME_HEADER, *end = frame + len;
+    uint32_t seq, offset, mask;
+
+    if (!(p = get_varint(p, end, &seq))) return 0;
+    if (!(p = get_varint(p, end, &offset))) return 0;
+    if (!(p = get_varint(p, end, &mask))) return 0;
+    if (!offset) *snap = (PongSnapshot){0};
+    // Frames without a baseline carry every field.
+
+    return get_fields(p, end, snap, mask & PONG_FIELDS_ALL) != NULL;
+}
+
+// === Datagrams ===
+
+size_t pong_encode_snapshot_dgram(const PongSnapshot *snap, uint32_t seq, uint8_t *out, size_t cap) {
+    if (cap < PONG_DGRAM_MAX) return 0;
+
+    uint8_t *p = out;
+    *p++ = PONG_DGRAM_SNAPSHOT;
+    p = put_varint(p, seq);
+    p = put_fields(p, snap, PONG_FIELDS_ALL);
+    return (size_t)(p - out);
+}
+
+size_t pong_encode_input_dgram(const PongInputDgram *in, uint8_t *out, size_t cap) {
+    if (cap < PONG_DGRAM_MAX || in->count == 0 || in->count > PONG_INPUT_REDUNDANCY) return 0;
+
+    uint8_t *p = out;
+    *p++ = PONG_DGRAM_INPUT;
+    p = put_varint(p, in->slot);
+    p = put_varint(p, in->token);
+    p = put_varint(p, in->seq);
+    p = put_varint(p, in->ack);
+    p = put_varint(p, in->stamp);
+    *p++ = in->count;
+    for (int i = 0; i < in->count; i++) *p++ = in->inputs[i];
+    return (size_t)(p - out);
+}
+
+int pong_decode_snapshot_dgram(const uint8_t *dgram, size_t len, uint32_t *seq, PongSnapshot *snap) {
+    const uint8_t *p = dgram, *end = dgram + len;
+
+    if (len < 1 || *p++ != PONG_DGRAM_SNAPSHOT) return 0;
+    if (!(p = get_varint(p, end, seq))) return 0;
+    return get_fields(p, end, snap, PONG_FIELDS_ALL) != NULL;
+}
+
+int pong_decode_input_dgram(const uint8_t *dgram, size_t len, PongInputDgram *in) {
+    const uint8_t *p = dgram, *end = dgram + len;
+
+    if (len < 1 || *p++ != PONG_DGRAM_INPUT) return 0;
+    if (!(p = get_varint(p, end, &in->slot))) return 0;
+    if (!(p = get_varint(p, end, &in->token))) return 0;
+    if (!(p = get_varint(p, end, &in->seq))) return 0;
+    if (!(p = get_varint(p, end, &in->ack))) return 0;
+    if (!(p = get_varint(p, end, &in->stamp))) return 0;
+    if (p >= end) return 0;
+
+    in->count = *p++;
+    if (in->count == 0 || in->count > PONG_INPUT_REDUNDANCY || end - p < in->count) return 0;
+    for (int i = 0; i < in->count; i++) {
+        in->inputs[i] = *p++;
+        if (in->inputs[i] > PONG_INPUT_DOWN) return 0;
+    }
+    return 1;
+}
+
+// === Snapshot history ===
+
+void pong_ring_put(PongSnapshotRing *ring, uint32_t seq, const PongSnapshot *snap) {
+    uint32_t slot = seq % PONG_SNAPSHOT_HISTORY;
+    ring->snap[slot] = *snap;
+    ring->seq[slot] = seq;
+}
+
+const PongSnapshot *pong_ring_get(const PongSnapshotRing *ring, uint32_t seq) {
+    uint32_t slot = seq % PONG_SNAPSHOT_HISTORY;
+    if (seq == 0 || ring->seq[slot] != seq) return NULL;
+    return &ring->snap[slot];
+}
+
+// === Text mode ===
+
+int pong_format_state(const PongSnapshot *snap, char *out, size_t cap) {
+    return snprintf(out, cap, "STATE:%d,%d,%.2f,%.2f,%.2f,%.2f,%d,%d,%d\n",
+                    snap->p1_y, snap->p2_y,
+                    pong_dequantize(snap->ball_x, PONG_POS_SCALE),
+                    pong_dequantize(snap->ball_y, PONG_POS_SCALE),
+                    pong_dequantize(snap->ball_dx, PONG_VEL_SCALE),
+                    pong_dequantize(snap->ball_dy, PONG_VEL_SCALE),
+                    snap->score1, snap->score2, snap->serve_timer);
+}
+
+int pong_parse_state(const char *line, PongSnapshot *snap) {
+    int p1_y, p2_y, score1, score2, timer;
+    float x, y, dx, dy;
+
+    if (sscanf(line, "STATE:%d,%d,%f,%f,%f,%f,%d,%d,%d",
+               &p1_y, &p2_y, &x, &y, &dx, &dy, &score1, &score2, &timer) != 9)
+        return 0;
+
+    snap->p1_y = (uint16_t)p1_y;
+    snap->p2_y = (uint16_t)p2_y;
+    snap->ball_x = pong_quantize(x, PONG_POS_SCALE);
+    snap->ball_y = pong_quantize(y, PONG_POS_SCALE);
+    snap->ball_dx = pong_quantize(dx, PONG_VEL_SCALE);
+    snap->ball_dy = pong_quantize(dy, PONG_VEL_SCALE);
+    snap->score1 = (uint16_t)score1;
+    snap->score2 = (uint16_t)score2;
+    snap->serve_timer = (uint16_t)timer;
+    return 1;
+}
+
+int pong_parse_input(const char *line) {
+    if (strncmp(line, "INPUT:UP", 8) == 0) return PONG_INPUT_UP;
+    // If the line starts with "INPUT:UP", we interpret it as the UP command.
+
+    if (strncmp(line, "INPUT:DOWN", 10) == 0) return PONG_INPUT_DOWN;
+    // If the line starts with "INPUT:DOWN", it's interpreted as the DOWN command.
+
+    return PONG_INPUT_NONE;
+    // If it doesn't match either, the input is ignored and treated as no movement.
+}
@@ -0,0 +1,201 @@
+#ifndef __PONG_PROTO_H__
+#define __PONG_PROTO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// === Wire protocol shared by the server and the client ===
+//
+// The handshake is always text:
+//   client → server   HELLO:<player>[ BIN:<version>][ RATE:<hz>][ RESUME:<token>]\n
+//   server → client   WELCOME <player>[ BIN:<version>] MATCH:<index>[ RESUME:<token>] HZ:<physics>:<input>:<snapshot>\n
+// HZ tells the server's rates: simulation ticks (the unit of serve_timer and of
+// the client's prediction steps), input samples and snapshot sequence numbers
+// per second. RATE asks for fewer snapshots than that; the client then gets
+// every n-th one.
+// A server that journals its matches gives each player a RESUME token. After a
+// restart, a match it restored only takes back players whose HELLO echoes
+// their token; everyone else gets a new match.
+// If the server echoes BIN:<version>, everything it sends afterwards is binary
+// frames; otherwise it keeps sending the STATE:/GAMEOVER: text lines, which
+// remain available for debugging with tools like netcat.
+//
+// Version 1 sends a full PONG_FRAME_SNAPSHOT every frame. Version 2 sends
+// PONG_FRAME_DELTA frames instead: the client acknowledges the newest snapshot
+// it has applied with an ACK:<seq>\n line, and each delta only carries the
+// fields that differ from that acknowledged baseline.
+//
+// Version 2 clients also stamp their input lines with the snapshot their
+// prediction had reached when the key changed, INPUT:<dir>@<seq>\n (the seq of
+// the newest snapshot applied plus the frames predicted since). The server
+// uses the stamp to apply the input at the tick the player acted on, as long
+// as that is within its short rewind window.
+//
+// Binary frame layout:
+//   byte 0      frame type
+//   byte 1      payload length
+//   byte 2..    payload
+//
+// Snapshot payload (PONG_FRAME_SNAPSHOT):
+//   varint  p1_y, p2_y                 paddle rows
+//   s16 LE  ball_x, ball_y             position, fixed point (PONG_POS_SCALE)
+//   s16 LE  ball_dx, ball_dy           velocity, fixed point (PONG_VEL_SCALE)
+//   varint  score1, score2, serve_timer
+//
+// Game over payload (PONG_FRAME_GAMEOVER):
+//   varint  winner                     1 or 2, 0 if the match was aborted
+//
+// Delta payload (PONG_FRAME_DELTA):
+//   varint  seq                        sequence number of this snapshot (starts at 1)
+//   varint  seq - baseline             0 if the frame doesn't depend on a baseline
+//   varint  field mask                 bit n set if field n follows (PONG_FIELD_*)
+//   ...     fields present in the mask, in snapshot payload order and encoding
+//
+// UDP channel (version 2 only): a client that adds " UDP" to its HELLO gets
+//   WELCOME <player> BIN:2 MATCH:<index> UDP:<port>:<slot>:<token>
+// and from then on sends its input in datagrams to that server port. Snapshots
+// come back as datagrams, unreliable and latest-wins: a datagram older than the
+// newest one applied is simply dropped. The TCP connection stays for what must
+// not get lost: deltas keep coming over it until the client has acknowledged a
+// snapshot with the current score, and GAMEOVER.
+//
+// Snapshot datagram (PONG_DGRAM_SNAPSHOT):
+//   byte 0      type
+//   varint      seq
+//   ...         snapshot payload
+//
+// Input datagram (PONG_DGRAM_INPUT):
+//   byte 0      type
+//   varint      slot, token            as given in WELCOME
+//   varint      seq                    sequence number of the newest input (starts at 1)
+//   varint      ack                    newest snapshot applied, as in ACK:<seq>
+//   varint      stamp                  snapshot the newest input was predicting, as in INPUT:<dir>@<seq>
+//   byte        count                  1..PONG_INPUT_REDUNDANCY
+//   count bytes inputs (PONG_INPUT_*), newest first: seq, seq - 1, ...
+
+#define PONG_PROTO_VERSION 2            // Newest binary version we speak
+#define PONG_PROTO_FULL 1               // Version with full snapshots only
+#define PONG_PROTO_DELTA 2              // Version with delta snapshots and ACKs
+
+#define PONG_FRAME_SNAPSHOT 0x01
+#define PONG_FRAME_GAMEOVER 0x02
+#define PONG_FRAME_DELTA 0x03
+
+#define PONG_DGRAM_SNAPSHOT 0x11
+#define PONG_DGRAM_INPUT 0x12
+#define PONG_DGRAM_MAX 64               // Largest datagram of either kind
+
+#define PONG_INPUT_REDUNDANCY 4         // Inputs repeated in each input datagram
+
+// Input values carried by input datagrams.
+enum { PONG_INPUT_NONE, PONG_INPUT_UP, PONG_INPUT_DOWN };
+
+// Snapshot fields, in wire order. Used as bit numbers in delta field masks.
+enum {
+    PONG_FIELD_P1_Y, PONG_FIELD_P2_Y,
+    PONG_FIELD_BALL_X, PONG_FIELD_BALL_Y,
+    PONG_FIELD_BALL_DX, PONG_FIELD_BALL_DY,
+    PONG_FIELD_SCORE1, PONG_FIELD_SCORE2,
+    PONG_FIELD_SERVE_TIMER,
+    PONG_FIELD_COUNT
+};
+
+#define PONG_FIELDS_ALL ((1u << PONG_FIELD_COUNT) - 1)
+
+#define PONG_SNAPSHOT_HISTORY 32        // Snapshots kept as possible delta baselines
+
+#define PONG_FRAME_HEADER 2             // Type byte + length byte
+#define PONG_FRAME_MAX 64               // Largest frame we ever produce
+
+#define PONG_POS_SCALE 256              // Position units per field unit (Q8.8)
+#define PONG_VEL_SCALE 4096             // Velocity units per field unit per 1/60 s (Q3.12)
+
+// Game state carried by one snapshot, already quantized for the wire.
+typedef struct {
+    uint16_t p1_y, p2_y;      // Paddle rows
+    int16_t ball_x, ball_y;   // Ball position × PONG_POS_SCALE
+    int16_t ball_dx, ball_dy; // Ball velocity × PONG_VEL_SCALE
+    uint16_t score1, score2;  // Scores
+    uint16_t serve_timer;     // Simulation ticks left before the ball is served
+} PongSnapshot;
+
+// Last PONG_SNAPSHOT_HISTORY snapshots, indexed by sequence number.
+// The server keeps one per match to encode deltas; the client keeps one to decode them.
+typedef struct {
+    PongSnapshot snap[PONG_SNAPSHOT_HISTORY];
+    uint32_t seq[PONG_SNAPSHOT_HISTORY];      // Sequence number stored in each slot (0 = empty)
+} PongSnapshotRing;
+
+// Quantizes a float position or velocity to its wire representation.
+int16_t pong_quantize(float value, int scale);
+
+// Converts a wire value back to a float.
+float pong_dequantize(int16_t value, int scale);
+
+// Writes a snapshot or game over frame. Returns the frame length, or 0 if cap is too small.
+size_t pong_encode_snapshot(const PongSnapshot *snap, uint8_t *out, size_t cap);
+size_t pong_encode_gameover(int winner, uint8_t *out, size_t cap);
+
+// Looks at the start of buf for a complete frame.
+// Returns its total length and stores its type, 0 if more bytes are needed,
+// or -1 if the data is not a valid frame.
+int pong_frame_peek(const uint8_t *buf, size_t len, uint8_t *type);
+
+// Decodes the payload of a complete frame returned by pong_frame_peek().
+// Return 1 on success, 0 if the payload is malformed.
+int pong_decode_snapshot(const uint8_t *frame, size_t len, PongSnapshot *snap);
+int pong_decode_gameover(const uint8_t *frame, size_t len, int *winner);
+
+// Returns the mask of fields that differ between two snapshots (0 if identical).
+uint32_t pong_snapshot_diff(const PongSnapshot *a, const PongSnapshot *b);
+
+// Writes a delta frame for snapshot seq against the baseline base_seq.
+// base may be NULL (base_seq is then ignored) to send every field.
+// Returns the frame length, or 0 if cap is too small.
+size_t pong_encode_delta(const PongSnapshot *snap, uint32_t seq,
+                         const PongSnapshot *base, uint32_t base_seq,
+                         uint8_t *out, size_t cap);
+
+// Reads the sequence numbers of a delta frame; base_seq is 0 if it needs no baseline.
+// Returns 1 on success, 0 if the header is malformed.
+int pong_decode_delta_header(const uint8_t *frame, size_t len, uint32_t *seq, uint32_t *base_seq);
+
+// Rebuilds the snapshot carried by a delta frame. snap must hold the baseline
+// on entry (ignored for frames without one) and holds the result on return.
+// Returns 1 on success, 0 if the frame is malformed.
+int pong_decode_delta(const uint8_t *frame, size_t len, PongSnapshot *snap);
+
+// Datagram input of a UDP client, decoded.
+typedef struct {
+    uint32_t slot, token;                     // Credentials from WELCOME
+    uint32_t seq;                             // Sequence number of inputs[0]
+    uint32_t ack;                             // Newest snapshot applied by the client
+    uint32_t stamp;                           // Snapshot inputs[0] was predicting (0 = unknown)
+    uint8_t count;                            // Valid entries in inputs
+    uint8_t inputs[PONG_INPUT_REDUNDANCY];    // Newest first
+} PongInputDgram;
+
+// Writes a snapshot or input datagram. Returns its length, or 0 if cap is too small.
+size_t pong_encode_snapshot_dgram(const PongSnapshot *snap, uint32_t seq, uint8_t *out, size_t cap);
+size_t pong_encode_input_dgram(const PongInputDgram *in, uint8_t *out, size_t cap);
+
+// Decodes a datagram of the given kind. Return 1 on success, 0 if it is malformed.
+int pong_decode_snapshot_dgram(const uint8_t *dgram, size_t len, uint32_t *seq, PongSnapshot *snap);
+int pong_decode_input_dgram(const uint8_t *dgram, size_t len, PongInputDgram *in);
+
+// Stores a snapshot in the ring, or looks one up. pong_ring_get() returns NULL
+// if seq is 0 or has already been overwritten.
+void pong_ring_put(PongSnapshotRing *ring, uint32_t seq, const PongSnapshot *snap);
+const PongSnapshot *pong_ring_get(const PongSnapshotRing *ring, uint32_t seq);
+
+// Text mode: formats or parses a "STATE:..." line.
+// pong_format_state() returns the line length (including the newline);
+// pong_parse_state() returns 1 if the line was a complete STATE message.
+int pong_format_state(const PongSnapshot *snap, char *out, size_t cap);
+int pong_parse_state(const char *line, PongSnapshot *snap);
+
+// Parses the direction of an "INPUT:UP" or "INPUT:DOWN" line, ignoring any
+// "@<seq>" stamp. Returns a PONG_INPUT_* value, PONG_INPUT_NONE for anything else.
+int pong_parse_input(const char *line);
+
+#endif /* __PONG_PROTO_H__ */
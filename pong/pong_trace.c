@@ -0,0 +1,137 @@
+#include "pong_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+PongTrace pong_trace;
+
+#define EVENT_JSON_MAX 192                 // Longest rendered event, with room to spare
+
+static const struct {
+    const char *name;
+    const char *count;                     // Name of the count argument
+    const char *busy;                      // Name of the busy argument, NULL if unused
+} phases[PONG_TRACE_PHASES] = {
+    [PONG_TRACE_FRAME]           = { "frame", "ticks", NULL },
+    [PONG_TRACE_SLEEP]           = { "sleep", "ticks", NULL },
+    [PONG_TRACE_INPUT]           = { "input", "lines", NULL },
+    [PONG_TRACE_STEP]            = { "step", "matches", NULL },
+    [PONG_TRACE_MATCHES]         = { "matches", "matches", "stepping_us" },
+    [PONG_TRACE_BROADCAST]       = { "broadcast", "snapshots", "serialize_us" },
+    [PONG_TRACE_FANOUT]          = { "fanout", "frames", NULL },
+    [PONG_TRACE_FANOUT_WRITE]    = { "fanout write", "frames", "mailbox_us" },
+    [PONG_TRACE_SPECTATORS]      = { "spectators", "frames", NULL },
+    [PONG_TRACE_SPECTATOR_WRITE] = { "spectator write", "frames", "mailbox_us" },
+};
+
+int pong_trace_init(PongTrace *t, uint32_t events) {
+    uint32_t cap = 1;
+    while (cap < events && cap < (1u << 30)) cap <<= 1;
+
+    for (int i = 0; i < PONG_TRACE_RINGS; i++) {
+        PongTraceRing *r = &t->rings[i];
+        r->events = calloc(cap, sizeof(PongTraceEvent));
+        if (!r->events) {
+            for (int k = 0; k < i; k++) {
+                free(t->rings[k].events);
+                t->rings[k].events = NULL;
+            }
+            return 0;
+        }
+        r->mask = cap - 1;
+        atomic_init(&r->head, 0);
+    }
+
+    t->cycles0 = pong_trace_cycles();
+    t->ns0 = pong_clock_ns();
+    return 1;
+}
+
+// Copies the events still in a ring into out[], oldest first, leaving out
+// those the writer overwrote while they were copied. Returns how many.
+static uint32_t ring_copy(PongTraceRing *r, PongTraceEvent *out) {
+    uint64_t cap = (uint64_t)r->mask + 1;
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    uint64_t from = head > cap ? head - cap : 0;
+
+    for (uint64_t i = from; i < head; i++) out[i - from] = r->events[i & r->mask];
+
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t now = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint64_t valid = now >= cap ? now - cap + 1 : 0;
+    // Whatever the writer stored into a slot we read, it published the head
+    // before (see pong_trace_put): slots of events older than valid may be torn.
+    if (valid <= from) return (uint32_t)(head - from);
+    if (valid >= head) return 0;
+
+    uint32_t n = (uint32_t)(head - valid);
+    for (uint32_t i = 0; i < n; i++) out[i] = out[valid - from + i];
+    return n;
+}
+
+size_t pong_trace_json(PongTrace *t, char **out) {
+    *out = NULL;
+    if (!pong_trace_on(t)) return 0;
+
+    uint32_t cap = t->rings[0].mask + 1;
+    PongTraceEvent *events = malloc((size_t)cap * PONG_TRACE_RINGS * sizeof(PongTraceEvent));
+    if (!events) return 0;
+
+    uint32_t count = 0;
+    for (int i = 0; i < PONG_TRACE_RINGS; i++) count += ring_copy(&t->rings[i], events + count);
+
+    uint64_t cycles = pong_trace_cycles() - t->cycles0, ns = pong_clock_ns() - t->ns0;
+    double us_per_cycle = cycles ? (double)ns / (double)cycles / 1000.0 : 0.001;
+    // Measured over the whole time tracing has been on: the counters we read
+    // tick at a constant rate whatever the core's frequency.
+
+    uint32_t tids = 0;
+    for (uint32_t i = 0; i < count; i++)
+        if (events[i].tid >= tids) tids = events[i].tid + 1u;
+
+    size_t size = ((size_t)count + tids + 2) * EVENT_JSON_MAX;
+    char *buf = malloc(size);
+    if (!buf) {
+        free(events);
+        return 0;
+    }
+
+    size_t len = 0;
+    const char *sep = "\n";
+    len += (size_t)snprintf(buf + len, size - len, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    for (uint32_t tid = 0; tid < tids; tid++) {
+        char name[32];
+        if (tid == PONG_TRACE_TID_LOOP) snprintf(name, sizeof(name), "game loop");
+        else if (tid == PONG_TRACE_TID_TCPIP) snprintf(name, sizeof(name), "tcpip thread");
+        else snprintf(name, sizeof(name), "worker %u", (unsigned)(tid - PONG_TRACE_TID_WORKER + 1));
+        len += (size_t)snprintf(buf + len, size - len,
+                                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                                sep, (unsigned)tid, name);
+        sep = ",\n";
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const PongTraceEvent *e = &events[i];
+        if (e->phase >= PONG_TRACE_PHASES) continue;
+
+        double ts = (double)(int64_t)(e->start - t->cycles0) * us_per_cycle;
+        len += (size_t)snprintf(buf + len, size - len,
+                                "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                                "\"args\":{\"%s\":%u",
+                                sep, phases[e->phase].name, (unsigned)e->tid, ts, e->cycles * us_per_cycle,
+                                phases[e->phase].count, (unsigned)e->count);
+        if (phases[e->phase].busy)
+            len += (size_t)snprintf(buf + len, size - len, ",\"%s\":%.3f", phases[e->phase].busy,
+                                    e->busy * us_per_cycle);
+        len += (size_t)snprintf(buf + len, size - len, "}}");
+        sep = ",\n";
+    }
+    // Each event fits in EVENT_JSON_MAX, so none of these can run past the end.
+
+    len += (size_t)snprintf(buf + len, size - len, "\n]}\n");
+
+    free(events);
+    *out = buf;
+    return len;
+}
@@ -0,0 +1,115 @@
+#ifndef __PONG_TRACE_H__
+#define __PONG_TRACE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "pong_clock.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// === Frame phase profiler ===
+//
+// Spans of the game loop's phases, timed with the CPU's cycle counter and kept
+// in rings that overwrite their oldest events. Each ring has a single writer
+// and is never locked: pong_trace_json() copies what it needs and drops the
+// events overwritten meanwhile. The export is a Chrome trace (JSON), which
+// chrome://tracing and ui.perfetto.dev open as one track per thread.
+
+typedef enum {
+    PONG_TRACE_FRAME,            // A whole frame                      count: ticks
+    PONG_TRACE_SLEEP,            // Waiting for the next deadline      count: ticks due
+    PONG_TRACE_INPUT,            // Accepts, input drain, lobby        count: input lines
+    PONG_TRACE_STEP,             // Stepping every match, barrier included   count: matches
+    PONG_TRACE_MATCHES,          // One worker's matches of the step   count: matches, busy: stepping
+    PONG_TRACE_BROADCAST,        // Journal, snapshots, match ends     count: snapshots, busy: serializing
+    PONG_TRACE_FANOUT,           // Handing the send queue over and waiting for it   count: frames
+    PONG_TRACE_FANOUT_WRITE,     // Writing it, in the tcpip thread    count: frames, busy: mailbox wait
+    PONG_TRACE_SPECTATORS,       // Building the spectator batch       count: frames
+    PONG_TRACE_SPECTATOR_WRITE,  // Writing a chunk of it              count: frames, busy: mailbox wait
+    PONG_TRACE_PHASES
+} PongTracePhase;
+
+// Tracks of the trace: the game loop, the tcpip thread, then the pool's
+// helper workers (worker n on PONG_TRACE_TID_WORKER + n - 1).
+#define PONG_TRACE_TID_LOOP 0
+#define PONG_TRACE_TID_TCPIP 1
+#define PONG_TRACE_TID_WORKER 2
+
+typedef struct {
+    uint64_t start;              // Cycle counter at the start
+    uint32_t cycles;             // Length, saturated
+    uint32_t count;              // Meaning depends on the phase, see above
+    uint32_t busy;               // Cycles of the part named for the phase, saturated
+    uint16_t phase;
+    uint16_t tid;
+} PongTraceEvent;
+
+typedef struct {
+    PongTraceEvent *events;      // NULL while tracing is off
+    uint32_t mask;               // Capacity - 1, a power of two
+    _Atomic uint64_t head;       // Events written so far
+} PongTraceRing;
+
+// The game loop writes rings[0] (for the pool's workers too, once they are
+// done), the tcpip thread rings[1]. In raw mode both are the same thread.
+#define PONG_TRACE_RING_LOOP 0
+#define PONG_TRACE_RING_TCPIP 1
+#define PONG_TRACE_RINGS 2
+
+typedef struct {
+    PongTraceRing rings[PONG_TRACE_RINGS];
+    uint64_t cycles0, ns0;       // Both clocks when tracing started, to convert cycles
+} PongTrace;
+
+extern PongTrace pong_trace;
+
+// Cycle counter of the CPU, or the monotonic clock where there is none.
+static inline uint64_t pong_trace_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return pong_clock_ns();
+#endif
+}
+
+// Starts tracing with rings of at least the given number of events each
+// (rounded up to a power of two). Returns 0 if they couldn't be allocated.
+int pong_trace_init(PongTrace *t, uint32_t events);
+
+// Whether tracing is on.
+static inline int pong_trace_on(const PongTrace *t) {
+    return t->rings[0].events != NULL;
+}
+
+// Appends a span to a ring; only its one writer may call this.
+static inline void pong_trace_put(PongTraceRing *r, PongTracePhase phase, int tid, uint64_t start,
+                                  uint64_t end, uint32_t count, uint64_t busy) {
+    if (!r->events) return;
+    uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    // Orders the last head update before the slot is reused (see pong_trace_json).
+
+    PongTraceEvent *e = &r->events[h & r->mask];
+    e->start = start;
+    e->cycles = end - start > UINT32_MAX ? UINT32_MAX : (uint32_t)(end - start);
+    e->count = count;
+    e->busy = busy > UINT32_MAX ? UINT32_MAX : (uint32_t)busy;
+    e->phase = (uint16_t)phase;
+    e->tid = (uint16_t)tid;
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+// Renders every event still in the rings as a Chrome trace into a buffer
+// allocated with malloc(), which the caller frees. Returns its length, 0 (and
+// *out NULL) if tracing is off or memory ran out.
+size_t pong_trace_json(PongTrace *t, char **out);
+
+#endif /* __PONG_TRACE_H__ */
@@ -0,0 +1,10 @@
+#ifndef __PRIVATE_MIB_H__
+#define __PRIVATE_MIB_H__
+
+// Included by lwIP's snmp_structs.h when SNMP_PRIVATE_MIB is set: the root of
+// the private subtree (.1.3.6.1.4) that mib2.c hangs next to MIB-II.
+// Defined in pong_mib.c.
+
+extern const struct mib_array_node mib_private;
+
+#endif /* __PRIVATE_MIB_H__ */